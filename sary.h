@@ -3,14 +3,23 @@
 
 #include <sary/array.h>
 #include <sary/bsearch.h>
+#include <sary/bucket.h>
 #include <sary/builder.h>
 #include <sary/cache.h>
+#include <sary/child.h>
+#include <sary/fmindex.h>
+#include <sary/header.h>
 #include <sary/i.h>
 #include <sary/ipoint.h>
+#include <sary/lcp.h>
 #include <sary/merger.h>
 #include <sary/mkqsort.h>
 #include <sary/mmap.h>
+#include <sary/prefix.h>
 #include <sary/progress.h>
+#include <sary/qsufsort.h>
+#include <sary/sais.h>
+#include <sary/sample.h>
 #include <sary/saryconfig.h>
 #include <sary/searcher.h>
 #include <sary/sorter.h>
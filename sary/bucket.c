@@ -0,0 +1,320 @@
+/*
+ * sary - a suffix array library
+ *
+ * $Id$
+ *
+ * Copyright (C) 2000  Satoru Takabayashi <satoru@namazu.org>
+ * All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+#include <glib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sary.h>
+
+/*
+ * Bucket sorting:
+ *
+ * Index points are partitioned in place by the first two
+ * bytes of their suffixes with one counting pass. The
+ * buckets are then in their final order and each one is
+ * sorted by Multikey Quicksort independently, so that
+ * threads share the work without merging.
+ *
+ * Buckets are handed to the threads largest first. A
+ * bucket larger than a thread's share, such as the one of
+ * a frequent pair of bytes, is sorted alone by all the
+ * threads instead.
+ */
+
+enum {
+    NBUCKETS = 257 * 257  /* two bytes or eof */
+};
+
+/*
+ * Bucket i holds array[starts[i] .. starts[i + 1] - 1].
+ * `order' lists the buckets left to the threads and
+ * `cursor' is the next one of them.
+ */
+typedef struct {
+    gboolean		cached;
+    SaryProgress	*progress;
+    SaryInt		*array;
+    SaryInt		*starts;
+    SaryInt		*order;
+    SaryInt		norder;
+    SaryInt		cursor;
+    SaryInt		nbytes;
+    SaryInt		limit;
+    const gchar		*bof;
+    const gchar		*eof;
+    pthread_mutex_t	mutex;
+} Buckets;
+
+static void		bucket_sort	(gboolean cached,
+					 SaryProgress *progress,
+					 SaryInt *array,
+					 SaryInt len,
+					 SaryInt limit,
+					 const gchar *bof,
+					 const gchar *eof,
+					 gint nthreads);
+static void		partition	(SaryInt *array,
+					 SaryInt len,
+					 SaryInt *starts,
+					 SaryInt nbytes,
+					 const gchar *bof,
+					 const gchar *eof);
+static inline SaryInt	get_bucket	(SaryInt offset,
+					 SaryInt nbytes,
+					 const gchar *bof,
+					 const gchar *eof);
+static gint		lencmp		(gconstpointer b1,
+					 gconstpointer b2,
+					 gpointer starts);
+static void		sort_buckets	(Buckets *buckets);
+static void		advance		(SaryProgress *progress,
+					 SaryInt count);
+
+
+/*
+ * Sort the whole array with `nthreads' threads. Suffixes
+ * sharing the first `limit' bytes are sorted by their
+ * positions if `limit' is not 0. See
+ * sary_multikey_qsort_bounded().
+ */
+void
+sary_bucket_sort (SaryProgress *progress,
+		  SaryInt *array,
+		  SaryInt len,
+		  SaryInt limit,
+		  const gchar *bof,
+		  const gchar *eof,
+		  gint nthreads)
+{
+    bucket_sort(FALSE, progress, array, len, limit, bof, eof, nthreads);
+}
+
+void
+sary_bucket_sort_cached (SaryProgress *progress,
+			 SaryInt *array,
+			 SaryInt len,
+			 SaryInt limit,
+			 const gchar *bof,
+			 const gchar *eof,
+			 gint nthreads)
+{
+    bucket_sort(TRUE, progress, array, len, limit, bof, eof, nthreads);
+}
+
+static void
+bucket_sort (gboolean cached,
+	     SaryProgress *progress,
+	     SaryInt *array,
+	     SaryInt len,
+	     SaryInt limit,
+	     const gchar *bof,
+	     const gchar *eof,
+	     gint nthreads)
+{
+    Buckets buckets;
+    pthread_t *threads;
+    SaryInt i, share;
+
+    g_assert(nthreads > 0 && limit >= 0);
+
+    buckets.cached    = cached;
+    buckets.progress  = progress;
+    buckets.array     = array;
+    buckets.limit     = limit;
+    buckets.bof	      = bof;
+    buckets.eof	      = eof;
+
+    /*
+     * Suffixes sharing only the first byte are in the same
+     * order as their positions if the limit is 1 so that
+     * the second byte must not split them.
+     */
+    buckets.nbytes = limit == 1 ? 1 : 2;
+    buckets.starts = g_new(SaryInt, NBUCKETS + 1);
+    partition(array, len, buckets.starts, buckets.nbytes, bof, eof);
+
+    share = len / nthreads;
+    buckets.order  = g_new(SaryInt, NBUCKETS);
+    buckets.norder = 0;
+    for (i = 0; i < NBUCKETS; i++) {
+	SaryInt *first = array + buckets.starts[i];
+	SaryInt blen   = buckets.starts[i + 1] - buckets.starts[i];
+
+	if (blen <= 1) {
+	    advance(progress, blen);
+	} else if (nthreads > 1 && blen > share) {
+	    sary_multikey_qsort_bounded(NULL, first, blen, buckets.nbytes, 
+					limit, bof, eof, cached, nthreads);
+	    advance(progress, blen);
+	} else {
+	    buckets.order[buckets.norder++] = i;
+	}
+    }
+    g_qsort_with_data(buckets.order, buckets.norder, sizeof(SaryInt),
+		      lencmp, buckets.starts);
+    buckets.cursor = 0;
+
+    pthread_mutex_init(&buckets.mutex, NULL);
+    threads = g_new(pthread_t, nthreads);
+    for (i = 0; i < nthreads; i++) {
+	if (pthread_create(&threads[i], NULL,
+			   (void *)sort_buckets, &buckets) != 0)
+	{
+	    g_error("pthread_create: %s", g_strerror(errno));
+	}
+    }
+    for (i = 0; i < nthreads; i++) {
+	pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&buckets.mutex);
+
+    g_free(threads);
+    g_free(buckets.order);
+    g_free(buckets.starts);
+}
+
+/*
+ * Count the index points of each bucket and move them into
+ * their buckets by cycles of swaps as American flag sort
+ * does.
+ */
+static void
+partition (SaryInt *array,
+	   SaryInt len,
+	   SaryInt *starts,
+	   SaryInt nbytes,
+	   const gchar *bof,
+	   const gchar *eof)
+{
+    SaryInt i, *next;
+
+    next = g_new0(SaryInt, NBUCKETS);
+    for (i = 0; i < len; i++) {
+	next[get_bucket(array[i], nbytes, bof, eof)]++;
+    }
+
+    starts[0] = 0;
+    for (i = 0; i < NBUCKETS; i++) {
+	starts[i + 1] = starts[i] + next[i];
+	next[i] = starts[i];
+    }
+
+    for (i = 0; i < NBUCKETS; i++) {
+	while (next[i] < starts[i + 1]) {
+	    SaryInt x = array[next[i]];
+	    SaryInt b = get_bucket(x, nbytes, bof, eof);
+
+	    while (b != i) {
+		SaryInt tmp = array[next[b]];
+
+		array[next[b]++] = x;
+		x = tmp;
+		b = get_bucket(x, nbytes, bof, eof);
+	    }
+	    array[next[i]++] = x;
+	}
+    }
+
+    g_free(next);
+}
+
+/*
+ * Return the number of the bucket of the suffix at
+ * `offset', its first two bytes in base 257. The end of
+ * the text counts as a symbol smaller than any byte.
+ */
+static inline SaryInt
+get_bucket (SaryInt offset,
+	    SaryInt nbytes,
+	    const gchar *bof,
+	    const gchar *eof)
+{
+    const gchar *suffix = bof + SARY_INT_FROM_BE(offset);
+    SaryInt i, bucket = 0;
+
+    for (i = 0; i < 2; i++) {
+	bucket *= 257;
+	if (i < nbytes && suffix + i < eof) {
+	    bucket += (guchar)suffix[i] + 1;
+	}
+    }
+    return bucket;
+}
+
+/*
+ * Larger buckets come first.
+ */
+static gint
+lencmp (gconstpointer b1, gconstpointer b2, gpointer starts)
+{
+    SaryInt i = *(const SaryInt *)b1;
+    SaryInt j = *(const SaryInt *)b2;
+    SaryInt len1 = ((SaryInt *)starts)[i + 1] - ((SaryInt *)starts)[i];
+    SaryInt len2 = ((SaryInt *)starts)[j + 1] - ((SaryInt *)starts)[j];
+
+    if (len1 != len2) {
+	return len1 > len2 ? -1 : 1;
+    }
+    return i < j ? -1 : i > j;
+}
+
+static void
+sort_buckets (Buckets *buckets)
+{
+    for (;;) {
+	SaryInt i, len;
+
+	pthread_mutex_lock(&buckets->mutex);
+	if (buckets->cursor == buckets->norder) {
+	    pthread_mutex_unlock(&buckets->mutex);
+	    break;
+	}
+	i = buckets->order[buckets->cursor++];
+	pthread_mutex_unlock(&buckets->mutex);
+
+	/*
+	 * Pass NULL for the progress as sort_block() in
+	 * sorter.c does and count the bucket at once.
+	 */
+	len = buckets->starts[i + 1] - buckets->starts[i];
+	sary_multikey_qsort_bounded(NULL, 
+				    buckets->array + buckets->starts[i], len,
+				    buckets->nbytes, buckets->limit,
+				    buckets->bof, buckets->eof,
+				    buckets->cached, 1);
+
+	pthread_mutex_lock(&buckets->mutex);
+	advance(buckets->progress, len);
+	pthread_mutex_unlock(&buckets->mutex);
+    }
+}
+
+static void
+advance (SaryProgress *progress, SaryInt count)
+{
+    if (progress != NULL && count > 0) {
+	sary_progress_set_count(progress, progress->current + count);
+    }
+}
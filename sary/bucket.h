@@ -0,0 +1,31 @@
+#ifndef __SARY_BUCKET_H__
+#define __SARY_BUCKET_H__
+
+#include <glib.h>
+#include <sary/progress.h>
+#include <sary/saryconfig.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+void	sary_bucket_sort	(SaryProgress *progress,
+				 SaryInt *array,
+				 SaryInt len,
+				 SaryInt limit,
+				 const gchar *bof,
+				 const gchar *eof,
+				 gint nthreads);
+void	sary_bucket_sort_cached	(SaryProgress *progress,
+				 SaryInt *array,
+				 SaryInt len,
+				 SaryInt limit,
+				 const gchar *bof,
+				 const gchar *eof,
+				 gint nthreads);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __SARY_BUCKET_H__ */
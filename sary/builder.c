@@ -28,19 +28,96 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <time.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <sary.h>
 
+enum {
+    CHUNK_SIZE = 1024 * 1024,  /* bytes of the text per thread */
+    BULK_LEN   = 4096	       /* index points per bulk call */
+};
+
+/*
+ * Figures for plan().
+ */
+enum {
+    SAMPLE_SIZE	    = 1024 * 1024,	/* bytes of the text to sample */
+    MIN_BLOCK_LEN   = 64 * 1024,	/* index points */
+    CACHED_KEY_SIZE = 16,		/* per index point, see mkqsort.c */
+    WRITER_SIZE	    = 2 * 1024 * 1024,	/* buffers of a SaryWriter */
+    RUN_SIZE	    = 256 * 1024,	/* read-ahead of a run in merging */
+    DEFAULT_MEMORY  = 256 * 1024 * 1024	/* if the free memory is unknown */
+};
+
+/*
+ * Figures for choose_engine().
+ */
+enum {
+    NSAMPLES	    = 1024,		/* suffixes sampled */
+    SAMPLE_DEPTH    = 1024,		/* bytes compared at most */
+    WINDOW_SIZE	    = 256,		/* bytes read for the alphabet */
+    REPEAT_LCP	    = 64,		/* mean lcp of a repetitive text */
+    QSUFSORT_COST   = 16,		/* per byte of the text, in bytes
+					   compared by Multikey Quicksort */
+    SMALL_ALPHABET  = 16,		/* symbols */
+    LARGE_TEXT	    = 8 * 1024 * 1024	/* bytes, beyond the CPU cache */
+};
+
 typedef void	(*SortFunc)	(SaryBuilder *builder,
 				 SaryMmap *array, 
 				 SaryText *text,
 				 SaryInt len);
 
+/*
+ * Return the first position at or after `cursor' from which
+ * the ipoint function can start indexing.
+ */
+typedef gchar*	(*SyncFunc)	(gchar *cursor, 
+				 gchar *bof, 
+				 gchar *eof);
+
+/*
+ * Bulk and sync functions known for an ipoint function.
+ * Either can be NULL.
+ */
+typedef struct {
+    SaryIpointFunc	ipoint_func;
+    SaryIpointBulkFunc	bulk_func;
+    SyncFunc		sync_func;
+} IpointTab;
+
+/*
+ * A piece of the text indexed by a thread. Index points from
+ * `first' up to (not including) `last' are stored into
+ * `ipoints' and `next' is set to the first one after them.
+ */
+typedef struct {
+    SaryIpointFunc	ipoint_func;
+    SaryIpointBulkFunc	bulk_func;
+    SaryText		text;
+    gchar		*first;
+    gchar		*last;
+    gchar		*next;
+    SaryInt		*ipoints;
+    SaryInt		len;
+    SaryInt		size;
+} Chunk;
+
 struct _SaryBuilder{
     SaryText		*text;
     gchar		*array_name;
     SaryIpointFunc	ipoint_func;
     SaryInt		block_size;
     SaryInt		nthreads;
+    SaryInt		fanin;
+    SaryInt		depth;
+    gboolean		is_limited;
+    gboolean		block_size_set;
+    gboolean		nthreads_set;
+    gsize		memory_limit;
+    SarySortEngine	sort_engine;
+    gint		offset_width;
+    gboolean		is_native;
     SaryProgressFunc	progress_func;
     gpointer		progress_func_data;
 };
@@ -48,7 +125,86 @@ struct _SaryBuilder{
 static SaryInt	index		(SaryBuilder	*builder, 
 				 SaryProgress	*progress,
 				 SaryWriter	*writer);
+static SaryInt	bulk_index	(SaryBuilder	*builder, 
+				 SaryIpointBulkFunc bulk_func,
+				 SaryProgress	*progress,
+				 SaryWriter	*writer);
+static SaryInt	parallel_index	(SaryBuilder	*builder, 
+				 IpointTab	*tab,
+				 SaryProgress	*progress,
+				 SaryWriter	*writer);
+static void	index_chunk	(Chunk		*chunk);
+static SaryInt	fill_block	(SaryBuilder	*builder, 
+				 SaryIpointBulkFunc bulk_func,
+				 SaryInt	*block,
+				 SaryInt	len);
+static void	sort_block	(SaryBuilder	*builder, 
+				 SaryInt	*block,
+				 SaryInt	len);
+static gboolean	write_block	(const gchar	*file_name,
+				 gint		width,
+				 SaryInt	depth,
+				 SaryInt	*block,
+				 SaryInt	len);
+static gboolean	merge_runs	(SaryBuilder	*builder, 
+				 const gchar	*run_name,
+				 SaryInt	*runs,
+				 SaryInt	nruns,
+				 SaryInt	nipoints);
+static gint	get_packed_width(SaryBuilder	*builder);
+static SaryInt	get_depth	(SaryBuilder	*builder);
+static void	choose_engine	(SaryBuilder	*builder);
+static SaryInt	take_samples	(SaryBuilder	*builder,
+				 IpointTab	*tab,
+				 gchar		**samples,
+				 SaryInt	*nsymbols);
+static SaryInt	sample_lcp	(const gchar	*s1,
+				 const gchar	*s2,
+				 const gchar	*eof);
+static gint	samplecmp	(gconstpointer	s1,
+				 gconstpointer	s2,
+				 gpointer	eof);
+static const gchar*	get_engine_name	(SarySortEngine	engine);
+static void	plan		(SaryBuilder	*builder);
+static SaryInt	estimate_nipoints	(SaryBuilder	*builder);
+static guint64	get_free_memory	(void);
+static SaryInt	get_ncpus	(void);
+static IpointTab*	get_ipoint_tab	(SaryIpointFunc	ipoint_func);
+static gchar*	sync_any	(gchar *cursor, gchar *bof, gchar *eof);
+static gchar*	sync_utf8	(gchar *cursor, gchar *bof, gchar *eof);
+static gchar*	sync_eucjp	(gchar *cursor, gchar *bof, gchar *eof);
+static gchar*	sync_sjis	(gchar *cursor, gchar *bof, gchar *eof);
+static gchar*	sync_line	(gchar *cursor, gchar *bof, gchar *eof);
+static gchar*	sync_word	(gchar *cursor, gchar *bof, gchar *eof);
+static inline gboolean	is_space	(gchar c);
+static gboolean	rename_to_work	(const gchar	*src_name,
+				 const gchar	*dest_name);
+static gboolean	finish		(SaryBuilder	*builder);
+static void	make_header	(SaryBuilder	*builder,
+				 gint		width,
+				 SaryInt	depth,
+				 SaryHeader	*header);
+static gboolean	rewrite		(const gchar	*src_name,
+				 const gchar	*dest_name,
+				 const SaryHeader *dest_header);
 static void	progress_quiet	(SaryProgress	*progress);
+static void	remove_sidecars	(SaryBuilder	*builder);
+
+/*
+ * sary_ipoint_locale is missing because mblen(3) is not
+ * reentrant.
+ */
+static IpointTab ipoint_tab[] = {
+    { sary_ipoint_bytestream,	sary_ipoint_bulk_bytestream,	sync_any   },
+    { sary_ipoint_char_ascii,	sary_ipoint_bulk_bytestream,	sync_any   },
+    { sary_ipoint_char_iso8859,	sary_ipoint_bulk_bytestream,	sync_any   },
+    { sary_ipoint_char_utf8,	sary_ipoint_bulk_char_utf8,	sync_utf8  },
+    { sary_ipoint_char_eucjp,	NULL,				sync_eucjp },
+    { sary_ipoint_char_sjis,	NULL,				sync_sjis  },
+    { sary_ipoint_line,		sary_ipoint_bulk_line,		sync_line  },
+    { sary_ipoint_word,		sary_ipoint_bulk_word,		sync_word  },
+    { NULL,			NULL,				NULL       }
+};
 
 SaryBuilder *
 sary_builder_new (const gchar *file_name)
@@ -82,8 +238,26 @@ sary_builder_new2 (const gchar *file_name, const gchar *array_name)
     builder->ipoint_func   = sary_ipoint_bytestream;
     builder->block_size    = 1024 * 1024 / sizeof(SaryInt); /* 1 MB */
     builder->nthreads      = 1;
+    builder->fanin         = 0;
+    builder->depth         = 0;
+    builder->is_limited    = FALSE;
+    builder->memory_limit  = 0;
+    builder->block_size_set = FALSE;
+    builder->nthreads_set  = FALSE;
+    builder->sort_engine   = SARY_SORT_MKQSORT;
+    builder->is_native     = FALSE;
     builder->progress_func = progress_quiet;
 
+    /*
+     * Keep the plain 32 bit format readable by older
+     * versions as long as the text fits in it.
+     */
+    if (sary_text_get_size(builder->text) <= G_MAXINT) {
+	builder->offset_width = 32;
+    } else {
+	builder->offset_width = 64;
+    }
+
     return builder;
 }
 
@@ -111,8 +285,10 @@ sary_builder_index (SaryBuilder *builder)
     SaryInt file_size;
     SaryProgress *progress;
     SaryWriter *writer;
+    IpointTab *tab;
 
-    writer = sary_writer_new(builder->array_name);
+    remove_sidecars(builder);
+    writer = sary_writer_new2(builder->array_name, builder->offset_width);
     if (writer == NULL) {
 	return -1;
     }
@@ -124,7 +300,14 @@ sary_builder_index (SaryBuilder *builder)
 			  builder->progress_func, 
 			  builder->progress_func_data);
 
-    count = index(builder, progress, writer);
+    tab = get_ipoint_tab(builder->ipoint_func);
+    if (tab != NULL && builder->nthreads > 1) {
+	count = parallel_index(builder, tab, progress, writer);
+    } else if (tab != NULL && tab->bulk_func != NULL) {
+	count = bulk_index(builder, tab->bulk_func, progress, writer);
+    } else {
+	count = index(builder, progress, writer);
+    }
 
     sary_progress_destroy(progress);
     sary_writer_destroy(writer);
@@ -135,18 +318,62 @@ sary_builder_index (SaryBuilder *builder)
 gboolean
 sary_builder_sort (SaryBuilder *builder)
 {
+    gchar *tmp_name;
     SarySorter *sorter;
     gboolean result;
 
-    sorter = sary_sorter_new(builder->text, builder->array_name);
-    if (sorter == NULL)
-      return FALSE;
+    remove_sidecars(builder);
+    if (builder->sort_engine == SARY_SORT_AUTO) {
+	choose_engine(builder);
+    }
+
+    /*
+     * The array file is sorted in place with SaryInt wide
+     * offsets. Sort a temporary one and rewrite it if
+     * another width is wanted.
+     */
+    tmp_name = g_strconcat(builder->array_name, ".tmp", NULL);
+    if (rename_to_work(builder->array_name, tmp_name) == FALSE) {
+	g_free(tmp_name);
+	return FALSE;
+    }
+
+    sorter = sary_sorter_new(builder->text, tmp_name);
+    if (sorter == NULL) {
+	g_free(tmp_name);
+	return FALSE;
+    }
     sary_sorter_connect_progress(sorter,
 				 builder->progress_func,
 				 builder->progress_func_data);
+    sary_sorter_set_engine(sorter, builder->sort_engine);
+    sary_sorter_set_nthreads(sorter, builder->nthreads);
+    sary_sorter_set_depth(sorter, get_depth(builder));
     result = sary_sorter_sort(sorter);
     sary_sorter_destroy(sorter);
 
+    /*
+     * The depth is recorded in the header, which the
+     * temporary one lacks.
+     */
+    if (result == TRUE) {
+	if (builder->offset_width == sizeof(SaryInt) * 8 &&
+	    get_depth(builder) == 0 && builder->is_native == FALSE) 
+	{
+	    result = (rename(tmp_name, builder->array_name) != -1);
+	} else {
+	    SaryHeader header;
+
+	    make_header(builder, builder->offset_width, 
+			get_depth(builder), &header);
+	    result = rewrite(tmp_name, builder->array_name, &header);
+	}
+    } else {
+	rename(tmp_name, builder->array_name);  /* restore */
+    }
+    unlink(tmp_name);
+    g_free(tmp_name);
+
     return result;
 }
 
@@ -157,6 +384,23 @@ sary_builder_block_sort (SaryBuilder *builder)
     SarySorter *sorter;
     gboolean result;
 
+    remove_sidecars(builder);
+    if (builder->sort_engine == SARY_SORT_AUTO) {
+	choose_engine(builder);
+    } else if (builder->is_limited) {
+	plan(builder);
+    }
+
+    /*
+     * Induced sorting and prefix doubling build the whole
+     * array at once and gain nothing from blocks.
+     */
+    if (builder->sort_engine == SARY_SORT_SAIS ||
+	builder->sort_engine == SARY_SORT_QSUFSORT) 
+    {
+	return sary_builder_sort(builder);
+    }
+
     /*
      * Rename the array file temporarily.  
      *
@@ -164,15 +408,24 @@ sary_builder_block_sort (SaryBuilder *builder)
      * they may create a pathname on a different filesystem.
      */
     tmp_name = g_strconcat(builder->array_name, ".tmp", NULL);
-    if (rename(builder->array_name, tmp_name) == -1) {
+    if (rename_to_work(builder->array_name, tmp_name) == FALSE) {
+	g_free(tmp_name);
 	return FALSE;
     }
 
     sorter = sary_sorter_new(builder->text, tmp_name);
+    if (sorter == NULL) {
+	g_free(tmp_name);
+	return FALSE;
+    }
     sary_sorter_connect_progress(sorter,
 				 builder->progress_func,
 				 builder->progress_func_data);
     sary_sorter_set_nthreads(sorter, builder->nthreads);
+    sary_sorter_set_fanin(sorter, builder->fanin);
+    sary_sorter_set_depth(sorter, builder->depth);
+    sary_sorter_set_engine(sorter, builder->sort_engine);
+    sary_sorter_set_offset_width(sorter, builder->offset_width);
 
     /*
      * Construct the temporary array file by block sorting
@@ -190,6 +443,248 @@ sary_builder_block_sort (SaryBuilder *builder)
     unlink(tmp_name);
     g_free(tmp_name);
 
+    if (result == TRUE) {
+	result = finish(builder);
+    }
+    return result;
+}
+
+/*
+ * Index and sort block by block without writing the unsorted
+ * array. Index points are gathered into a block in memory,
+ * which is sorted as soon as it fills and appended to the
+ * temporary file as a sorted run. The runs are merged into
+ * the array file at last. A text fitting in a block is
+ * written to the array file directly.
+ */
+gboolean
+sary_builder_index_and_block_sort (SaryBuilder *builder)
+{
+    IpointTab *tab;
+    SaryIpointBulkFunc bulk_func;
+    SaryProgress *progress;
+    SaryWriter *writer = NULL;
+    SaryInt *block, *runs = NULL;
+    SaryInt i, len, nruns = 0, nipoints = 0;
+    gchar *bof, *tmp_name;
+    gboolean result = TRUE;
+
+    remove_sidecars(builder);
+    if (builder->sort_engine == SARY_SORT_AUTO) {
+	choose_engine(builder);
+    } else if (builder->is_limited) {
+	plan(builder);
+    }
+
+    /*
+     * Induced sorting and prefix doubling need the whole
+     * array at once.
+     */
+    if (builder->sort_engine == SARY_SORT_SAIS ||
+	builder->sort_engine == SARY_SORT_QSUFSORT) 
+    {
+	return sary_builder_index(builder) != -1 && 
+	    sary_builder_sort(builder);
+    }
+
+    tab = get_ipoint_tab(builder->ipoint_func);
+    bulk_func = tab != NULL ? tab->bulk_func : NULL;
+    bof = sary_text_get_bof(builder->text);
+    tmp_name = g_strconcat(builder->array_name, ".tmp", NULL);
+    block = g_new(SaryInt, builder->block_size);
+
+    progress = sary_progress_new("index", sary_text_get_size(builder->text));
+    sary_progress_connect(progress,
+			  builder->progress_func, 
+			  builder->progress_func_data);
+
+    do {
+	len = fill_block(builder, bulk_func, block, builder->block_size);
+	sary_progress_set_count(progress, 
+				sary_text_get_cursor(builder->text) - bof);
+	sort_block(builder, block, len);
+
+	if (nruns == 0 && sary_text_is_eof(builder->text)) {
+	    result = write_block(builder->array_name, builder->offset_width, 
+				 builder->depth, block, len);
+	    break;
+	}
+
+	if (writer == NULL) {
+	    writer = sary_writer_new(tmp_name);
+	    if (writer == NULL) {
+		result = FALSE;
+		break;
+	    }
+	}
+	for (i = 0; i < len && result == TRUE; i++) {
+	    result = sary_writer_write(writer, block[i]);
+	}
+	runs = g_renew(SaryInt, runs, nruns + 1);
+	runs[nruns++] = len;
+	nipoints += len;
+    } while (result == TRUE && !sary_text_is_eof(builder->text));
+
+    sary_progress_destroy(progress);
+    g_free(block);
+
+    if (writer != NULL) {
+	if (result == TRUE) {
+	    result = sary_writer_flush(writer);
+	}
+	sary_writer_destroy(writer);
+	if (result == TRUE) {
+	    result = merge_runs(builder, tmp_name, runs, nruns, nipoints);
+	}
+	unlink(tmp_name);
+    }
+
+    g_free(runs);
+    g_free(tmp_name);
+
+    if (result == TRUE) {
+	result = finish(builder);
+    }
+    return result;
+}
+
+/*
+ * Rewrite the array file with offsets in as few bits as the
+ * length of the text needs, 29 bits for a text of 300MB, at
+ * the cost of unpacking them at every step of a search. It
+ * is kept as it is if no bit is saved. The sidecars remain
+ * valid.
+ */
+gboolean
+sary_builder_pack (SaryBuilder *builder)
+{
+    SaryMmap *map;
+    SaryHeader header, dest_header;
+    gchar *tmp_name;
+    gint width;
+    gboolean result;
+
+    map = sary_mmap(builder->array_name, "r");
+    if (map == NULL) {
+	return FALSE;
+    }
+    result = sary_header_read(&header, map->map, map->len);
+    sary_munmap(map);
+    if (result == FALSE) {
+	errno = EINVAL;
+	return FALSE;
+    }
+
+    width = get_packed_width(builder);
+    if (width >= header.width) {
+	return TRUE;
+    }
+
+    make_header(builder, width, header.depth, &dest_header);
+    tmp_name = g_strconcat(builder->array_name, ".tmp", NULL);
+    result = rewrite(builder->array_name, tmp_name, &dest_header);
+    if (result == TRUE) {
+	result = (rename(tmp_name, builder->array_name) != -1);
+    }
+    unlink(tmp_name);
+    g_free(tmp_name);
+
+    return result;
+}
+
+/*
+ * Write the LCP array of the sorted array file to its
+ * sidecar named by sary_lcp_file_name(). See sary_lcp_make().
+ */
+gboolean
+sary_builder_make_lcp (SaryBuilder *builder)
+{
+    gchar *lcp_name;
+    gboolean result;
+
+    lcp_name = sary_lcp_file_name(builder->array_name);
+    result = sary_lcp_make(builder->text, builder->array_name, lcp_name,
+			   builder->nthreads, builder->progress_func,
+			   builder->progress_func_data);
+    g_free(lcp_name);
+
+    return result;
+}
+
+/*
+ * Write the table of the ranges of `nbytes' byte prefixes
+ * of the sorted array file to its sidecar named by
+ * sary_prefix_file_name(). See sary_prefix_make().
+ */
+gboolean
+sary_builder_make_prefix (SaryBuilder *builder, gint nbytes)
+{
+    gchar *prefix_name;
+    gboolean result;
+
+    prefix_name = sary_prefix_file_name(builder->array_name);
+    result = sary_prefix_make(builder->text, builder->array_name,
+			      prefix_name, nbytes);
+    g_free(prefix_name);
+
+    return result;
+}
+
+/*
+ * Write the child table to the sidecar named by
+ * sary_child_file_name(). It is computed from the LCP file,
+ * which must be made first. See sary_child_make().
+ */
+gboolean
+sary_builder_make_child (SaryBuilder *builder)
+{
+    gchar *lcp_name, *child_name;
+    gboolean result;
+
+    lcp_name   = sary_lcp_file_name(builder->array_name);
+    child_name = sary_child_file_name(builder->array_name);
+    result = sary_child_make(lcp_name, child_name);
+    g_free(lcp_name);
+    g_free(child_name);
+
+    return result;
+}
+
+/*
+ * Write every `interval'-th suffix of the sorted array file
+ * with its first bytes to the sidecar named by
+ * sary_sample_file_name(). See sary_sample_make().
+ */
+gboolean
+sary_builder_make_sample (SaryBuilder *builder, SaryInt interval)
+{
+    gchar *sample_name;
+    gboolean result;
+
+    sample_name = sary_sample_file_name(builder->array_name);
+    result = sary_sample_make(builder->text, builder->array_name,
+			      sample_name, interval);
+    g_free(sample_name);
+
+    return result;
+}
+
+/*
+ * Write the FM-index of the sorted array file, sampling
+ * every `interval'-th offset, to the sidecar named by
+ * sary_fmindex_file_name(). See sary_fmindex_make().
+ */
+gboolean
+sary_builder_make_fmindex (SaryBuilder *builder, SaryInt interval)
+{
+    gchar *fmindex_name;
+    gboolean result;
+
+    fmindex_name = sary_fmindex_file_name(builder->array_name);
+    result = sary_fmindex_make(builder->text, builder->array_name,
+			       fmindex_name, interval);
+    g_free(fmindex_name);
+
     return result;
 }
 
@@ -198,6 +693,7 @@ sary_builder_set_block_size (SaryBuilder *builder, SaryInt block_size)
 {
     g_assert(block_size > 0);
     builder->block_size = block_size / sizeof(SaryInt);
+    builder->block_size_set = TRUE;
 }
 
 void
@@ -205,6 +701,80 @@ sary_builder_set_nthreads (SaryBuilder *builder, SaryInt nthreads)
 {
     g_assert(nthreads > 0);
     builder->nthreads = nthreads;
+    builder->nthreads_set = TRUE;
+}
+
+/*
+ * Merge at most `fanin' blocks at once in block sorting,
+ * in several passes if there are more. 0, the default,
+ * merges all blocks in one pass unless a memory limit is
+ * set.
+ */
+void
+sary_builder_set_fanin (SaryBuilder *builder, SaryInt fanin)
+{
+    g_assert(fanin == 0 || fanin >= 2);
+    builder->fanin = fanin;
+}
+
+/*
+ * Sort suffixes by their first `depth' bytes only and the
+ * ones sharing them by their positions, which saves going
+ * deep into long repeats. The depth is recorded in the
+ * array file and SarySearcher verifies occurrences of
+ * longer patterns with the text. 0, the default, sorts
+ * suffixes fully as SA-IS and prefix doubling always do.
+ */
+void
+sary_builder_set_depth (SaryBuilder *builder, SaryInt depth)
+{
+    g_assert(depth >= 0);
+    builder->depth = depth;
+}
+
+/*
+ * Let block sorting choose the block size, the number of
+ * threads and the fan-in of merging, unless set by their
+ * own functions, to use about `limit' bytes of memory
+ * including the text. 0 stands for the free physical
+ * memory.
+ */
+void
+sary_builder_set_memory_limit (SaryBuilder *builder, gsize limit)
+{
+    builder->is_limited   = TRUE;
+    builder->memory_limit = limit;
+}
+
+void
+sary_builder_set_sort_engine (SaryBuilder *builder, SarySortEngine engine)
+{
+    builder->sort_engine = engine;
+}
+
+/*
+ * Write the array file with a header of version 2, which
+ * records the text to be checked by SarySearcher, and with
+ * offsets of 32 or 64 bits in the byte order of the machine
+ * to be read without swapping bytes. Unlike a plain array,
+ * it is readable only by this version of sary or later.
+ */
+void
+sary_builder_set_native (SaryBuilder *builder, gboolean native)
+{
+    builder->is_native = native;
+}
+
+/*
+ * Set the width in bits of offsets in the array file: 32,
+ * 40 or 64. Offsets wider than 32 bits are available only
+ * with --enable-large-array.
+ */
+void
+sary_builder_set_offset_width (SaryBuilder *builder, gint width)
+{
+    g_assert(width == 32 || width == 40 || width == 64);
+    builder->offset_width = width;
 }
 
 void
@@ -229,7 +799,7 @@ index (SaryBuilder *builder, SaryProgress *progress, SaryWriter *writer)
     while ((cursor = builder->ipoint_func(builder->text))) {
 	SaryInt pos = cursor - bof;
 
-	if (sary_writer_write(writer, GINT_TO_BE(pos)) == FALSE) {
+	if (sary_writer_write(writer, SARY_INT_TO_BE(pos)) == FALSE) {
 	    return -1;
 	}
 
@@ -242,9 +812,899 @@ index (SaryBuilder *builder, SaryProgress *progress, SaryWriter *writer)
     return count;
 }
 
+static SaryInt
+bulk_index (SaryBuilder *builder, 
+	    SaryIpointBulkFunc bulk_func,
+	    SaryProgress *progress, 
+	    SaryWriter *writer)
+{
+    SaryInt ipoints[BULK_LEN];
+    SaryInt i, n, count = 0;
+
+    while ((n = bulk_func(builder->text, ipoints, BULK_LEN)) > 0) {
+	for (i = 0; i < n; i++) {
+	    if (sary_writer_write(writer, 
+				  SARY_INT_TO_BE(ipoints[i])) == FALSE) 
+	    {
+		return -1;
+	    }
+	}
+	sary_progress_set_count(progress, ipoints[n - 1]);
+	count += n;
+    }
+    if (sary_writer_flush(writer) == FALSE) {
+	return -1;
+    }
+    return count;
+}
+
+/*
+ * Index the text by rounds of nthreads chunks. The chunks
+ * are cut at positions given by `sync_func' and indexed at
+ * once, then written in order. A chunk which does not begin
+ * where the previous one ends, which may happen with broken
+ * multibyte characters, is indexed again from there so that
+ * the result is the same as index().
+ */
+static SaryInt
+parallel_index (SaryBuilder *builder, 
+		IpointTab *tab,
+		SaryProgress *progress, 
+		SaryWriter *writer)
+{
+    SaryInt i, j, count = 0;
+    SaryInt nthreads = builder->nthreads;
+    gchar *bof    = sary_text_get_bof(builder->text);
+    gchar *eof    = sary_text_get_eof(builder->text);
+    gchar *cursor = bof;
+    Chunk *chunks;
+    pthread_t *threads;
+
+    chunks  = g_new(Chunk, nthreads);
+    threads = g_new(pthread_t, nthreads);
+    for (i = 0; i < nthreads; i++) {
+	chunks[i].ipoint_func = builder->ipoint_func;
+	chunks[i].bulk_func   = tab->bulk_func;
+	chunks[i].text        = *builder->text;
+	chunks[i].size        = CHUNK_SIZE / 16;
+	chunks[i].ipoints     = g_new(SaryInt, chunks[i].size);
+    }
+
+    while (cursor < eof) {
+	gchar *first = cursor;
+
+	for (i = 0; i < nthreads; i++) {
+	    gchar *last = eof - first > CHUNK_SIZE ? first + CHUNK_SIZE : eof;
+
+	    chunks[i].first = first;
+	    chunks[i].last  = tab->sync_func(last, bof, eof);
+	    first = chunks[i].last;
+	}
+
+	for (i = 0; i < nthreads; i++) {
+	    if (pthread_create(&threads[i], NULL, 
+			       (void *)index_chunk, chunks + i) != 0) 
+	    {
+		g_error("pthread_create: %s", g_strerror(errno));
+	    }
+	}
+	for (i = 0; i < nthreads; i++) {
+	    pthread_join(threads[i], NULL);
+	}
+
+	for (i = 0; i < nthreads; i++) {
+	    Chunk *chunk = chunks + i;
+
+	    if (chunk->first != cursor) {
+		chunk->first = cursor;
+		index_chunk(chunk);
+	    }
+	    for (j = 0; j < chunk->len; j++) {
+		SaryInt pos = chunk->ipoints[j];
+
+		if (sary_writer_write(writer, SARY_INT_TO_BE(pos)) == FALSE) {
+		    count = -1;
+		    goto out;
+		}
+	    }
+	    count += chunk->len;
+	    cursor = chunk->next;
+	}
+	sary_progress_set_count(progress, cursor - bof);
+    }
+    if (sary_writer_flush(writer) == FALSE) {
+	count = -1;
+    }
+
+ out:
+    for (i = 0; i < nthreads; i++) {
+	g_free(chunks[i].ipoints);
+    }
+    g_free(chunks);
+    g_free(threads);
+    return count;
+}
+
+static void
+index_chunk (Chunk *chunk)
+{
+    gchar *bof  = sary_text_get_bof(&chunk->text);
+    gchar *eof  = sary_text_get_eof(&chunk->text);
+    SaryInt last = chunk->last - bof;
+
+    chunk->len  = 0;
+    chunk->next = eof;
+    sary_text_set_cursor(&chunk->text, chunk->first);
+
+    while (1) {
+	SaryInt i, n, *ipoints;
+
+	if (chunk->size - chunk->len < BULK_LEN) {
+	    chunk->size    = chunk->size * 2 + BULK_LEN;
+	    chunk->ipoints = g_renew(SaryInt, chunk->ipoints, chunk->size);
+	}
+	ipoints = chunk->ipoints + chunk->len;
+
+	if (chunk->bulk_func != NULL) {
+	    n = chunk->bulk_func(&chunk->text, ipoints, BULK_LEN);
+	} else {
+	    gchar *cursor = chunk->ipoint_func(&chunk->text);
+
+	    n = 0;
+	    if (cursor != NULL) {
+		ipoints[n++] = cursor - bof;
+	    }
+	}
+	if (n == 0) {
+	    break;
+	}
+
+	/*
+	 * The last chunk takes everything including eof
+	 * which sary_ipoint_word returns for a text of
+	 * whitespaces.
+	 */
+	for (i = 0; i < n; i++) {
+	    if (ipoints[i] >= last && chunk->last < eof) {
+		chunk->next = bof + ipoints[i];
+		chunk->len += i;
+		return;
+	    }
+	}
+	chunk->len += n;
+    }
+}
+
+/*
+ * Fill `block' with up to `len' index points in big endian.
+ */
+static SaryInt
+fill_block (SaryBuilder *builder, 
+	    SaryIpointBulkFunc bulk_func, 
+	    SaryInt *block, 
+	    SaryInt len)
+{
+    gchar *bof = sary_text_get_bof(builder->text);
+    SaryInt i, n = 0;
+
+    while (n < len) {
+	if (bulk_func != NULL) {
+	    SaryInt m = bulk_func(builder->text, block + n, len - n);
+
+	    if (m == 0) {
+		break;
+	    }
+	    n += m;
+	} else {
+	    gchar *cursor = builder->ipoint_func(builder->text);
+
+	    if (cursor == NULL) {
+		break;
+	    }
+	    block[n++] = cursor - bof;
+	}
+    }
+
+    for (i = 0; i < n; i++) {
+	block[i] = SARY_INT_TO_BE(block[i]);
+    }
+    return n;
+}
+
+static void
+sort_block (SaryBuilder *builder, SaryInt *block, SaryInt len)
+{
+    gchar *bof = sary_text_get_bof(builder->text);
+    gchar *eof = sary_text_get_eof(builder->text);
+
+    SaryInt depth = builder->depth;
+
+    /*
+     * Buckets share the work among the threads from the
+     * start. See bucket.c.
+     */
+    if (builder->sort_engine == SARY_SORT_MKQSORT_CACHED) {
+	if (builder->nthreads > 1) {
+	    sary_bucket_sort_cached(NULL, block, len, depth, bof, eof, 
+				    builder->nthreads);
+	} else {
+	    sary_multikey_qsort_bounded(NULL, block, len, 0, depth, bof, eof,
+					TRUE, 1);
+	}
+    } else {
+	if (builder->nthreads > 1) {
+	    sary_bucket_sort(NULL, block, len, depth, bof, eof, 
+			     builder->nthreads);
+	} else {
+	    sary_multikey_qsort_bounded(NULL, block, len, 0, depth, bof, eof,
+					FALSE, 1);
+	}
+    }
+}
+
+static gboolean
+write_block (const gchar *file_name, 
+	     gint width, 
+	     SaryInt depth, 
+	     SaryInt *block, 
+	     SaryInt len)
+{
+    SaryWriter *writer;
+    SaryHeader header;
+    SaryInt i;
+    gboolean result = TRUE;
+
+    sary_header_init2(&header, width, depth);
+    writer = sary_writer_new_with_header(file_name, &header);
+    if (writer == NULL) {
+	return FALSE;
+    }
+    for (i = 0; i < len && result == TRUE; i++) {
+	result = sary_writer_write(writer, block[i]);
+    }
+    if (result == TRUE) {
+	result = sary_writer_flush(writer);
+    }
+    sary_writer_destroy(writer);
+
+    return result;
+}
+
+/*
+ * Merge the sorted runs stored one after another in the
+ * file `run_name' into the array file.
+ */
+static gboolean
+merge_runs (SaryBuilder *builder, 
+	    const gchar *run_name, 
+	    SaryInt *runs, 
+	    SaryInt nruns,
+	    SaryInt nipoints)
+{
+    SaryMmap *mobj;
+    SaryHeader header;
+    SaryMerger *merger;
+    SaryInt i, *payload;
+    gboolean result;
+
+    mobj = sary_mmap(run_name, "r");
+    if (mobj == NULL) {
+	return FALSE;
+    }
+    sary_header_read(&header, mobj->map, mobj->len);
+    payload = (SaryInt *)((gchar *)mobj->map + header.len);
+
+    merger = sary_merger_new(builder->text, builder->array_name, nruns);
+    sary_merger_set_offset_width(merger, builder->offset_width);
+    sary_merger_set_nthreads(merger, builder->nthreads);
+    sary_merger_set_fanin(merger, builder->fanin);
+    sary_merger_set_depth(merger, builder->depth);
+    for (i = 0; i < nruns; i++) {
+	sary_merger_add_block(merger, payload, runs[i]);
+	payload += runs[i];
+    }
+    result = sary_merger_merge(merger, 
+			       builder->progress_func, 
+			       builder->progress_func_data, 
+			       nipoints);
+    sary_merger_destroy(merger);
+    sary_munmap(mobj);
+
+    return result;
+}
+
+/*
+ * Return the fewest bits for any offset in the text, but 8
+ * at least.
+ */
+static gint
+get_packed_width (SaryBuilder *builder)
+{
+    guint64 len = sary_text_get_size(builder->text);
+    gint width = 8;
+
+    while (width < 56 && len > (guint64)1 << width) {
+	width++;
+    }
+    return width;
+}
+
+/*
+ * Return the depth which suffixes are sorted to by the
+ * engine, 0 for full sorting.
+ */
+static SaryInt
+get_depth (SaryBuilder *builder)
+{
+    if (builder->sort_engine == SARY_SORT_SAIS ||
+	builder->sort_engine == SARY_SORT_QSUFSORT)
+    {
+	return 0;
+    }
+    return builder->depth;
+}
+
+/*
+ * Replace SARY_SORT_AUTO with an engine fit for the text
+ * and plan block sorting within the memory limit, or the
+ * free memory if none is set. Index points sampled evenly
+ * from the text are sorted up to SAMPLE_DEPTH bytes and
+ * the mean lcp of the neighbors tells how repetitive the
+ * text is. SA-IS copes with a repetitive text if every
+ * byte is an index point, and so does prefix doubling if
+ * sorting the whole text costs less than comparing the
+ * repeats. Cached keys pay for a small alphabet, which
+ * makes suffixes share long prefixes, or a text larger than
+ * the CPU cache. The choice and the figures behind it are
+ * reported as the message of the "plan" task.
+ */
+static void
+choose_engine (SaryBuilder *builder)
+{
+    gchar *eof   = sary_text_get_eof(builder->text);
+    SaryInt size = sary_text_get_size(builder->text);
+    SaryInt i, nsamples, nsymbols, nipoints, max_lcp = 0;
+    gdouble mean_lcp = 0;
+    guint64 limit, sum_lcp = 0, nblocks;
+    gboolean is_repetitive, is_bytewise, is_full;
+    gchar **samples, *message;
+    SarySortEngine engine;
+    SaryProgress *progress;
+    IpointTab *tab = get_ipoint_tab(builder->ipoint_func);
+
+    progress = sary_progress_new("plan", 0);
+    sary_progress_connect(progress,
+			  builder->progress_func, 
+			  builder->progress_func_data);
+
+    samples  = g_new(gchar *, NSAMPLES);
+    nsamples = take_samples(builder, tab, samples, &nsymbols);
+    g_qsort_with_data(samples, nsamples, sizeof(gchar *), samplecmp, eof);
+    for (i = 1; i < nsamples; i++) {
+	SaryInt lcp = sample_lcp(samples[i - 1], samples[i], eof);
+
+	sum_lcp += lcp;
+	max_lcp  = MAX(max_lcp, lcp);
+    }
+    if (nsamples > 1) {
+	mean_lcp = (gdouble)sum_lcp / (nsamples - 1);
+    }
+    g_free(samples);
+
+    limit = builder->memory_limit;
+    if (limit == 0) {
+	limit = get_free_memory();
+    }
+    nipoints      = estimate_nipoints(builder);
+    is_repetitive = mean_lcp >= REPEAT_LCP;
+    is_bytewise   = tab != NULL && tab->sync_func == sync_any;
+
+    /*
+     * SA-IS and prefix doubling sort suffixes fully, while
+     * repeats cost Multikey Quicksort no more than the
+     * depth if it is bounded.
+     */
+    is_full = builder->depth == 0;
+
+    if (is_full && is_repetitive && is_bytewise &&
+	(guint64)size * (sizeof(SaryInt) + 1) <= limit)
+    {
+	engine = SARY_SORT_SAIS;
+    } else if (is_full && is_repetitive && 
+	       nipoints * mean_lcp > (gdouble)size * QSUFSORT_COST &&
+	       (guint64)(size + 1) * 2 * sizeof(SaryInt) + size <= limit)
+    {
+	engine = SARY_SORT_QSUFSORT;
+    } else if (is_repetitive || nsymbols <= SMALL_ALPHABET || 
+	       size >= LARGE_TEXT) 
+    {
+	engine = SARY_SORT_MKQSORT_CACHED;
+    } else {
+	engine = SARY_SORT_MKQSORT;
+    }
+
+    builder->sort_engine  = engine;
+    builder->is_limited   = TRUE;
+    builder->memory_limit = limit;
+    plan(builder);
+
+    nblocks = (nipoints + builder->block_size - 1) / builder->block_size;
+    message = g_strdup_printf("%s engine, %ld blocks of %ld index points, "
+			      "%ld threads; %ld symbols, lcp %.1f mean "
+			      "%ld max in %ld samples, %ld MB memory",
+			      get_engine_name(engine), (glong)nblocks, 
+			      (glong)builder->block_size, 
+			      (glong)builder->nthreads, (glong)nsymbols, 
+			      mean_lcp, (glong)max_lcp, (glong)nsamples, 
+			      (glong)(limit / (1024 * 1024)));
+    sary_progress_set_message(progress, message);
+    sary_progress_destroy(progress);
+    g_free(message);
+}
+
+/*
+ * Take up to NSAMPLES index points, one from each of
+ * evenly divided pieces of the text, and count symbols in
+ * the WINDOW_SIZE bytes after them. Return the number of
+ * samples taken.
+ */
+static SaryInt
+take_samples (SaryBuilder *builder, 
+	      IpointTab *tab, 
+	      gchar **samples, 
+	      SaryInt *nsymbols)
+{
+    SaryText text = *builder->text;
+    gchar *bof    = sary_text_get_bof(&text);
+    gchar *eof    = sary_text_get_eof(&text);
+    SaryInt size  = eof - bof;
+    SaryInt i, j, npieces, nsamples = 0;
+    guint32 seed = 1;
+    gboolean seen[256];
+
+    for (i = 0; i < 256; i++) {
+	seen[i] = FALSE;
+    }
+    *nsymbols = 0;
+
+    npieces = MIN(size, NSAMPLES);
+    for (i = 0; i < npieces; i++) {
+	SaryInt first = (gdouble)size * i / npieces;
+	SaryInt last  = (gdouble)size * (i + 1) / npieces;
+	gchar *cursor;
+
+	seed   = seed * 1103515245 + 12345;
+	cursor = bof + first + (seed >> 8) % (last - first);
+	for (j = 0; j < WINDOW_SIZE && cursor + j < eof; j++) {
+	    guchar c = cursor[j];
+
+	    if (!seen[c]) {
+		seen[c] = TRUE;
+		(*nsymbols)++;
+	    }
+	}
+
+	/*
+	 * Move to the next index point if it is known how to
+	 * start indexing there.
+	 */
+	if (tab != NULL) {
+	    sary_text_set_cursor(&text, tab->sync_func(cursor, bof, eof));
+	    cursor = builder->ipoint_func(&text);
+	    if (cursor == NULL) {
+		break;
+	    }
+	}
+	if (nsamples == 0 || cursor != samples[nsamples - 1]) {
+	    samples[nsamples++] = cursor;
+	}
+    }
+    return nsamples;
+}
+
+/*
+ * The length of the common prefix up to SAMPLE_DEPTH.
+ */
+static SaryInt
+sample_lcp (const gchar *s1, const gchar *s2, const gchar *eof)
+{
+    SaryInt i, len = MIN(eof - MAX(s1, s2), SAMPLE_DEPTH);
+
+    for (i = 0; i < len && s1[i] == s2[i]; i++) {
+	;
+    }
+    return i;
+}
+
+static gint
+samplecmp (gconstpointer s1, gconstpointer s2, gpointer eof)
+{
+    const gchar *suffix1 = *(gchar **)s1;
+    const gchar *suffix2 = *(gchar **)s2;
+    SaryInt lcp = sample_lcp(suffix1, suffix2, eof);
+
+    if (lcp == SAMPLE_DEPTH) {
+	return 0;
+    } else if (suffix1 + lcp == eof) {
+	return -1;
+    } else if (suffix2 + lcp == eof) {
+	return 1;
+    } else {
+	return (guchar)suffix1[lcp] - (guchar)suffix2[lcp];
+    }
+}
+
+static const gchar *
+get_engine_name (SarySortEngine engine)
+{
+    switch (engine) {
+    case SARY_SORT_SAIS:
+	return "sais";
+    case SARY_SORT_MKQSORT_CACHED:
+	return "cached";
+    case SARY_SORT_QSUFSORT:
+	return "qsufsort";
+    default:
+	return "mkqsort";
+    }
+}
+
+/*
+ * Up to half of the memory is left to the text which
+ * sorting reads at random. The rest holds a block and its
+ * cached keys while sorting, and a writer for each thread
+ * and the read-ahead of each run while merging. Too many
+ * blocks for the fan-in are merged in several passes.
+ */
+static void
+plan (SaryBuilder *builder)
+{
+    guint64 limit, budget, elt_size, len;
+    SaryInt nipoints, nthreads;
+
+    limit = builder->memory_limit;
+    if (limit == 0) {
+	limit = get_free_memory();
+    }
+    budget = limit - MIN(sary_text_get_size(builder->text), limit / 2);
+    budget = budget > WRITER_SIZE ? budget - WRITER_SIZE : 0;
+
+    elt_size = sizeof(SaryInt);
+    if (builder->sort_engine == SARY_SORT_MKQSORT_CACHED) {
+	elt_size += CACHED_KEY_SIZE;
+    }
+
+    nipoints = estimate_nipoints(builder);
+    if (!builder->block_size_set) {
+	len = MAX(budget / elt_size, MIN_BLOCK_LEN);
+	builder->block_size = MIN(len, MAX(nipoints, 1));
+    }
+    if (builder->fanin == 0) {
+	builder->fanin = MIN(MAX(budget / RUN_SIZE, 2), G_MAXINT);
+    }
+
+    if (!builder->nthreads_set) {
+	nthreads = MIN(get_ncpus(), MAX(budget / WRITER_SIZE, 1));
+	nthreads = MIN(nthreads, nipoints / MIN_BLOCK_LEN);
+	builder->nthreads = MAX(nthreads, 1);
+    }
+}
+
+/*
+ * Count index points in the first SAMPLE_SIZE bytes of the
+ * text and extrapolate with a margin of 1/16. Every byte is
+ * an index point for the functions synchronized anywhere.
+ */
+static SaryInt
+estimate_nipoints (SaryBuilder *builder)
+{
+    IpointTab *tab = get_ipoint_tab(builder->ipoint_func);
+    SaryText text  = *builder->text;
+    SaryInt size   = sary_text_get_size(&text);
+    gchar *bof     = sary_text_get_bof(&text);
+    gchar *cursor;
+    SaryInt count = 0;
+    gdouble estimate;
+
+    if (tab != NULL && tab->sync_func == sync_any) {
+	return size;
+    }
+
+    sary_text_set_cursor(&text, bof);
+    while ((cursor = builder->ipoint_func(&text)) != NULL) {
+	if (cursor - bof >= SAMPLE_SIZE) {
+	    break;
+	}
+	count++;
+    }
+    if (cursor == NULL) {
+	return count;  /* exact */
+    }
+
+    estimate = (gdouble)count * size / SAMPLE_SIZE * 17 / 16;
+    return MIN(estimate, size) + 1;
+}
+
+static guint64
+get_free_memory (void)
+{
+#if defined(_SC_AVPHYS_PAGES) && defined(_SC_PAGESIZE)
+    glong pages = sysconf(_SC_AVPHYS_PAGES);
+
+    if (pages > 0) {
+	return (guint64)pages * sysconf(_SC_PAGESIZE);
+    }
+#endif
+    return DEFAULT_MEMORY;
+}
+
+static SaryInt
+get_ncpus (void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    glong ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (ncpus > 0) {
+	return MIN(ncpus, G_MAXINT);
+    }
+#endif
+    return 1;
+}
+
+static IpointTab *
+get_ipoint_tab (SaryIpointFunc ipoint_func)
+{
+    IpointTab *cursor;
+
+    for (cursor = ipoint_tab; cursor->ipoint_func != NULL; cursor++) {
+	if (cursor->ipoint_func == ipoint_func) {
+	    return cursor;
+	}
+    }
+    return NULL;
+}
+
+static gchar *
+sync_any (gchar *cursor, gchar *bof, gchar *eof)
+{
+    return cursor;
+}
+
+/*
+ * Skip continuation bytes.
+ */
+static gchar *
+sync_utf8 (gchar *cursor, gchar *bof, gchar *eof)
+{
+    while (cursor < eof && ((guchar)*cursor & 0xc0) == 0x80) {
+	cursor++;
+    }
+    return cursor;
+}
+
+/*
+ * Bytes of multibyte characters are 0x80 or larger in
+ * EUC-JP so that a character begins after an ASCII one.
+ */
+static gchar *
+sync_eucjp (gchar *cursor, gchar *bof, gchar *eof)
+{
+    while (cursor < eof && cursor > bof && (guchar)cursor[-1] >= 0x80) {
+	cursor++;
+    }
+    return cursor;
+}
+
+/*
+ * The second byte of a Shift_JIS character is 0x40 or
+ * larger.
+ */
+static gchar *
+sync_sjis (gchar *cursor, gchar *bof, gchar *eof)
+{
+    while (cursor < eof && cursor > bof && (guchar)cursor[-1] >= 0x40) {
+	cursor++;
+    }
+    return cursor;
+}
+
+static gchar *
+sync_line (gchar *cursor, gchar *bof, gchar *eof)
+{
+    while (cursor < eof && cursor > bof && cursor[-1] != '\n') {
+	cursor++;
+    }
+    return cursor;
+}
+
+static gchar *
+sync_word (gchar *cursor, gchar *bof, gchar *eof)
+{
+    while (cursor < eof && cursor > bof && 
+	   (!is_space(cursor[-1]) || is_space(*cursor)))
+    {
+	cursor++;
+    }
+    return cursor;
+}
+
+/*
+ * Same as sary_str_get_whitespaces().
+ */
+static inline gboolean
+is_space (gchar c)
+{
+    return c == ' ' || c == '\f' || c == '\n' || 
+	c == '\r' || c == '\t' || c == '\v';
+}
+
+/*
+ * Rename the array file to `dest_name' to be sorted in
+ * place. It is rewritten with SaryInt wide offsets if it
+ * has another width.
+ */
+static gboolean
+rename_to_work (const gchar *src_name, const gchar *dest_name)
+{
+    SaryMmap *src;
+    SaryHeader header;
+    gboolean result;
+
+    src = sary_mmap(src_name, "r");
+    if (src == NULL) {
+	return FALSE;
+    }
+    result = sary_header_read(&header, src->map, src->len);
+    sary_munmap(src);
+    if (result == FALSE) {
+	errno = EINVAL;
+	return FALSE;
+    }
+
+    if (header.width == sizeof(SaryInt) * 8 && 
+	header.byte_order == G_BIG_ENDIAN) 
+    {
+	return rename(src_name, dest_name) != -1;
+    }
+
+    sary_header_init(&header, sizeof(SaryInt) * 8);
+    if (rewrite(src_name, dest_name, &header)) {
+	return unlink(src_name) != -1;
+    } else {
+	return FALSE;
+    }
+}
+
+/*
+ * Rewrite the array file made by merging with a header of
+ * version 2 if it is wanted. See sary_builder_set_native().
+ */
+static gboolean
+finish (SaryBuilder *builder)
+{
+    SaryMmap *map;
+    SaryHeader header, dest_header;
+    gchar *tmp_name;
+    gboolean result;
+
+    if (builder->is_native == FALSE) {
+	return TRUE;
+    }
+
+    map = sary_mmap(builder->array_name, "r");
+    if (map == NULL) {
+	return FALSE;
+    }
+    result = sary_header_read(&header, map->map, map->len);
+    sary_munmap(map);
+    if (result == FALSE) {
+	errno = EINVAL;
+	return FALSE;
+    }
+
+    make_header(builder, header.width, header.depth, &dest_header);
+    tmp_name = g_strconcat(builder->array_name, ".tmp", NULL);
+    result = rewrite(builder->array_name, tmp_name, &dest_header);
+    if (result == TRUE) {
+	result = (rename(tmp_name, builder->array_name) != -1);
+    }
+    unlink(tmp_name);
+    g_free(tmp_name);
+
+    return result;
+}
+
+/*
+ * Initialize the header of the array file to be written,
+ * which is of version 2 with offsets in the native byte
+ * order if sary_builder_set_native() is called.
+ */
+static void
+make_header (SaryBuilder *builder, 
+	     gint width, 
+	     SaryInt depth, 
+	     SaryHeader *header)
+{
+    sary_header_init2(header, width, depth);
+    if (builder->is_native) {
+	sary_header_set_text(header, builder->text, 
+			     sary_ipoint_get_kind(builder->ipoint_func));
+	if (width == 32 || width == 64) {
+	    sary_header_set_byte_order(header, G_BYTE_ORDER);
+	}
+    }
+}
+
+static gboolean
+rewrite (const gchar *src_name, 
+	 const gchar *dest_name, 
+	 const SaryHeader *dest_header)
+{
+    SaryMmap *src;
+    SaryWriter *writer;
+    SaryInt i, nipoints;
+    SaryHeader header;
+    gchar *payload;
+    gboolean result = TRUE;
+
+    src = sary_mmap(src_name, "r");
+    if (src == NULL) {
+	return FALSE;
+    }
+    sary_header_read(&header, src->map, src->len);
+    payload  = (gchar *)src->map + header.len;
+    nipoints = sary_header_count_offsets(&header, src->len);
+
+    writer = sary_writer_new_with_header(dest_name, dest_header);
+    if (writer == NULL) {
+	sary_munmap(src);
+	return FALSE;
+    }
+    for (i = 0; i < nipoints; i++) {
+	SaryInt offset = sary_header_get_offset(&header, payload, i);
+
+	if (sary_writer_write(writer, SARY_INT_TO_BE(offset)) == FALSE) {
+	    result = FALSE;
+	    break;
+	}
+    }
+    if (result == TRUE) {
+	result = sary_writer_flush(writer);
+    }
+    sary_writer_destroy(writer);
+    sary_munmap(src);
+
+    return result;
+}
+
 static void
 progress_quiet (SaryProgress *progress)
 {
     /* do nothing */
 }
 
+
+/*
+ * The sidecar files left by the previous array would
+ * mislead searches on the new one.
+ */
+static void
+remove_sidecars (SaryBuilder *builder)
+{
+    gchar *lcp_name = sary_lcp_file_name(builder->array_name);
+    gchar *prefix_name = sary_prefix_file_name(builder->array_name);
+    gchar *child_name = sary_child_file_name(builder->array_name);
+    gchar *sample_name = sary_sample_file_name(builder->array_name);
+    gchar *fmindex_name = sary_fmindex_file_name(builder->array_name);
+
+    unlink(lcp_name);
+    unlink(prefix_name);
+    unlink(child_name);
+    unlink(sample_name);
+    unlink(fmindex_name);
+    g_free(lcp_name);
+    g_free(prefix_name);
+    g_free(child_name);
+    g_free(sample_name);
+    g_free(fmindex_name);
+}
@@ -4,6 +4,7 @@
 #include <glib.h>
 #include <sary/ipoint.h>
 #include <sary/progress.h>
+#include <sary/sorter.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -25,10 +26,33 @@ SaryInt		sary_builder_index		(SaryBuilder *builder);
 
 gboolean	sary_builder_sort		(SaryBuilder *builder);
 gboolean	sary_builder_block_sort		(SaryBuilder *builder);
+gboolean	sary_builder_index_and_block_sort
+						(SaryBuilder *builder);
+gboolean	sary_builder_pack		(SaryBuilder *builder);
+gboolean	sary_builder_make_lcp		(SaryBuilder *builder);
+gboolean	sary_builder_make_prefix	(SaryBuilder *builder,
+						 gint nbytes);
+gboolean	sary_builder_make_child		(SaryBuilder *builder);
+gboolean	sary_builder_make_sample	(SaryBuilder *builder,
+						 SaryInt interval);
+gboolean	sary_builder_make_fmindex	(SaryBuilder *builder,
+						 SaryInt interval);
 void		sary_builder_set_block_size	(SaryBuilder *builder,
 						 SaryInt block_size);
 void		sary_builder_set_nthreads	(SaryBuilder *builder,
 						 SaryInt nthreads);
+void		sary_builder_set_fanin		(SaryBuilder *builder,
+						 SaryInt fanin);
+void		sary_builder_set_depth		(SaryBuilder *builder,
+						 SaryInt depth);
+void		sary_builder_set_memory_limit	(SaryBuilder *builder,
+						 gsize limit);
+void		sary_builder_set_sort_engine	(SaryBuilder *builder,
+						 SarySortEngine engine);
+void		sary_builder_set_offset_width	(SaryBuilder *builder,
+						 gint width);
+void		sary_builder_set_native		(SaryBuilder *builder,
+						 gboolean native);
 void		sary_builder_connect_progress	(SaryBuilder *builder,
 						 SaryProgressFunc 
 						 	progress_func,
@@ -0,0 +1,66 @@
+#ifndef __SARY_BYTES_H__
+#define __SARY_BYTES_H__
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Numbers in the headers of array files and their sidecar
+ * files, which are in big endian unless noted otherwise.
+ * This header is internal to the library and not
+ * installed.
+ */
+
+static inline guint32
+sary_get_uint32 (const guchar *p)
+{
+    return (guint32)p[0] << 24 | (guint32)p[1] << 16 |
+	   (guint32)p[2] << 8  | (guint32)p[3];
+}
+
+static inline void
+sary_put_uint32 (guchar *p, guint32 val)
+{
+    p[0] = val >> 24;
+    p[1] = val >> 16;
+    p[2] = val >> 8;
+    p[3] = val;
+}
+
+static inline guint64
+sary_get_uint64 (const guchar *p)
+{
+    return (guint64)sary_get_uint32(p) << 32 | sary_get_uint32(p + 4);
+}
+
+static inline void
+sary_put_uint64 (guchar *p, guint64 val)
+{
+    sary_put_uint32(p, val >> 32);
+    sary_put_uint32(p + 4, val);
+}
+
+static inline guint32
+sary_get_uint32_le (const guchar *p)
+{
+    return (guint32)p[3] << 24 | (guint32)p[2] << 16 |
+	   (guint32)p[1] << 8  | (guint32)p[0];
+}
+
+static inline void
+sary_put_uint32_le (guchar *p, guint32 val)
+{
+    p[0] = val;
+    p[1] = val >> 8;
+    p[2] = val >> 16;
+    p[3] = val >> 24;
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __SARY_BYTES_H__ */
@@ -64,8 +64,8 @@ void
 sary_cache_add (SaryCache *cache, 
 		const gchar *pattern,
 		SaryInt len,
-		SaryInt *first,
-		SaryInt *last)
+		SaryInt first,
+		SaryInt last)
 {
     SaryResult *item  = g_new(SaryResult, 1);
     SaryPattern *key = g_new(SaryPattern, 1);
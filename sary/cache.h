@@ -19,8 +19,8 @@ SaryResult*	sary_cache_get		(SaryCache *cache,
 void		sary_cache_add		(SaryCache *cache, 
 					 const gchar *pattern,
 					 SaryInt len,
-					 SaryInt *first,
-					 SaryInt *last);
+					 SaryInt first,
+					 SaryInt last);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,322 @@
+/*
+ * sary - a suffix array library
+ *
+ * $Id$
+ *
+ * Copyright (C) 2000  Satoru Takabayashi <satoru@namazu.org>
+ * All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <glib.h>
+#include <sary.h>
+#include <sary/bytes.h>
+
+/*
+ * Child file, a sidecar of an array file (all numbers in
+ * big endian):
+ *
+ *   0  8  magic "\211SCLD\r\n\032"
+ *   8  4  version
+ *  12  4  length of the header
+ *  16  8  number of entries, same as the index points
+ *  24  4  depth of sorting of the array, 0 if full
+ *  28  4  width of an entry in bits, 32 or 64
+ *  32     entries
+ *
+ * The child table of an enhanced suffix array lets a search
+ * walk down the lcp-intervals of the array as it would walk
+ * down a suffix tree. An l-interval [i..j] holds suffixes
+ * sharing l bytes, and its l-indices, the k in (i..j] with
+ * lcp[k] = l, split it into the child intervals. With lcp
+ * of -1 before the first suffix and after the last, each
+ * entry holds one of the three values of the paper:
+ *
+ *   up[i + 1]	  if lcp[i] > lcp[i + 1]
+ *   nextlIndex[i]  the next l-index after i, if any
+ *   down[i]	  otherwise, if any, and 0 if none
+ *
+ * which never overlap where a search needs them. The first
+ * l-index of [i..j] is up[j + 1] if it is in (i..j], and
+ * down[i] otherwise.
+ *
+ * Reference:
+ * Mohamed Ibrahim Abouelhoda, Stefan Kurtz, Enno Ohlebusch:
+ * "Replacing Suffix Trees with Enhanced Suffix Arrays,"
+ * Journal of Discrete Algorithms 2(1), 2004.
+ */
+
+enum {
+    CHILD_VERSION     = 1,
+    CHILD_HEADER_SIZE = 32
+};
+
+static const gchar magic[8] = "\211SCLD\r\n\032";
+
+struct _SaryChild {
+    SaryMmap	*file;
+    guchar	*entries;
+    SaryInt	len;
+    SaryInt	depth;
+    gint	width;
+};
+
+static void		set_up_down	(SaryLcp *lcp,
+					 SaryInt *entries,
+					 SaryInt *stack);
+static void		set_next	(SaryLcp *lcp,
+					 SaryInt *entries,
+					 SaryInt *stack);
+static inline SaryInt	get_lcp		(SaryLcp *lcp, SaryInt idx);
+static gboolean		write_child	(SaryLcp *lcp,
+					 SaryInt *entries,
+					 const gchar *child_name);
+
+
+/*
+ * Compute the child table from the LCP file `lcp_name' and
+ * write it to `child_name'. Each of the two passes keeps a
+ * stack of indices with nondecreasing lcp, which takes
+ * linear time and two offsets of memory per index point.
+ */
+gboolean
+sary_child_make (const gchar *lcp_name, const gchar *child_name)
+{
+    SaryLcp *lcp;
+    SaryInt *entries, *stack, len;
+    gboolean result;
+
+    lcp = sary_lcp_new(lcp_name);
+    if (lcp == NULL) {
+	return FALSE;
+    }
+
+    len	    = sary_lcp_get_len(lcp);
+    entries = g_new0(SaryInt, MAX(len, 1));
+    stack   = g_new(SaryInt, len + 1);
+    set_up_down(lcp, entries, stack);
+    set_next(lcp, entries, stack);
+    g_free(stack);
+
+    result = write_child(lcp, entries, child_name);
+    g_free(entries);
+    sary_lcp_destroy(lcp);
+
+    return result;
+}
+
+/* The child file name. See sary_sidecar_file_name(). */
+gchar *
+sary_child_file_name (const gchar *array_name)
+{
+    return sary_sidecar_file_name(array_name, ".cld");
+}
+
+SaryChild *
+sary_child_new (const gchar *child_name)
+{
+    SaryChild *child;
+    SaryMmap *file;
+    guchar *p;
+    guint64 len;
+    gint width;
+
+    file = sary_mmap(child_name, "r");
+    if (file == NULL) {
+	return NULL;
+    }
+
+    p = file->map;
+    if (file->len < CHILD_HEADER_SIZE ||
+	memcmp(p, magic, sizeof(magic)) != 0 ||
+	sary_get_uint32(p + 8)  != CHILD_VERSION ||
+	sary_get_uint32(p + 12) != CHILD_HEADER_SIZE)
+    {
+	goto broken;
+    }
+    len	  = sary_get_uint64(p + 16);
+    width = sary_get_uint32(p + 28);
+    if ((width != 32 && width != 64) || len > (guint64)file->len ||
+	file->len != CHILD_HEADER_SIZE + len * (width / 8))
+    {
+	goto broken;
+    }
+
+    child = g_new(SaryChild, 1);
+    child->file	   = file;
+    child->entries = p + CHILD_HEADER_SIZE;
+    child->len	   = len;
+    child->depth   = sary_get_uint32(p + 24);
+    child->width   = width;
+
+    return child;
+
+ broken:
+    g_warning("%s: unsupported child format", child_name);
+    sary_munmap(file);
+    errno = EINVAL;
+    return NULL;
+}
+
+void
+sary_child_destroy (SaryChild *child)
+{
+    sary_munmap(child->file);
+    g_free(child);
+}
+
+/*
+ * Return the idx-th entry. See the comment at the top of
+ * this file.
+ */
+SaryInt
+sary_child_get (SaryChild *child, SaryInt idx)
+{
+    g_assert(idx >= 0 && idx < child->len);
+
+    if (child->width == 32) {
+	return sary_get_uint32(child->entries + idx * 4);
+    } else {
+	return sary_get_uint64(child->entries + idx * 8);
+    }
+}
+
+SaryInt
+sary_child_get_len (SaryChild *child)
+{
+    return child->len;
+}
+
+SaryInt
+sary_child_get_depth (SaryChild *child)
+{
+    return child->depth;
+}
+
+/*
+ * An index popped for a smaller lcp closes an interval.
+ * The last one popped is the first l-index of the interval
+ * closed there, which is up[i], and down of the index left
+ * on the top if the lcp of the top is not greater.
+ */
+static void
+set_up_down (SaryLcp *lcp, SaryInt *entries, SaryInt *stack)
+{
+    SaryInt i, top = 0, last = -1, len = sary_lcp_get_len(lcp);
+
+    stack[0] = 0;
+    for (i = 1; i <= len; i++) {
+	SaryInt val = get_lcp(lcp, i);
+
+	while (val < get_lcp(lcp, stack[top])) {
+	    last = stack[top--];
+	    if (val <= get_lcp(lcp, stack[top]) &&
+		get_lcp(lcp, stack[top]) != get_lcp(lcp, last))
+	    {
+		entries[stack[top]] = last;  /* down */
+	    }
+	}
+	if (last != -1) {
+	    entries[i - 1] = last;  /* up[i] */
+	    last = -1;
+	}
+	stack[++top] = i;
+    }
+}
+
+/*
+ * An index of the same lcp as the top, with nothing smaller
+ * in between, is the next l-index of the top. It takes the
+ * place of down, which a search never needs there.
+ */
+static void
+set_next (SaryLcp *lcp, SaryInt *entries, SaryInt *stack)
+{
+    SaryInt i, top = 0, len = sary_lcp_get_len(lcp);
+
+    stack[0] = 0;
+    for (i = 1; i < len; i++) {
+	SaryInt val = get_lcp(lcp, i);
+
+	while (val < get_lcp(lcp, stack[top])) {
+	    top--;
+	}
+	if (val == get_lcp(lcp, stack[top])) {
+	    entries[stack[top--]] = i;
+	}
+	stack[++top] = i;
+    }
+}
+
+/*
+ * Return the lcp of the (idx-1)-th and idx-th suffixes, or
+ * -1 at both ends of the array.
+ */
+static inline SaryInt
+get_lcp (SaryLcp *lcp, SaryInt idx)
+{
+    if (idx == 0 || idx == sary_lcp_get_len(lcp)) {
+	return -1;
+    }
+    return sary_lcp_get(lcp, idx);
+}
+
+static gboolean
+write_child (SaryLcp *lcp, SaryInt *entries, const gchar *child_name)
+{
+    FILE *fp;
+    guchar buf[CHILD_HEADER_SIZE];
+    SaryInt i, len = sary_lcp_get_len(lcp);
+    gint width;
+    gint saved_errno;
+
+    fp = fopen(child_name, "wb");
+    if (fp == NULL) {
+	return FALSE;
+    }
+
+    width = (guint64)len > 0xffffffff ? 64 : 32;
+    memcpy(buf, magic, sizeof(magic));
+    sary_put_uint32(buf + 8,	 CHILD_VERSION);
+    sary_put_uint32(buf + 12, CHILD_HEADER_SIZE);
+    sary_put_uint64(buf + 16, len);
+    sary_put_uint32(buf + 24, sary_lcp_get_depth(lcp));
+    sary_put_uint32(buf + 28, width);
+    fwrite(buf, 1, CHILD_HEADER_SIZE, fp);
+
+    for (i = 0; i < len; i++) {
+	if (width == 32) {
+	    sary_put_uint32(buf, entries[i]);
+	    fwrite(buf, 1, 4, fp);
+	} else {
+	    sary_put_uint64(buf, entries[i]);
+	    fwrite(buf, 1, 8, fp);
+	}
+    }
+
+    if (ferror(fp)) {
+	saved_errno = errno;
+	fclose(fp);
+	errno = saved_errno;
+	return FALSE;
+    }
+    return fclose(fp) == 0;
+}
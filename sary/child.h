@@ -0,0 +1,26 @@
+#ifndef __SARY_CHILD_H__
+#define __SARY_CHILD_H__
+
+#include <glib.h>
+#include <sary/saryconfig.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct _SaryChild SaryChild;
+
+gboolean	sary_child_make		(const gchar *lcp_name,
+					 const gchar *child_name);
+gchar*		sary_child_file_name	(const gchar *array_name);
+SaryChild*	sary_child_new		(const gchar *child_name);
+void		sary_child_destroy	(SaryChild *child);
+SaryInt		sary_child_get		(SaryChild *child, SaryInt idx);
+SaryInt		sary_child_get_len	(SaryChild *child);
+SaryInt		sary_child_get_depth	(SaryChild *child);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __SARY_CHILD_H__ */
@@ -0,0 +1,654 @@
+/*
+ * sary - a suffix array library
+ *
+ * $Id$
+ *
+ * Copyright (C) 2000  Satoru Takabayashi <satoru@namazu.org>
+ * All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <glib.h>
+#include <sary.h>
+#include <sary/bytes.h>
+
+/*
+ * FM-index file, a sidecar of an array file which can stand
+ * for it (all numbers in big endian):
+ *
+ *   0  8  magic "\211SFMI\r\n\032"
+ *   8  4  version
+ *  12  4  length of the header
+ *  16  8  length of the text, same as the index points
+ *  24  4  interval of the sampled offsets
+ *  28  4  width of a sampled offset in bits, 32 or 64
+ *  32  8  row of the first suffix of the text
+ *  40  8  number of sampled offsets
+ *  48     number of rows less than each byte, 256 * 8 bytes
+ *         first row of each byte at the last level, 256 * 8
+ *         8 levels of the wavelet matrix, each of which is
+ *	   the number of its 0 bits (8 bytes) and a bit vector
+ *	   bit vector of the rows whose offsets are sampled
+ *	   sampled offsets in the order of the rows
+ *
+ * Rows are the suffixes of the text in the order of the
+ * array after the empty suffix at the end of the text, and
+ * the Burrows-Wheeler transform of the text holds the byte
+ * before each of them, 0 for the first suffix. A bit vector
+ * of n bits is divided into n / 512 + 1 blocks of 72 bytes,
+ * the number of 1 bits before the block and 512 bits, the
+ * i-th of which is the (i % 8)-th lowest bit of the (i /
+ * 8)-th byte.
+ *
+ * The wavelet matrix holds the transform bit by bit from
+ * the highest, each level stably sorted by the bit of the
+ * level above, so that the rank of a byte at a row takes a
+ * rank of 1 bits at each level. A search narrows the rows
+ * prefixed with the pattern from its last byte backwards
+ * with two such ranks per byte and never reads the array or
+ * the text. A row is located by walking back the text from
+ * it to a sampled offset, every `interval'-th byte.
+ *
+ * References:
+ * Paolo Ferragina, Giovanni Manzini: "Opportunistic Data
+ * Structures with Applications," FOCS 2000.
+ * Francisco Claude, Gonzalo Navarro: "The Wavelet Matrix,"
+ * SPIRE 2012.
+ */
+
+enum {
+    FMINDEX_VERSION	= 1,
+    FMINDEX_HEADER_SIZE = 48,
+    NSYMBOLS		= 256,
+    NLEVELS		= 8,
+    BLOCK_BITS		= 512,
+    BLOCK_SIZE		= 8 + BLOCK_BITS / 8
+};
+
+static const gchar magic[8] = "\211SFMI\r\n\032";
+
+struct _SaryFmindex {
+    SaryMmap		*file;
+    SaryInt		len;
+    SaryInt		interval;
+    gint		width;
+    SaryInt		dollar;
+    SaryInt		counts[NSYMBOLS];
+    SaryInt		starts[NSYMBOLS];
+    SaryInt		zeros[NLEVELS];
+    const guchar	*levels[NLEVELS];
+    const guchar	*marks;
+    const guchar	*samples;
+};
+
+typedef struct {
+    const gchar		*bof;
+    SaryHeader		header;
+    gconstpointer	payload;
+    SaryInt		len;
+    SaryInt		interval;
+    SaryInt		dollar;
+    guchar		*bwt;
+    guchar		*bits;
+    SaryInt		counts[NSYMBOLS];
+    SaryInt		starts[NSYMBOLS];
+} Builder;
+
+static void		transform	(Builder *builder);
+static void		write_levels	(Builder *builder, FILE *fp);
+static void		write_samples	(Builder *builder, FILE *fp,
+					 gint width);
+static void		set_bit		(guchar *bits, SaryInt i);
+static void		write_bits	(guchar *bits, SaryInt len,
+					 FILE *fp);
+static gint		reverse_bits	(gint c);
+static SaryInt		count_blocks	(SaryInt len);
+static inline gint	get_bit		(const guchar *bits, SaryInt i);
+static inline SaryInt	rank		(const guchar *bits, SaryInt i);
+static inline SaryInt	rank_symbol	(SaryFmindex *fmindex,
+					 gint c,
+					 SaryInt row);
+static inline SaryInt	lf		(SaryFmindex *fmindex, SaryInt row);
+static inline gint	popcount	(guint32 word);
+
+
+/*
+ * Write the FM-index of the text and the sorted array file
+ * `array_name' to `fmindex_name', sampling the offsets of
+ * every `interval'-th byte. The array must have every byte
+ * of the text as an index point and be sorted fully.
+ *
+ * The file takes n * (9 / 8 + 9 / 64) bytes and an offset
+ * per interval for a text of n bytes, about 1.4 n with 4
+ * byte offsets and an interval of 32, while the array takes
+ * 4 n.
+ */
+gboolean
+sary_fmindex_make (SaryText *text,
+		   const gchar *array_name,
+		   const gchar *fmindex_name,
+		   SaryInt interval)
+{
+    SaryMmap *map;
+    Builder builder;
+    FILE *fp;
+    guchar buf[FMINDEX_HEADER_SIZE];
+    SaryInt nipoints;
+    gint c, width, saved_errno;
+
+    g_assert(interval > 0);
+
+    map = sary_mmap(array_name, "r");
+    if (map == NULL) {
+	return FALSE;
+    }
+    if (sary_header_read(&builder.header, map->map, map->len) == FALSE) {
+	g_warning("%s: unsupported array format", array_name);
+	sary_munmap(map);
+	errno = EINVAL;
+	return FALSE;
+    }
+
+    builder.bof	     = sary_text_get_bof(text);
+    builder.len	     = sary_text_get_eof(text) - builder.bof;
+    builder.payload  = (const gchar *)map->map + builder.header.len;
+    builder.interval = interval;
+    nipoints = sary_header_count_offsets(&builder.header, map->len);
+    if (nipoints != builder.len || builder.header.depth != 0) {
+	g_warning("%s: FM-index needs every byte indexed and sorted fully",
+		  array_name);
+	sary_munmap(map);
+	errno = EINVAL;
+	return FALSE;
+    }
+
+    fp = fopen(fmindex_name, "wb");
+    if (fp == NULL) {
+	sary_munmap(map);
+	return FALSE;
+    }
+
+    transform(&builder);
+
+    width = (guint64)builder.len > 0xffffffff ? 64 : 32;
+    memcpy(buf, magic, sizeof(magic));
+    sary_put_uint32(buf + 8,	 FMINDEX_VERSION);
+    sary_put_uint32(buf + 12, FMINDEX_HEADER_SIZE);
+    sary_put_uint64(buf + 16, builder.len);
+    sary_put_uint32(buf + 24, interval);
+    sary_put_uint32(buf + 28, width);
+    sary_put_uint64(buf + 32, builder.dollar);
+    sary_put_uint64(buf + 40, (builder.len + interval - 1) / interval);
+    fwrite(buf, 1, FMINDEX_HEADER_SIZE, fp);
+    for (c = 0; c < NSYMBOLS; c++) {
+	sary_put_uint64(buf, builder.counts[c]);
+	fwrite(buf, 1, 8, fp);
+    }
+    for (c = 0; c < NSYMBOLS; c++) {
+	sary_put_uint64(buf, builder.starts[c]);
+	fwrite(buf, 1, 8, fp);
+    }
+
+    write_levels(&builder, fp);
+    write_samples(&builder, fp, width);
+    sary_munmap(map);
+
+    if (ferror(fp)) {
+	saved_errno = errno;
+	fclose(fp);
+	errno = saved_errno;
+	return FALSE;
+    }
+    return fclose(fp) == 0;
+}
+
+/* The FM-index file name. See sary_sidecar_file_name(). */
+gchar *
+sary_fmindex_file_name (const gchar *array_name)
+{
+    return sary_sidecar_file_name(array_name, ".fmi");
+}
+
+SaryFmindex *
+sary_fmindex_new (const gchar *fmindex_name)
+{
+    SaryFmindex *fmindex;
+    SaryMmap *file;
+    const guchar *p;
+    guint64 len, interval, nsamples, nblocks, size;
+    gint i, width;
+
+    file = sary_mmap(fmindex_name, "r");
+    if (file == NULL) {
+	return NULL;
+    }
+
+    p = file->map;
+    if (file->len < FMINDEX_HEADER_SIZE ||
+	memcmp(p, magic, sizeof(magic)) != 0 ||
+	sary_get_uint32(p + 8)  != FMINDEX_VERSION ||
+	sary_get_uint32(p + 12) != FMINDEX_HEADER_SIZE)
+    {
+	goto broken;
+    }
+    len	     = sary_get_uint64(p + 16);
+    interval = sary_get_uint32(p + 24);
+    width    = sary_get_uint32(p + 28);
+    nsamples = sary_get_uint64(p + 40);
+    if ((width != 32 && width != 64) || interval < 1 ||
+	len >= (guint64)file->len ||
+	nsamples != (len + interval - 1) / interval)
+    {
+	goto broken;
+    }
+    nblocks = count_blocks(len + 1);
+    size    = FMINDEX_HEADER_SIZE + NSYMBOLS * 16 +
+	NLEVELS * (8 + nblocks * BLOCK_SIZE) + nblocks * BLOCK_SIZE +
+	nsamples * (width / 8);
+    if (file->len != size) {
+	goto broken;
+    }
+
+    fmindex = g_new(SaryFmindex, 1);
+    fmindex->file     = file;
+    fmindex->len      = len;
+    fmindex->interval = interval;
+    fmindex->width    = width;
+    fmindex->dollar   = sary_get_uint64(p + 32);
+
+    p += FMINDEX_HEADER_SIZE;
+    for (i = 0; i < NSYMBOLS; i++, p += 8) {
+	fmindex->counts[i] = sary_get_uint64(p);
+    }
+    for (i = 0; i < NSYMBOLS; i++, p += 8) {
+	fmindex->starts[i] = sary_get_uint64(p);
+    }
+    for (i = 0; i < NLEVELS; i++) {
+	fmindex->zeros[i]  = sary_get_uint64(p);
+	fmindex->levels[i] = p + 8;
+	p += 8 + nblocks * BLOCK_SIZE;
+    }
+    fmindex->marks   = p;
+    fmindex->samples = p + nblocks * BLOCK_SIZE;
+
+    return fmindex;
+
+ broken:
+    g_warning("%s: unsupported FM-index format", fmindex_name);
+    sary_munmap(file);
+    errno = EINVAL;
+    return NULL;
+}
+
+void
+sary_fmindex_destroy (SaryFmindex *fmindex)
+{
+    sary_munmap(fmindex->file);
+    g_free(fmindex);
+}
+
+/*
+ * Return the number of suffixes prefixed with the pattern
+ * and store the index in the array of the first one in
+ * `first'.
+ */
+SaryInt
+sary_fmindex_search (SaryFmindex *fmindex,
+		     const gchar *pattern,
+		     SaryInt len,
+		     SaryInt *first)
+{
+    SaryInt low = 0, high = fmindex->len + 1;
+
+    if (len == 0) {  /* all but the empty suffix */
+	*first = 0;
+	return fmindex->len;
+    }
+
+    while (len-- > 0 && low < high) {
+	gint c = (guchar)pattern[len];
+
+	low  = fmindex->counts[c] + rank_symbol(fmindex, c, low);
+	high = fmindex->counts[c] + rank_symbol(fmindex, c, high);
+    }
+
+    *first = low - 1;
+    return high - low;
+}
+
+/*
+ * Return the offset in the text of the idx-th suffix of the
+ * array, walking back the text up to `interval' - 1 bytes.
+ */
+SaryInt
+sary_fmindex_locate (SaryFmindex *fmindex, SaryInt idx)
+{
+    SaryInt row = idx + 1, steps = 0, i;
+
+    g_assert(idx >= 0 && idx < fmindex->len);
+
+    while (get_bit(fmindex->marks, row) == 0) {
+	row = lf(fmindex, row);
+	steps++;
+    }
+
+    i = rank(fmindex->marks, row);
+    if (fmindex->width == 32) {
+	return sary_get_uint32(fmindex->samples + i * 4) + steps;
+    } else {
+	return sary_get_uint64(fmindex->samples + i * 8) + steps;
+    }
+}
+
+SaryInt
+sary_fmindex_get_len (SaryFmindex *fmindex)
+{
+    return fmindex->len;
+}
+
+SaryInt
+sary_fmindex_get_interval (SaryFmindex *fmindex)
+{
+    return fmindex->interval;
+}
+
+/*
+ * Take the Burrows-Wheeler transform of the text with the
+ * number of rows less than each byte, the empty suffix
+ * counted, and the first row of each byte at the last
+ * level of the wavelet matrix, where bytes are in the order
+ * of their bits reversed.
+ */
+static void
+transform (Builder *builder)
+{
+    SaryInt i, len = builder->len, nbwt[NSYMBOLS], sum;
+    gint c;
+
+    builder->bwt    = g_new(guchar, len + 1);
+    builder->dollar = 0;
+    for (c = 0; c < NSYMBOLS; c++) {
+	nbwt[c] = 0;
+    }
+
+    builder->bwt[0] = len > 0 ? builder->bof[len - 1] : 0;
+    for (i = 0; i < len; i++) {
+	SaryInt pos = sary_header_get_offset(&builder->header,
+					     builder->payload, i);
+
+	if (pos == 0) {
+	    builder->bwt[i + 1] = 0;
+	    builder->dollar	= i + 1;
+	} else {
+	    builder->bwt[i + 1] = builder->bof[pos - 1];
+	}
+    }
+    for (i = 0; i <= len; i++) {
+	nbwt[builder->bwt[i]]++;
+    }
+
+    /*
+     * The transform holds the bytes of the text and 0 for
+     * the end of the text.
+     */
+    sum = 1;
+    for (c = 0; c < NSYMBOLS; c++) {
+	builder->counts[c] = sum;
+	sum += c == 0 ? nbwt[c] - 1 : nbwt[c];
+    }
+    for (c = 0; c < NSYMBOLS; c++) {
+	SaryInt start = 0;
+	gint d;
+
+	for (d = 0; d < NSYMBOLS; d++) {
+	    if (reverse_bits(d) < reverse_bits(c)) {
+		start += nbwt[d];
+	    }
+	}
+	builder->starts[c] = start;
+    }
+}
+
+/*
+ * Write the levels of the wavelet matrix, sorting the
+ * transform stably by each bit.
+ */
+static void
+write_levels (Builder *builder, FILE *fp)
+{
+    SaryInt i, len = builder->len + 1;
+    SaryInt nbytes = count_blocks(len) * BLOCK_SIZE;
+    guchar *cur = builder->bwt, *next = g_new(guchar, len);
+    guchar buf[8];
+    gint level;
+
+    builder->bits = g_new(guchar, nbytes);
+    for (level = 0; level < NLEVELS; level++) {
+	gint shift = NLEVELS - 1 - level;
+	SaryInt nzeros = 0, j;
+
+	memset(builder->bits, 0, nbytes);
+	for (i = 0; i < len; i++) {
+	    if ((cur[i] >> shift) & 1) {
+		set_bit(builder->bits, i);
+	    } else {
+		nzeros++;
+	    }
+	}
+	for (i = 0, j = 0; i < len; i++) {
+	    if (((cur[i] >> shift) & 1) == 0) {
+		next[j++] = cur[i];
+	    }
+	}
+	for (i = 0; i < len; i++) {
+	    if ((cur[i] >> shift) & 1) {
+		next[j++] = cur[i];
+	    }
+	}
+
+	sary_put_uint64(buf, nzeros);
+	fwrite(buf, 1, 8, fp);
+	write_bits(builder->bits, len, fp);
+
+	builder->bwt = next;
+	next = cur;
+	cur  = builder->bwt;
+    }
+    g_free(cur);
+    g_free(next);
+}
+
+/*
+ * Write the bit vector of the rows of every `interval'-th
+ * offset and the offsets.
+ */
+static void
+write_samples (Builder *builder, FILE *fp, gint width)
+{
+    SaryInt i, len = builder->len;
+    guchar buf[8];
+
+    memset(builder->bits, 0, count_blocks(len + 1) * BLOCK_SIZE);
+    for (i = 0; i < len; i++) {
+	SaryInt pos = sary_header_get_offset(&builder->header,
+					     builder->payload, i);
+
+	if (pos % builder->interval == 0) {
+	    set_bit(builder->bits, i + 1);
+	}
+    }
+    write_bits(builder->bits, len + 1, fp);
+    g_free(builder->bits);
+
+    for (i = 0; i < len; i++) {
+	SaryInt pos = sary_header_get_offset(&builder->header,
+					     builder->payload, i);
+
+	if (pos % builder->interval == 0) {
+	    if (width == 32) {
+		sary_put_uint32(buf, pos);
+		fwrite(buf, 1, 4, fp);
+	    } else {
+		sary_put_uint64(buf, pos);
+		fwrite(buf, 1, 8, fp);
+	    }
+	}
+    }
+}
+
+static void
+set_bit (guchar *bits, SaryInt i)
+{
+    bits[i / BLOCK_BITS * BLOCK_SIZE + 8 + i % BLOCK_BITS / 8] |=
+	1 << (i % 8);
+}
+
+/*
+ * Fill in the numbers of 1 bits before the blocks and
+ * write them out.
+ */
+static void
+write_bits (guchar *bits, SaryInt len, FILE *fp)
+{
+    SaryInt i, nblocks = count_blocks(len), sum = 0;
+    gint j;
+
+    for (i = 0; i < nblocks; i++) {
+	guchar *block = bits + i * BLOCK_SIZE;
+
+	sary_put_uint64(block, sum);
+	for (j = 8; j < BLOCK_SIZE; j++) {
+	    sum += popcount(block[j]);
+	}
+    }
+    fwrite(bits, 1, nblocks * BLOCK_SIZE, fp);
+}
+
+static gint
+reverse_bits (gint c)
+{
+    gint i, r = 0;
+
+    for (i = 0; i < NLEVELS; i++) {
+	r = r << 1 | ((c >> i) & 1);
+    }
+    return r;
+}
+
+static SaryInt
+count_blocks (SaryInt len)
+{
+    return len / BLOCK_BITS + 1;
+}
+
+static inline gint
+get_bit (const guchar *bits, SaryInt i)
+{
+    return bits[i / BLOCK_BITS * BLOCK_SIZE + 8 + i % BLOCK_BITS / 8] >>
+	(i % 8) & 1;
+}
+
+/*
+ * Return the number of 1 bits before the i-th.
+ */
+static inline SaryInt
+rank (const guchar *bits, SaryInt i)
+{
+    const guchar *block = bits + i / BLOCK_BITS * BLOCK_SIZE;
+    const guchar *p = block + 8;
+    SaryInt count = sary_get_uint64(block);
+    gint rest = i % BLOCK_BITS;
+
+    for (; rest >= 32; rest -= 32, p += 4) {
+	count += popcount(sary_get_uint32_le(p));
+    }
+    for (; rest >= 8; rest -= 8, p++) {
+	count += popcount(p[0]);
+    }
+    if (rest > 0) {
+	count += popcount(p[0] & ((1 << rest) - 1));
+    }
+    return count;
+}
+
+/*
+ * Return the number of c in the transform before `row'.
+ * The first suffix has 0 there for the end of the text,
+ * which is not counted.
+ */
+static inline SaryInt
+rank_symbol (SaryFmindex *fmindex, gint c, SaryInt row)
+{
+    SaryInt i = row;
+    gint level;
+
+    for (level = 0; level < NLEVELS; level++) {
+	const guchar *bits = fmindex->levels[level];
+
+	if ((c >> (NLEVELS - 1 - level)) & 1) {
+	    i = fmindex->zeros[level] + rank(bits, i);
+	} else {
+	    i = i - rank(bits, i);
+	}
+    }
+    i -= fmindex->starts[c];
+    if (c == 0 && row > fmindex->dollar) {
+	i--;
+    }
+    return i;
+}
+
+/*
+ * Return the row of the suffix one byte before that of
+ * `row', which is not the first suffix.
+ */
+static inline SaryInt
+lf (SaryFmindex *fmindex, SaryInt row)
+{
+    SaryInt i = row;
+    gint level, c = 0;
+
+    for (level = 0; level < NLEVELS; level++) {
+	const guchar *bits = fmindex->levels[level];
+	gint bit = get_bit(bits, i);
+
+	c = c << 1 | bit;
+	if (bit) {
+	    i = fmindex->zeros[level] + rank(bits, i);
+	} else {
+	    i = i - rank(bits, i);
+	}
+    }
+    i -= fmindex->starts[c];
+    if (c == 0 && row > fmindex->dollar) {
+	i--;
+    }
+    return fmindex->counts[c] + i;
+}
+
+static inline gint
+popcount (guint32 word)
+{
+    word = word - ((word >> 1) & 0x55555555);
+    word = (word & 0x33333333) + ((word >> 2) & 0x33333333);
+    word = (word + (word >> 4)) & 0x0f0f0f0f;
+    return (word * 0x01010101) >> 24;
+}
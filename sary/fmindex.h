@@ -0,0 +1,34 @@
+#ifndef __SARY_FMINDEX_H__
+#define __SARY_FMINDEX_H__
+
+#include <glib.h>
+#include <sary/saryconfig.h>
+#include <sary/text.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct _SaryFmindex SaryFmindex;
+
+gboolean	sary_fmindex_make	(SaryText *text,
+					 const gchar *array_name,
+					 const gchar *fmindex_name,
+					 SaryInt interval);
+gchar*		sary_fmindex_file_name	(const gchar *array_name);
+SaryFmindex*	sary_fmindex_new	(const gchar *fmindex_name);
+void		sary_fmindex_destroy	(SaryFmindex *fmindex);
+SaryInt		sary_fmindex_search	(SaryFmindex *fmindex,
+					 const gchar *pattern,
+					 SaryInt len,
+					 SaryInt *first);
+SaryInt		sary_fmindex_locate	(SaryFmindex *fmindex, SaryInt idx);
+SaryInt		sary_fmindex_get_len	(SaryFmindex *fmindex);
+SaryInt		sary_fmindex_get_interval
+					(SaryFmindex *fmindex);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __SARY_FMINDEX_H__ */
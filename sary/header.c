@@ -0,0 +1,544 @@
+/* 
+ * sary - a suffix array library
+ *
+ * $Id$
+ *
+ * Copyright (C) 2000  Satoru Takabayashi <satoru@namazu.org>
+ * All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <glib.h>
+#include <sary.h>
+#include <sary/bytes.h>
+
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+/*
+ * Header of an array file (all numbers in big endian):
+ *
+ *   0  8  magic "\211SARY\r\n\032"
+ *   8  4  version
+ *  12  4  length of the header
+ *  16  4  bits per offset
+ *  20  4  depth of sorting, 0 if suffixes are sorted fully
+ *
+ * and from version 2 on:
+ *
+ *  24  4  byte order of offsets, 4321 or 1234 as G_BYTE_ORDER
+ *  28  4  kind of index points, SaryIpointKind
+ *  32  8  size of the text
+ *  40  4  checksum of the text
+ *  44  4  reserved, 0
+ *
+ * The first byte of the magic has the highest bit set so
+ * that the header never looks like a plain array whose
+ * offsets are non-negative.
+ *
+ * Offsets of 32 and 64 bits may be in little endian, which
+ * most machines read as they are. The checksum is Adler-32
+ * of the text, or of CHECKSUM_NBLOCKS blocks spread evenly
+ * over a larger text, so that checking it costs a few pages
+ * at every open however large the text is.
+ *
+ * Offsets of 32, 40 and 64 bits take whole bytes. Those of
+ * the other widths, as few bits as the length of the text
+ * needs, are packed from the highest bit of the first byte
+ * on, and the last byte is padded with 0.
+ */
+
+enum {
+    CHECKSUM_NBLOCKS = 16,
+    CHECKSUM_BLOCK   = 4096,
+    UNPACK_N	     = 16,  /* packed offsets unpacked at once */
+    UNPACK_SLACK     = 24   /* offsets left for unpack16() to read */
+};
+
+static const gchar magic[8] = "\211SARY\r\n\032";
+
+static guint64	get_bits	(const guchar *p,
+				 gint shift,
+				 gint nbytes);
+static void	put_bits	(guchar *p,
+				 gint nbytes,
+				 guint64 val);
+static guint32	checksum_text	(SaryText *text);
+static guint32	adler32		(guint32 adler,
+				 const guchar *p,
+				 gsize len);
+#ifdef __SSE2__
+static inline void unpack16	(const guchar *payload,
+				 guint64 bit,
+				 gint width,
+				 SaryInt *offsets);
+#endif /* __SSE2__ */
+
+void
+sary_header_init (SaryHeader *header, gint width)
+{
+    sary_header_init2(header, width, 0);
+}
+
+/*
+ * Initialize the header of an array whose suffixes are
+ * sorted by their first `depth' bytes and then by their
+ * positions. 0 means they are sorted fully.
+ */
+void
+sary_header_init2 (SaryHeader *header, gint width, SaryInt depth)
+{
+    g_assert(sary_header_is_valid_width(width));
+    g_assert(depth >= 0 && depth <= G_MAXINT);
+
+    header->width = width;
+    header->depth = depth;
+    header->byte_order	  = G_BIG_ENDIAN;
+    header->ipoint	  = SARY_IPOINT_UNKNOWN;
+    header->text_size	  = 0;
+    header->text_checksum = 0;
+    if (width == 32 && depth == 0) {
+	header->version = 0;
+	header->len     = 0;
+    } else {
+	header->version = SARY_HEADER_VERSION;
+	header->len     = SARY_HEADER_SIZE;
+    }
+}
+
+/*
+ * Make the header one of version 2, which records the size
+ * and the checksum of `text' and the kind of index points.
+ */
+void
+sary_header_set_text (SaryHeader *header, 
+		      SaryText *text, 
+		      SaryIpointKind ipoint)
+{
+    header->version	  = SARY_HEADER_VERSION2;
+    header->len		  = SARY_HEADER_SIZE2;
+    header->ipoint	  = ipoint;
+    header->text_size	  = sary_text_get_size(text);
+    header->text_checksum = checksum_text(text);
+}
+
+/*
+ * Set the byte order of offsets of 32 or 64 bits, which the
+ * header of version 2 records. Those of the other widths
+ * are always in big endian.
+ */
+void
+sary_header_set_byte_order (SaryHeader *header, gint byte_order)
+{
+    g_assert(header->version == SARY_HEADER_VERSION2);
+    g_assert(byte_order == G_BIG_ENDIAN || 
+	     ((header->width == 32 || header->width == 64) &&
+	      byte_order == G_LITTLE_ENDIAN));
+
+    header->byte_order = byte_order;
+}
+
+/*
+ * Return FALSE if the header records another text than
+ * `text'. Older headers, which record none, pass.
+ */
+gboolean
+sary_header_check_text (const SaryHeader *header, SaryText *text)
+{
+    if (header->version < SARY_HEADER_VERSION2) {
+	return TRUE;
+    }
+    return header->text_size == (guint64)sary_text_get_size(text) &&
+	header->text_checksum == checksum_text(text);
+}
+
+/*
+ * Read the header of an array file mapped at `map'. Return
+ * FALSE if the header is broken or unsupported.
+ */
+gboolean
+sary_header_read (SaryHeader *header, gconstpointer map, gsize len)
+{
+    const guchar *p = map;
+    gint version, width, byte_order;
+    guint32 depth;
+
+    if (len < sizeof(magic) || memcmp(p, magic, sizeof(magic)) != 0) {
+	sary_header_init(header, 32);  /* plain array */
+	return len % 4 == 0;
+    }
+
+    if (len < SARY_HEADER_SIZE) {
+	return FALSE;
+    }
+    version = sary_get_uint32(p + 8);
+    if (!(version == SARY_HEADER_VERSION && 
+	  sary_get_uint32(p + 12) == SARY_HEADER_SIZE) &&
+	!(version == SARY_HEADER_VERSION2 && len >= SARY_HEADER_SIZE2 &&
+	  sary_get_uint32(p + 12) == SARY_HEADER_SIZE2))
+    {
+	return FALSE;
+    }
+
+    width = sary_get_uint32(p + 16);
+    depth = sary_get_uint32(p + 20);
+    if (sary_header_is_valid_width(width) == FALSE || depth > G_MAXINT ||
+	(version == SARY_HEADER_VERSION && 
+	 width == 32 && depth == 0))  /* must be a plain array */
+    {
+	return FALSE;
+    }
+    sary_header_init2(header, width, depth);
+
+    if (version == SARY_HEADER_VERSION2) {
+	byte_order = sary_get_uint32(p + 24);
+	if (byte_order != G_BIG_ENDIAN && byte_order != G_LITTLE_ENDIAN) {
+	    return FALSE;
+	}
+	header->version	      = SARY_HEADER_VERSION2;
+	header->len	      = SARY_HEADER_SIZE2;
+	header->ipoint	      = sary_get_uint32(p + 28);
+	header->text_size     = sary_get_uint64(p + 32);
+	header->text_checksum = sary_get_uint32(p + 40);
+	if (byte_order == G_LITTLE_ENDIAN && width != 32 && width != 64) {
+	    return FALSE;
+	}
+	header->byte_order = byte_order;
+    }
+
+    /* 
+     * The padding of packed offsets is shorter than an
+     * offset, so the number of them is certain.
+     */
+    return ((guint64)sary_header_count_offsets(header, len) * width + 7) / 8
+	== len - header->len;
+}
+
+/*
+ * Return the number of offsets in an array file of `len'
+ * bytes.
+ */
+SaryInt
+sary_header_count_offsets (const SaryHeader *header, gsize len)
+{
+    return (guint64)(len - header->len) * 8 / header->width;
+}
+
+/*
+ * Return TRUE if offsets can be `width' bits wide, from 8
+ * bits up to 56 bits or 64 bits. Any of them can be packed
+ * within 8 bytes wherever it starts in a byte.
+ */
+gboolean
+sary_header_is_valid_width (gint width)
+{
+    return (width >= 8 && width <= 56) || width == 64;
+}
+
+/*
+ * Return the name of a sidecar file of `array_name' with
+ * `ext' such as ".lcp". It replaces the ".ary" suffix,
+ * "foo.lcp" for "foo.ary", and is appended to other names,
+ * "foo.lcp" for "foo". The LCP, prefix, child, sample and
+ * FM-index files are all named so. The result must be
+ * freed.
+ */
+gchar *
+sary_sidecar_file_name (const gchar *array_name, const gchar *ext)
+{
+    gsize len = strlen(array_name);
+    gchar *name = g_strconcat(array_name, ext, NULL);
+
+    if (len > 4 && strcmp(array_name + len - 4, ".ary") == 0) {
+	strcpy(name + len - 4, ext);
+    }
+    return name;
+}
+
+/*
+ * Write the header to `buf' which must have header->len
+ * bytes.  Nothing is written for a plain array.
+ */
+void
+sary_header_write (const SaryHeader *header, gpointer buf)
+{
+    guchar *p = buf;
+
+    if (header->version == 0) {
+	return;
+    }
+
+    memcpy(p, magic, sizeof(magic));
+    sary_put_uint32(p + 8,  header->version);
+    sary_put_uint32(p + 12, header->len);
+    sary_put_uint32(p + 16, header->width);
+    sary_put_uint32(p + 20, header->depth);
+
+    if (header->version == SARY_HEADER_VERSION2) {
+	sary_put_uint32(p + 24, header->byte_order);
+	sary_put_uint32(p + 28, header->ipoint);
+	sary_put_uint64(p + 32, header->text_size);
+	sary_put_uint32(p + 40, header->text_checksum);
+	sary_put_uint32(p + 44, 0);
+    }
+}
+
+/*
+ * Return the `idx'-th offset of `payload' which follows the
+ * header.
+ */
+SaryInt
+sary_header_get_offset (const SaryHeader *header, 
+			gconstpointer payload, 
+			SaryInt idx)
+{
+    const guchar *p;
+    guint64 val, bit;
+    gint width = header->width, shift, nbytes;
+
+    switch (width) {
+    case 32:
+	p = (const guchar *)payload + idx * 4;
+	if (header->byte_order == G_LITTLE_ENDIAN) {
+	    return (gint32)sary_get_uint32_le(p);
+	}
+	return (gint32)sary_get_uint32(p);
+    case 40:
+	p = (const guchar *)payload + idx * 5;
+	val = (guint64)p[0] << 32 | sary_get_uint32(p + 1);
+	return val;
+    case 64:
+	p = (const guchar *)payload + idx * 8;
+	if (header->byte_order == G_LITTLE_ENDIAN) {
+	    val = (guint64)sary_get_uint32_le(p + 4) << 32 | sary_get_uint32_le(p);
+	    return val;
+	}
+	val = (guint64)sary_get_uint32(p) << 32 | sary_get_uint32(p + 4);
+	return val;
+    }
+
+    bit	   = (guint64)idx * width;
+    shift  = bit % 8;
+    nbytes = (shift + width + 7) / 8;
+    val	   = get_bits((const guchar *)payload + bit / 8, shift, nbytes);
+    return val >> (nbytes * 8 - shift - width);
+}
+
+/*
+ * Decode `n' offsets from the `idx'-th one to `offsets'.
+ * Packed offsets are taken from a window of bits filled a
+ * byte at a time, which costs little more than copying
+ * them compared with locating each one. With SSE2, most of
+ * them are unpacked 16 at a time by unpack16() first.
+ */
+void
+sary_header_get_offsets (const SaryHeader *header, 
+			 gconstpointer payload, 
+			 SaryInt idx,
+			 SaryInt n,
+			 SaryInt *offsets)
+{
+    const guchar *p;
+    guint64 bit, window, mask;
+    gint width = header->width, nbits;
+    SaryInt i = 0;
+
+    if (width % 8 == 0) {
+	for (i = 0; i < n; i++) {
+	    offsets[i] = sary_header_get_offset(header, payload, idx + i);
+	}
+	return;
+    }
+
+#ifdef __SSE2__
+    /*
+     * unpack16() reads up to 2 * width + 8 bytes, which the
+     * 8 offsets after the 16 cover.
+     */
+    for (; i + UNPACK_SLACK <= n; i += UNPACK_N) {
+	unpack16(payload, (guint64)(idx + i) * width, width, offsets + i);
+    }
+#endif /* __SSE2__ */
+
+    bit    = (guint64)(idx + i) * width;
+    p	   = (const guchar *)payload + bit / 8;
+    nbits  = 0;
+    window = 0;
+    mask   = ((guint64)1 << width) - 1;
+    if (bit % 8 != 0 && i < n) {
+	nbits  = 8 - bit % 8;
+	window = *p++;
+    }
+    for (; i < n; i++) {
+	while (nbits < width) {  /* at most 63 bits in the window */
+	    window = window << 8 | *p++;
+	    nbits += 8;
+	}
+	nbits -= width;
+	offsets[i] = window >> nbits & mask;
+    }
+}
+
+void
+sary_header_set_offset (const SaryHeader *header, 
+			gpointer payload, 
+			SaryInt idx,
+			SaryInt offset)
+{
+    guchar *p;
+    guint64 val = offset, bit, mask;
+    gint width = header->width, shift, nbytes;
+
+    switch (width) {
+    case 32:
+	p = (guchar *)payload + idx * 4;
+	if (header->byte_order == G_LITTLE_ENDIAN) {
+	    sary_put_uint32_le(p, val);
+	    break;
+	}
+	sary_put_uint32(p, val);
+	break;
+    case 40:
+	p = (guchar *)payload + idx * 5;
+	p[0] = val >> 32;
+	sary_put_uint32(p + 1, val);
+	break;
+    case 64:
+	p = (guchar *)payload + idx * 8;
+	if (header->byte_order == G_LITTLE_ENDIAN) {
+	    sary_put_uint32_le(p, val);
+	    sary_put_uint32_le(p + 4, val >> 32);
+	    break;
+	}
+	sary_put_uint32(p, val >> 32);
+	sary_put_uint32(p + 4, val);
+	break;
+    default:
+	/*
+	 * Replace the bits of the offset, keeping those of
+	 * the neighbors sharing the first and last bytes.
+	 */
+	bit    = (guint64)idx * width;
+	shift  = bit % 8;
+	nbytes = (shift + width + 7) / 8;
+	p      = (guchar *)payload + bit / 8;
+	mask   = (((guint64)1 << width) - 1) << (nbytes * 8 - shift - width);
+	val  <<= nbytes * 8 - shift - width;
+	put_bits(p, nbytes, (get_bits(p, 0, nbytes) & ~mask) | val);
+    }
+}
+
+#ifdef __SSE2__
+
+/*
+ * Unpack 16 offsets from `bit' of `payload'. 8 offsets take
+ * `width' bytes, so the i-th and the (i+8)-th ones start at
+ * the same bit of a byte and share a 64 bit vector shifted
+ * by the same count.
+ */
+static inline void
+unpack16 (const guchar *payload, guint64 bit, gint width, SaryInt *offsets)
+{
+    const __m128i right = _mm_cvtsi32_si128(64 - width);
+    guint64 lanes[2];
+    gint i;
+
+    for (i = 0; i < 8; i++, bit += width) {
+	const guchar *p = payload + bit / 8;
+	__m128i v = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)p),
+				       _mm_loadl_epi64((const __m128i *)
+						       (p + width)));
+
+	/* big endian to native, a byte pair and then 4 pairs */
+	v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+	v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+	v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+
+	v = _mm_sll_epi64(v, _mm_cvtsi32_si128(bit % 8));
+	v = _mm_srl_epi64(v, right);
+	_mm_storeu_si128((__m128i *)lanes, v);
+	offsets[i]     = lanes[0];
+	offsets[i + 8] = lanes[1];
+    }
+}
+
+#endif /* __SSE2__ */
+
+/*
+ * Return `nbytes' bytes at `p' as a big endian number
+ * without the first `shift' bits.
+ */
+static guint64
+get_bits (const guchar *p, gint shift, gint nbytes)
+{
+    guint64 val = 0;
+    gint i;
+
+    for (i = 0; i < nbytes; i++) {
+	val = val << 8 | p[i];
+    }
+    if (shift > 0) {
+	val &= ~(guint64)0 >> (64 - nbytes * 8 + shift);
+    }
+    return val;
+}
+
+static void
+put_bits (guchar *p, gint nbytes, guint64 val)
+{
+    gint i;
+
+    for (i = nbytes - 1; i >= 0; i--) {
+	p[i] = val;
+	val >>= 8;
+    }
+}
+
+static guint32
+checksum_text (SaryText *text)
+{
+    const guchar *bof = (const guchar *)sary_text_get_bof(text);
+    guint64 len = sary_text_get_size(text);
+    guint32 adler = 1;
+    gint i;
+
+    if (len <= CHECKSUM_NBLOCKS * CHECKSUM_BLOCK) {
+	return adler32(adler, bof, len);
+    }
+    for (i = 0; i < CHECKSUM_NBLOCKS; i++) {
+	guint64 start = (len - CHECKSUM_BLOCK) / (CHECKSUM_NBLOCKS - 1) * i;
+
+	adler = adler32(adler, bof + start, CHECKSUM_BLOCK);
+    }
+    return adler;
+}
+
+static guint32
+adler32 (guint32 adler, const guchar *p, gsize len)
+{
+    guint32 a = adler & 0xffff, b = adler >> 16;
+    gsize i;
+
+    for (i = 0; i < len; i++) {
+	a = (a + p[i]) % 65521;
+	b = (b + a) % 65521;
+    }
+    return b << 16 | a;
+}
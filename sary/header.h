@@ -0,0 +1,88 @@
+#ifndef __SARY_HEADER_H__
+#define __SARY_HEADER_H__
+
+#include <glib.h>
+#include <sary/saryconfig.h>
+#include <sary/text.h>
+#include <sary/ipoint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Layout of an array file. A plain array, which has no
+ * header, consists of 32 bit big endian offsets as sary has
+ * always written. Other widths and arrays sorted to a
+ * bounded depth are recorded in a header followed by the
+ * offsets. Offsets of a width other than 32, 40 or 64 are
+ * packed into a big endian bit stream.
+ *
+ * A header of version 2 also identifies the text, which is
+ * checked when the array is opened, and may have offsets of
+ * 32 or 64 bits in little endian to be read without
+ * swapping bytes.
+ */
+typedef struct {
+    gint	version;	/* 0 for a plain array */
+    gint	width;		/* bits per offset: 8 to 56 or 64 */
+    SaryInt	depth;		/* bytes of suffixes sorted, 0 for all */
+    gsize	len;		/* length of the header in bytes */
+    gint	byte_order;	/* G_BIG_ENDIAN or G_LITTLE_ENDIAN */
+    SaryIpointKind ipoint;	/* version 2 only from here */
+    guint64	text_size;
+    guint32	text_checksum;
+} SaryHeader;
+
+enum {
+    SARY_HEADER_VERSION  = 1,
+    SARY_HEADER_SIZE     = 24,
+    SARY_HEADER_VERSION2 = 2,
+    SARY_HEADER_SIZE2    = 48
+};
+
+void		sary_header_init	(SaryHeader *header,
+					 gint width);
+void		sary_header_init2	(SaryHeader *header,
+					 gint width,
+					 SaryInt depth);
+void		sary_header_set_text	(SaryHeader *header,
+					 SaryText *text,
+					 SaryIpointKind ipoint);
+void		sary_header_set_byte_order
+					(SaryHeader *header,
+					 gint byte_order);
+gboolean	sary_header_check_text	(const SaryHeader *header,
+					 SaryText *text);
+gboolean	sary_header_read	(SaryHeader *header,
+					 gconstpointer map,
+					 gsize len);
+void		sary_header_write	(const SaryHeader *header,
+					 gpointer buf);
+SaryInt		sary_header_get_offset	(const SaryHeader *header,
+					 gconstpointer payload,
+					 SaryInt idx);
+void		sary_header_set_offset	(const SaryHeader *header,
+					 gpointer payload,
+					 SaryInt idx,
+					 SaryInt offset);
+void		sary_header_get_offsets	(const SaryHeader *header,
+					 gconstpointer payload,
+					 SaryInt idx,
+					 SaryInt n,
+					 SaryInt *offsets);
+SaryInt		sary_header_count_offsets
+					(const SaryHeader *header,
+					 gsize len);
+gboolean	sary_header_is_valid_width
+					(gint width);
+gchar*		sary_sidecar_file_name	(const gchar *array_name,
+					 const gchar *ext);
+
+#define		sary_header_get_elt_size(header)	((header)->width / 8)
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __SARY_HEADER_H__ */
@@ -15,7 +15,7 @@ extern "C" {
  * file of a text.
  */
 #define sary_i_text(text, index_ptr)  sary_text_get_bof((text)) + \
-                                      GINT_FROM_BE(*(SaryInt *)(index_ptr))
+                                      SARY_INT_FROM_BE(*(SaryInt *)(index_ptr))
 
 #ifdef __cplusplus
 }
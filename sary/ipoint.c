@@ -25,9 +25,25 @@
 #include "config.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <glib.h>
 #include <sary.h>
 
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+enum {
+    WINDOW = 16  /* bytes examined at once by the bulk functions */
+};
+
+static inline guint	cont_mask	(const gchar *p);
+static inline guint	space_mask	(const gchar *p);
+static inline gint	utf8_len	(guchar c);
+static inline gboolean	is_space	(gchar c);
+static gchar*		next_word	(const gchar *cursor, 
+					 const gchar *eof);
+
 /*
  *  Functions for managing index points.
  */
@@ -250,3 +266,272 @@ sary_ipoint_word (SaryText *text)
     return cursor;
 }
 
+
+/*
+ * Return the kind of `ipoint_func' to be recorded in the
+ * header of an array file.
+ */
+SaryIpointKind
+sary_ipoint_get_kind (SaryIpointFunc ipoint_func)
+{
+    static const struct {
+	SaryIpointFunc	ipoint_func;
+	SaryIpointKind	kind;
+    } kinds[] = {
+	{ sary_ipoint_bytestream,	SARY_IPOINT_BYTESTREAM },
+	{ sary_ipoint_char_ascii,	SARY_IPOINT_CHAR_ASCII },
+	{ sary_ipoint_char_iso8859,	SARY_IPOINT_CHAR_ISO8859 },
+	{ sary_ipoint_char_eucjp,	SARY_IPOINT_CHAR_EUCJP },
+	{ sary_ipoint_char_sjis,	SARY_IPOINT_CHAR_SJIS },
+	{ sary_ipoint_char_utf8,	SARY_IPOINT_CHAR_UTF8 },
+	{ sary_ipoint_locale,		SARY_IPOINT_LOCALE },
+	{ sary_ipoint_line,		SARY_IPOINT_LINE },
+	{ sary_ipoint_word,		SARY_IPOINT_WORD },
+	{ NULL,				SARY_IPOINT_UNKNOWN }
+    };
+    gint i;
+
+    for (i = 0; kinds[i].ipoint_func != NULL; i++) {
+	if (kinds[i].ipoint_func == ipoint_func) {
+	    return kinds[i].kind;
+	}
+    }
+    return SARY_IPOINT_UNKNOWN;
+}
+
+/*
+ * Bulk functions store up to `len' index points at the
+ * cursor and after into `ipoints' as offsets from the
+ * beginning of the text and return the number of them. 0
+ * means the end of the text. The cursor is moved to the
+ * next index point. They give the same index points as the
+ * corresponding functions above without calling a function
+ * for each of them.
+ */
+
+SaryInt
+sary_ipoint_bulk_bytestream (SaryText *text, SaryInt *ipoints, SaryInt len)
+{
+    gchar *bof    = sary_text_get_bof(text);
+    gchar *cursor = sary_text_get_cursor(text);
+    SaryInt i, n  = MIN(len, sary_text_get_eof(text) - cursor);
+    SaryInt pos   = cursor - bof;
+
+    for (i = 0; i < n; i++) {
+	ipoints[i] = pos + i;
+    }
+    sary_text_forward_cursor(text, n);
+    return n;
+}
+
+/*
+ * Characters are found by their leading bytes, WINDOW bytes
+ * at a time. A character whose length does not agree with
+ * its leading byte is passed to sary_ipoint_char_utf8() as
+ * well as the last ones of the text.
+ */
+SaryInt
+sary_ipoint_bulk_char_utf8 (SaryText *text, SaryInt *ipoints, SaryInt len)
+{
+    gchar *bof    = sary_text_get_bof(text);
+    gchar *eof    = sary_text_get_eof(text);
+    gchar *cursor = sary_text_get_cursor(text);
+    SaryInt n = 0;
+
+    while (cursor < eof && n < len) {
+	if (eof - cursor >= WINDOW && len - n >= WINDOW) {
+	    guint starts = ~cont_mask(cursor) & ((1 << WINDOW) - 1);
+	    gint i = 0;
+
+	    /*
+	     * Take each character ending before the next
+	     * leading byte in the window.
+	     */
+	    while (starts & (1 << i)) {
+		gint next = i + utf8_len(cursor[i]);
+
+		if (next >= WINDOW || !(starts & (1 << next)) ||
+		    (starts & (((1 << next) - 1) & ~((2 << i) - 1))))
+		{
+		    break;
+		}
+		ipoints[n++] = cursor - bof + i;
+		i = next;
+	    }
+	    if (i > 0) {
+		cursor += i;
+		continue;
+	    }
+	}
+
+	sary_text_set_cursor(text, cursor);
+	ipoints[n++] = sary_ipoint_char_utf8(text) - bof;
+	cursor = sary_text_get_cursor(text);
+    }
+
+    sary_text_set_cursor(text, cursor);
+    return n;
+}
+
+/*
+ * memchr(3) scans the text for newlines many bytes at a
+ * time on most systems.
+ */
+SaryInt
+sary_ipoint_bulk_line (SaryText *text, SaryInt *ipoints, SaryInt len)
+{
+    gchar *bof    = sary_text_get_bof(text);
+    gchar *eof    = sary_text_get_eof(text);
+    gchar *cursor = sary_text_get_cursor(text);
+    SaryInt n = 0;
+
+    while (cursor < eof && n < len) {
+	gchar *newline = memchr(cursor, '\n', eof - cursor);
+
+	ipoints[n++] = cursor - bof;
+	cursor = newline == NULL ? eof : newline + 1;
+    }
+
+    sary_text_set_cursor(text, cursor);
+    return n;
+}
+
+SaryInt
+sary_ipoint_bulk_word (SaryText *text, SaryInt *ipoints, SaryInt len)
+{
+    gchar *bof    = sary_text_get_bof(text);
+    gchar *eof    = sary_text_get_eof(text);
+    gchar *cursor = sary_text_get_cursor(text);
+    SaryInt n = 0;
+
+    if (cursor == bof && cursor < eof && len > 0) { /* the first time */
+	cursor = sary_str_skip_forward(cursor, eof, 
+				       sary_str_get_whitespaces());
+	ipoints[n++] = cursor - bof;
+	cursor = next_word(cursor, eof);
+    }
+    while (cursor < eof && n < len) {
+	ipoints[n++] = cursor - bof;
+	cursor = next_word(cursor, eof);
+    }
+
+    sary_text_set_cursor(text, cursor);
+    return n;
+}
+
+/*
+ * Return the first word after `cursor', that is a non-space
+ * preceded by a space.
+ */
+static gchar *
+next_word (const gchar *cursor, const gchar *eof)
+{
+    const gchar *p = cursor + 1;
+
+    if (cursor >= eof) {
+	return (gchar *)eof;
+    }
+    while (eof - p >= WINDOW) {
+	guint spaces = space_mask(p);
+	guint starts = ~spaces & ((spaces << 1) | is_space(p[-1])) & 
+	    ((1 << WINDOW) - 1);
+
+	if (starts != 0) {
+	    while (!(starts & 1)) {
+		starts >>= 1;
+		p++;
+	    }
+	    return (gchar *)p;
+	}
+	p += WINDOW;
+    }
+    for (; p < eof; p++) {
+	if (is_space(p[-1]) && !is_space(*p)) {
+	    return (gchar *)p;
+	}
+    }
+    return (gchar *)eof;
+}
+
+static inline gint
+utf8_len (guchar c)
+{
+    if (c < 0x80) {
+	return 1;
+    } else if ((c & 0xe0) == 0xc0) {
+	return 2;
+    } else if ((c & 0xf0) == 0xe0) {
+	return 3;
+    } else if ((c & 0xf8) == 0xf0) {
+	return 4;
+    } else if ((c & 0xfc) == 0xf8) {
+	return 5;
+    } else if ((c & 0xfe) == 0xfc) {
+	return 6;
+    } else {
+	return WINDOW;  /* invalid */
+    }
+}
+
+/*
+ * Same as sary_str_get_whitespaces().
+ */
+static inline gboolean
+is_space (gchar c)
+{
+    return c == ' ' || c == '\f' || c == '\n' || 
+	c == '\r' || c == '\t' || c == '\v';
+}
+
+#ifdef __SSE2__
+
+/*
+ * Bit i of the masks tells about p[i].
+ */
+static inline guint
+cont_mask (const gchar *p)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+
+    /* 0x80 .. 0xbf are smaller than (gchar)0xc0 as signed */
+    return _mm_movemask_epi8(_mm_cmplt_epi8(v, _mm_set1_epi8((gchar)0xc0)));
+}
+
+static inline guint
+space_mask (const gchar *p)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    __m128i m;
+
+    /* '\t' .. '\r' are 9 .. 13 */
+    m = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('\t' - 1)),
+		      _mm_cmplt_epi8(v, _mm_set1_epi8('\r' + 1)));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+    return _mm_movemask_epi8(m);
+}
+
+#else /* not __SSE2__ */
+
+static inline guint
+cont_mask (const gchar *p)
+{
+    guint i, mask = 0;
+
+    for (i = 0; i < WINDOW; i++) {
+	mask |= (((guchar)p[i] & 0xc0) == 0x80) << i;
+    }
+    return mask;
+}
+
+static inline guint
+space_mask (const gchar *p)
+{
+    guint i, mask = 0;
+
+    for (i = 0; i < WINDOW; i++) {
+	mask |= is_space(p[i]) << i;
+    }
+    return mask;
+}
+
+#endif /* __SSE2__ */
@@ -8,7 +8,27 @@
 extern "C" {
 #endif /* __cplusplus */
 
+/*
+ * Kinds of index points recorded in the header of an array
+ * file. New ones are appended to keep the numbers.
+ */
+typedef enum {
+    SARY_IPOINT_UNKNOWN = 0,  /* a function of the application */
+    SARY_IPOINT_BYTESTREAM,
+    SARY_IPOINT_CHAR_ASCII,
+    SARY_IPOINT_CHAR_ISO8859,
+    SARY_IPOINT_CHAR_EUCJP,
+    SARY_IPOINT_CHAR_SJIS,
+    SARY_IPOINT_CHAR_UTF8,
+    SARY_IPOINT_LOCALE,
+    SARY_IPOINT_LINE,
+    SARY_IPOINT_WORD
+} SaryIpointKind;
+
 typedef gchar* 	(*SaryIpointFunc)		(SaryText *text);
+typedef SaryInt 	(*SaryIpointBulkFunc)		(SaryText *text,
+							 SaryInt *ipoints,
+							 SaryInt len);
 
 gchar*		sary_ipoint_bytestream		(SaryText *text);
 gchar*		sary_ipoint_char_ascii		(SaryText *text);
@@ -19,6 +39,20 @@ gchar*		sary_ipoint_char_utf8		(SaryText *text);
 gchar*		sary_ipoint_locale		(SaryText *text);
 gchar*		sary_ipoint_line		(SaryText *text);
 gchar*		sary_ipoint_word		(SaryText *text);
+SaryIpointKind	sary_ipoint_get_kind		(SaryIpointFunc ipoint_func);
+
+SaryInt		sary_ipoint_bulk_bytestream	(SaryText *text,
+						 SaryInt *ipoints,
+						 SaryInt len);
+SaryInt		sary_ipoint_bulk_char_utf8	(SaryText *text,
+						 SaryInt *ipoints,
+						 SaryInt len);
+SaryInt		sary_ipoint_bulk_line		(SaryText *text,
+						 SaryInt *ipoints,
+						 SaryInt len);
+SaryInt		sary_ipoint_bulk_word		(SaryText *text,
+						 SaryInt *ipoints,
+						 SaryInt len);
 
 #ifdef __cplusplus
 }
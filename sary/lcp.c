@@ -0,0 +1,738 @@
+/*
+ * sary - a suffix array library
+ *
+ * $Id$
+ *
+ * Copyright (C) 2000  Satoru Takabayashi <satoru@namazu.org>
+ * All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <glib.h>
+#include <sary.h>
+#include <sary/bytes.h>
+
+/*
+ * LCP file, a sidecar of an array file (all numbers in big
+ * endian):
+ *
+ *   0  8  magic "\211SLCP\r\n\032"
+ *   8  4  version
+ *  12  4  length of the header
+ *  16  8  number of entries, same as the index points
+ *  24  8  depth of sorting of the array, 0 if full
+ *  32  8  number of overflows of LCP
+ *  40  8  number of overflows of LLCP
+ *  48  8  number of overflows of RLCP
+ *  56     LCP, LLCP and RLCP tables in turn, each of
+ *	   an entry of a byte for each index point,
+ *	   padded with 0 to a multiple of 8 bytes, and
+ *	   overflows of 8 byte index and 8 byte value
+ *
+ * The i-th entry of LCP is the length of the longest common
+ * prefix of the (i-1)-th and i-th suffixes of the array,
+ * and 0 for the first. LLCP and RLCP serve binary search:
+ * the search over the virtual bounds -1 and the number of
+ * index points probes the i-th suffix between exactly one
+ * pair of bounds, and the i-th entries are its lcp with
+ * the suffixes at the low and the high bound. A virtual
+ * bound has 0.
+ *
+ * An entry of LCP_OVERFLOW means the value is found in the
+ * overflows sorted by index. Values are not greater than
+ * the depth of a bounded array.
+ */
+
+enum {
+    LCP_VERSION	    = 2,
+    LCP_HEADER_SIZE = 56,
+    LCP_OVERFLOW    = 255,
+    CHUNK_LEN	    = 1024 * 1024  /* index points per task */
+};
+
+enum {
+    LCP,
+    LLCP,
+    RLCP,
+    NTABLES
+};
+
+static const gchar magic[8] = "\211SLCP\r\n\032";
+
+typedef struct {
+    guchar	*bytes;
+    guchar	*overflows;
+    SaryInt	noverflows;
+} Column;
+
+struct _SaryLcp {
+    SaryMmap	*file;
+    Column	columns[NTABLES];
+    SaryInt	len;
+    SaryInt	depth;
+};
+
+typedef struct {
+    SaryInt	idx;
+    SaryInt	val;
+} Overflow;
+
+/*
+ * A table under construction. Overflows are kept for each
+ * chunk of CHUNK_LEN index points so that threads working
+ * on different chunks never share an array.
+ */
+typedef struct {
+    guchar	*bytes;
+    GArray	**overflows;
+} Table;
+
+typedef struct _Job Job;
+typedef void	(*StepFunc)	(Job *job, SaryInt first, SaryInt last);
+
+/*
+ * A step runs `step_func' over [0, len) with threads
+ * taking CHUNK_LEN at a time from `cursor'. `phi' is used
+ * by Kasai's algorithm and holds the predecessor in the
+ * array of each suffix, and then its lcp with it.
+ */
+struct _Job {
+    const gchar		*bof;
+    const gchar		*eof;
+    SaryHeader		header;
+    gconstpointer	payload;
+    SaryInt		nipoints;
+    SaryInt		nchunks;
+    SaryInt		limit;
+    SaryInt		*phi;
+    Table		tables[NTABLES];
+    StepFunc		step_func;
+    SaryInt		len;
+    SaryInt		cursor;
+    SaryProgress	*progress;
+    pthread_mutex_t	mutex;
+};
+
+static void		run		(Job *job,
+					 StepFunc step_func,
+					 SaryInt len,
+					 SaryProgress *progress,
+					 gint nthreads);
+static void		work		(Job *job);
+static void		set_phi		(Job *job,
+					 SaryInt first,
+					 SaryInt last);
+static void		kasai		(Job *job,
+					 SaryInt first,
+					 SaryInt last);
+static void		store		(Job *job,
+					 SaryInt first,
+					 SaryInt last);
+static SaryInt		fill_tree	(Job *job,
+					 SaryInt low,
+					 SaryInt high);
+static inline SaryInt	get_lcp		(const gchar *s1,
+					 const gchar *s2,
+					 const gchar *eof,
+					 SaryInt limit,
+					 SaryInt lcp);
+static void		table_set	(Table *table,
+					 SaryInt idx,
+					 SaryInt val);
+static SaryInt		table_get	(Table *table,
+					 SaryInt idx);
+static void		table_sort	(Table *table,
+					 SaryInt nchunks);
+static SaryInt		table_count	(Table *table,
+					 SaryInt nchunks);
+static gint		idxcmp		(gconstpointer o1,
+					 gconstpointer o2);
+static SaryInt		column_get	(Column *column,
+					 SaryInt idx);
+static gboolean		write_lcp	(Job *job,
+					 const gchar *lcp_name);
+
+
+/*
+ * Compute the LCP array of the sorted array file
+ * `array_name' and write it to `lcp_name'.
+ *
+ * If every byte is an index point, the lcp are computed by
+ * Kasai's algorithm in the order of positions, which takes
+ * linear time and an offset of memory per byte of the
+ * text. Each thread takes a range of positions and starts
+ * from scratch at its head. Otherwise, and for an array
+ * sorted to a bounded depth, where an lcp tells nothing
+ * about the next position, the neighbours in the array are
+ * compared directly.
+ *
+ * LLCP and RLCP are then filled in one walk over the
+ * tree of the binary search, each node taking the minimum
+ * of the lcp of its two halves.
+ *
+ * Reference:
+ * Toru Kasai, Gunho Lee, Hiroki Arimura, Setsuo Arikawa,
+ * Kunsoo Park: "Linear-Time Longest-Common-Prefix
+ * Computation in Suffix Arrays and Its Applications,"
+ * CPM 2001.
+ */
+gboolean
+sary_lcp_make (SaryText *text,
+	       const gchar *array_name,
+	       const gchar *lcp_name,
+	       gint nthreads,
+	       SaryProgressFunc progress_func,
+	       gpointer progress_func_data)
+{
+    SaryMmap *array;
+    SaryProgress *progress;
+    SaryInt i, j;
+    gboolean result;
+    Job job;
+
+    g_assert(nthreads > 0);
+
+    array = sary_mmap(array_name, "r");
+    if (array == NULL) {
+	return FALSE;
+    }
+    if (sary_header_read(&job.header, array->map, array->len) == FALSE) {
+	g_warning("%s: unsupported array format", array_name);
+	sary_munmap(array);
+	errno = EINVAL;
+	return FALSE;
+    }
+
+    job.bof	 = sary_text_get_bof(text);
+    job.eof	 = sary_text_get_eof(text);
+    job.payload  = (const gchar *)array->map + job.header.len;
+    job.nipoints = sary_header_count_offsets(&job.header, array->len);
+    job.nchunks  = (job.nipoints + CHUNK_LEN - 1) / CHUNK_LEN;
+    job.limit	 = job.header.depth > 0 ? job.header.depth :
+	sary_text_get_size(text);
+    job.phi	 = NULL;
+    for (i = 0; i < NTABLES; i++) {
+	job.tables[i].bytes	= g_new(guchar, MAX(job.nipoints, 1));
+	job.tables[i].overflows = g_new0(GArray *, MAX(job.nchunks, 1));
+    }
+    pthread_mutex_init(&job.mutex, NULL);
+
+    progress = sary_progress_new("lcp", job.nipoints);
+    sary_progress_connect(progress, progress_func, progress_func_data);
+    if (job.nipoints == sary_text_get_size(text) && job.header.depth == 0) {
+	job.phi = g_new(SaryInt, MAX(job.nipoints, 1));
+	run(&job, set_phi, job.nipoints, NULL, nthreads);
+	run(&job, kasai, job.nipoints, progress, nthreads);
+	run(&job, store, job.nipoints, NULL, nthreads);
+	g_free(job.phi);
+    } else {
+	run(&job, store, job.nipoints, progress, nthreads);
+    }
+    sary_progress_destroy(progress);
+    sary_munmap(array);
+
+    fill_tree(&job, -1, job.nipoints);
+    table_sort(&job.tables[LLCP], job.nchunks);
+    table_sort(&job.tables[RLCP], job.nchunks);
+
+    result = write_lcp(&job, lcp_name);
+
+    for (i = 0; i < NTABLES; i++) {
+	for (j = 0; j < job.nchunks; j++) {
+	    if (job.tables[i].overflows[j] != NULL) {
+		g_array_free(job.tables[i].overflows[j], TRUE);
+	    }
+	}
+	g_free(job.tables[i].overflows);
+	g_free(job.tables[i].bytes);
+    }
+    pthread_mutex_destroy(&job.mutex);
+
+    return result;
+}
+
+/* The LCP file name. See sary_sidecar_file_name(). */
+gchar *
+sary_lcp_file_name (const gchar *array_name)
+{
+    return sary_sidecar_file_name(array_name, ".lcp");
+}
+
+SaryLcp *
+sary_lcp_new (const gchar *lcp_name)
+{
+    SaryLcp *lcp;
+    SaryMmap *file;
+    guchar *p;
+    guint64 len, padded, offset;
+    gint i;
+
+    file = sary_mmap(lcp_name, "r");
+    if (file == NULL) {
+	return NULL;
+    }
+
+    p = file->map;
+    if (file->len < LCP_HEADER_SIZE ||
+	memcmp(p, magic, sizeof(magic)) != 0 ||
+	sary_get_uint32(p + 8)  != LCP_VERSION ||
+	sary_get_uint32(p + 12) != LCP_HEADER_SIZE)
+    {
+	goto broken;
+    }
+    len	   = sary_get_uint64(p + 16);
+    padded = (len + 7) / 8 * 8;
+    if (len > (guint64)file->len) {
+	goto broken;
+    }
+
+    lcp = g_new(SaryLcp, 1);
+    lcp->file  = file;
+    lcp->len   = len;
+    lcp->depth = sary_get_uint64(p + 24);
+
+    offset = LCP_HEADER_SIZE;
+    for (i = 0; i < NTABLES; i++) {
+	guint64 noverflows = sary_get_uint64(p + 32 + i * 8);
+
+	if (noverflows > (guint64)file->len ||
+	    offset + padded + noverflows * 16 > (guint64)file->len)
+	{
+	    g_free(lcp);
+	    goto broken;
+	}
+	lcp->columns[i].bytes	   = p + offset;
+	lcp->columns[i].overflows  = p + offset + padded;
+	lcp->columns[i].noverflows = noverflows;
+	offset += padded + noverflows * 16;
+    }
+    if (offset != (guint64)file->len) {
+	g_free(lcp);
+	goto broken;
+    }
+
+    return lcp;
+
+ broken:
+    g_warning("%s: unsupported lcp format", lcp_name);
+    sary_munmap(file);
+    errno = EINVAL;
+    return NULL;
+}
+
+void
+sary_lcp_destroy (SaryLcp *lcp)
+{
+    sary_munmap(lcp->file);
+    g_free(lcp);
+}
+
+/*
+ * Return the length of the longest common prefix of the
+ * (idx-1)-th and idx-th suffixes of the array.
+ */
+SaryInt
+sary_lcp_get (SaryLcp *lcp, SaryInt idx)
+{
+    g_assert(idx >= 0 && idx < lcp->len);
+    return column_get(&lcp->columns[LCP], idx);
+}
+
+/*
+ * Return the length of the longest common prefix of the
+ * idx-th suffix and the low bound of the binary search
+ * probing it. See the comment at the top of this file.
+ */
+SaryInt
+sary_lcp_get_left (SaryLcp *lcp, SaryInt idx)
+{
+    g_assert(idx >= 0 && idx < lcp->len);
+    return column_get(&lcp->columns[LLCP], idx);
+}
+
+/*
+ * Likewise with the high bound.
+ */
+SaryInt
+sary_lcp_get_right (SaryLcp *lcp, SaryInt idx)
+{
+    g_assert(idx >= 0 && idx < lcp->len);
+    return column_get(&lcp->columns[RLCP], idx);
+}
+
+SaryInt
+sary_lcp_get_len (SaryLcp *lcp)
+{
+    return lcp->len;
+}
+
+/*
+ * Return the depth of sorting of the array, which bounds
+ * the lcp, or 0.
+ */
+SaryInt
+sary_lcp_get_depth (SaryLcp *lcp)
+{
+    return lcp->depth;
+}
+
+static void
+run (Job *job,
+     StepFunc step_func,
+     SaryInt len,
+     SaryProgress *progress,
+     gint nthreads)
+{
+    pthread_t *threads;
+    gint i;
+
+    job->step_func = step_func;
+    job->len	   = len;
+    job->cursor	   = 0;
+    job->progress  = progress;
+
+    threads = g_new(pthread_t, nthreads);
+    for (i = 0; i < nthreads; i++) {
+	if (pthread_create(&threads[i], NULL, (void *)work, job) != 0) {
+	    g_error("pthread_create: %s", g_strerror(errno));
+	}
+    }
+    for (i = 0; i < nthreads; i++) {
+	pthread_join(threads[i], NULL);
+    }
+    g_free(threads);
+}
+
+static void
+work (Job *job)
+{
+    for (;;) {
+	SaryInt first, last;
+
+	pthread_mutex_lock(&job->mutex);
+	if (job->cursor == job->len) {
+	    pthread_mutex_unlock(&job->mutex);
+	    break;
+	}
+	first = job->cursor;
+	last  = MIN(first + CHUNK_LEN, job->len);
+	job->cursor = last;
+	pthread_mutex_unlock(&job->mutex);
+
+	job->step_func(job, first, last);
+
+	if (job->progress != NULL) {
+	    pthread_mutex_lock(&job->mutex);
+	    sary_progress_set_count(job->progress,
+				    job->progress->current + last - first);
+	    pthread_mutex_unlock(&job->mutex);
+	}
+    }
+}
+
+/*
+ * Every position is an index point here. -1 marks the
+ * first suffix.
+ */
+static void
+set_phi (Job *job, SaryInt first, SaryInt last)
+{
+    SaryInt i, prev;
+
+    prev = first > 0 ?
+	sary_header_get_offset(&job->header, job->payload, first - 1) : -1;
+    for (i = first; i < last; i++) {
+	SaryInt offset = sary_header_get_offset(&job->header,
+						job->payload, i);
+	job->phi[offset] = prev;
+	prev = offset;
+    }
+}
+
+/*
+ * The lcp of the suffix at i + 1 with its predecessor is
+ * at least that of the suffix at i minus 1.
+ */
+static void
+kasai (Job *job, SaryInt first, SaryInt last)
+{
+    SaryInt i, h = 0;
+
+    for (i = first; i < last; i++) {
+	SaryInt j = job->phi[i];
+
+	if (j == -1) {
+	    h = 0;
+	} else {
+	    h = get_lcp(job->bof + i, job->bof + j, job->eof, job->limit, h);
+	}
+	job->phi[i] = h;
+	if (h > 0) {
+	    h--;
+	}
+    }
+}
+
+static void
+store (Job *job, SaryInt first, SaryInt last)
+{
+    SaryInt i, prev, val;
+
+    prev = first > 0 ?
+	sary_header_get_offset(&job->header, job->payload, first - 1) : -1;
+    for (i = first; i < last; i++) {
+	SaryInt offset = sary_header_get_offset(&job->header,
+						job->payload, i);
+	if (job->phi != NULL) {
+	    val = job->phi[offset];
+	} else if (prev == -1) {
+	    val = 0;
+	} else {
+	    val = get_lcp(job->bof + prev, job->bof + offset, job->eof,
+			  job->limit, 0);
+	}
+	prev = offset;
+	table_set(&job->tables[LCP], i, val);
+    }
+}
+
+/*
+ * Fill LLCP and RLCP of the index points probed between
+ * the bounds `low' and `high' and return the lcp of the
+ * suffixes at them, which is 0 if either is virtual.
+ */
+static SaryInt
+fill_tree (Job *job, SaryInt low, SaryInt high)
+{
+    SaryInt mid, left, right;
+    gboolean is_virtual = low == -1 || high == job->nipoints;
+
+    if (low + 1 == high) {
+	return is_virtual ? 0 : table_get(&job->tables[LCP], high);
+    }
+
+    mid	  = (low + high) / 2;
+    left  = fill_tree(job, low, mid);
+    right = fill_tree(job, mid, high);
+    table_set(&job->tables[LLCP], mid, left);
+    table_set(&job->tables[RLCP], mid, right);
+
+    return is_virtual ? 0 : MIN(left, right);
+}
+
+/*
+ * Return the length of the common prefix of s1 and s2,
+ * which are known to share the first `lcp' bytes, up to
+ * `limit' bytes.
+ */
+static inline SaryInt
+get_lcp (const gchar *s1,
+	 const gchar *s2,
+	 const gchar *eof,
+	 SaryInt limit,
+	 SaryInt lcp)
+{
+    SaryInt len = MIN(eof - MAX(s1, s2), limit);
+
+    while (lcp + (SaryInt)sizeof(guint64) <= len) {
+	guint64 w1, w2;
+
+	memcpy(&w1, s1 + lcp, sizeof(guint64));
+	memcpy(&w2, s2 + lcp, sizeof(guint64));
+	if (w1 != w2) {
+	    break;
+	}
+	lcp += sizeof(guint64);
+    }
+    while (lcp < len && s1[lcp] == s2[lcp]) {
+	lcp++;
+    }
+    return lcp;
+}
+
+static void
+table_set (Table *table, SaryInt idx, SaryInt val)
+{
+    if (val < LCP_OVERFLOW) {
+	table->bytes[idx] = val;
+    } else {
+	GArray **overflows = table->overflows + idx / CHUNK_LEN;
+	Overflow overflow;
+
+	if (*overflows == NULL) {
+	    *overflows = g_array_new(FALSE, FALSE, sizeof(Overflow));
+	}
+	overflow.idx = idx;
+	overflow.val = val;
+	g_array_append_val(*overflows, overflow);
+	table->bytes[idx] = LCP_OVERFLOW;
+    }
+}
+
+/*
+ * The overflows of the chunk must be sorted.
+ */
+static SaryInt
+table_get (Table *table, SaryInt idx)
+{
+    GArray *overflows;
+    SaryInt low, high;
+
+    if (table->bytes[idx] != LCP_OVERFLOW) {
+	return table->bytes[idx];
+    }
+
+    overflows = table->overflows[idx / CHUNK_LEN];
+    low	 = 0;
+    high = overflows->len - 1;
+    while (low <= high) {
+	SaryInt mid = low + (high - low) / 2;
+	Overflow *overflow = &g_array_index(overflows, Overflow, mid);
+
+	if (overflow->idx == idx) {
+	    return overflow->val;
+	} else if (overflow->idx < idx) {
+	    low = mid + 1;
+	} else {
+	    high = mid - 1;
+	}
+    }
+    g_assert_not_reached();
+    return -1;
+}
+
+static void
+table_sort (Table *table, SaryInt nchunks)
+{
+    SaryInt i;
+
+    for (i = 0; i < nchunks; i++) {
+	if (table->overflows[i] != NULL) {
+	    GArray *overflows = table->overflows[i];
+
+	    qsort(overflows->data, overflows->len, sizeof(Overflow), idxcmp);
+	}
+    }
+}
+
+static SaryInt
+table_count (Table *table, SaryInt nchunks)
+{
+    SaryInt i, count = 0;
+
+    for (i = 0; i < nchunks; i++) {
+	if (table->overflows[i] != NULL) {
+	    count += table->overflows[i]->len;
+	}
+    }
+    return count;
+}
+
+static gint
+idxcmp (gconstpointer o1, gconstpointer o2)
+{
+    SaryInt i = ((const Overflow *)o1)->idx;
+    SaryInt j = ((const Overflow *)o2)->idx;
+
+    return i < j ? -1 : i > j;
+}
+
+static SaryInt
+column_get (Column *column, SaryInt idx)
+{
+    SaryInt low, high;
+
+    if (column->bytes[idx] != LCP_OVERFLOW) {
+	return column->bytes[idx];
+    }
+
+    low	 = 0;
+    high = column->noverflows - 1;
+    while (low <= high) {
+	SaryInt mid = low + (high - low) / 2;
+	SaryInt i   = sary_get_uint64(column->overflows + mid * 16);
+
+	if (i == idx) {
+	    return sary_get_uint64(column->overflows + mid * 16 + 8);
+	} else if (i < idx) {
+	    low = mid + 1;
+	} else {
+	    high = mid - 1;
+	}
+    }
+    g_assert_not_reached();
+    return -1;
+}
+
+static gboolean
+write_lcp (Job *job, const gchar *lcp_name)
+{
+    FILE *fp;
+    guchar buf[LCP_HEADER_SIZE];
+    SaryInt i, j, k;
+    gint saved_errno;
+
+    fp = fopen(lcp_name, "wb");
+    if (fp == NULL) {
+	return FALSE;
+    }
+
+    memcpy(buf, magic, sizeof(magic));
+    sary_put_uint32(buf + 8,  LCP_VERSION);
+    sary_put_uint32(buf + 12, LCP_HEADER_SIZE);
+    sary_put_uint64(buf + 16, job->nipoints);
+    sary_put_uint64(buf + 24, job->header.depth);
+    for (i = 0; i < NTABLES; i++) {
+	sary_put_uint64(buf + 32 + i * 8,
+		   table_count(&job->tables[i], job->nchunks));
+    }
+    fwrite(buf, 1, LCP_HEADER_SIZE, fp);
+
+    for (i = 0; i < NTABLES; i++) {
+	Table *table = &job->tables[i];
+
+	fwrite(table->bytes, 1, job->nipoints, fp);
+	memset(buf, 0, 8);
+	fwrite(buf, 1, (8 - job->nipoints % 8) % 8, fp);
+
+	for (j = 0; j < job->nchunks; j++) {
+	    GArray *overflows = table->overflows[j];
+
+	    for (k = 0; overflows != NULL && k < overflows->len; k++) {
+		Overflow *overflow = &g_array_index(overflows, Overflow, k);
+
+		sary_put_uint64(buf, overflow->idx);
+		sary_put_uint64(buf + 8, overflow->val);
+		fwrite(buf, 1, 16, fp);
+	    }
+	}
+    }
+
+    if (ferror(fp)) {
+	saved_errno = errno;
+	fclose(fp);
+	errno = saved_errno;
+	return FALSE;
+    }
+    return fclose(fp) == 0;
+}
@@ -0,0 +1,34 @@
+#ifndef __SARY_LCP_H__
+#define __SARY_LCP_H__
+
+#include <glib.h>
+#include <sary/progress.h>
+#include <sary/saryconfig.h>
+#include <sary/text.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct _SaryLcp SaryLcp;
+
+gboolean	sary_lcp_make		(SaryText *text,
+					 const gchar *array_name,
+					 const gchar *lcp_name,
+					 gint nthreads,
+					 SaryProgressFunc progress_func,
+					 gpointer progress_func_data);
+gchar*		sary_lcp_file_name	(const gchar *array_name);
+SaryLcp*	sary_lcp_new		(const gchar *lcp_name);
+void		sary_lcp_destroy	(SaryLcp *lcp);
+SaryInt		sary_lcp_get		(SaryLcp *lcp, SaryInt idx);
+SaryInt		sary_lcp_get_left	(SaryLcp *lcp, SaryInt idx);
+SaryInt		sary_lcp_get_right	(SaryLcp *lcp, SaryInt idx);
+SaryInt		sary_lcp_get_len	(SaryLcp *lcp);
+SaryInt		sary_lcp_get_depth	(SaryLcp *lcp);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __SARY_LCP_H__ */
@@ -26,53 +26,134 @@
 #include <glib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <sary.h>
 
+#if !defined (_WIN32) || defined (__CYGWIN__)
+#  include <sys/mman.h>
+#endif
+
 enum {
-    CACHE_SIZE = 16
+    CACHE_SIZE = 16,
+    PARTS_PER_THREAD = 4
 };
 
+/*
+ * `lcp' is the length of the common prefix of the head of
+ * the block and the suffix it has lost to (or the suffix
+ * written last for the winner).
+ */
 typedef struct {
     SaryInt	*first;
     SaryInt	*cursor;
     SaryInt	*last;
+    SaryInt	lcp;
     gchar	cache[CACHE_SIZE];
     SaryInt	cache_len;
 } Block;
 
+/*
+ * Tournament tree of losers. losers[1 .. nblocks - 1] are
+ * the internal nodes holding the blocks which lost the games
+ * there and losers[0] holds the overall winner. The i-th
+ * block is the leaf at nblocks + i.
+ */
 typedef struct {
     SaryText	*text;
-    Block	**qblocks;
-    SaryInt	len;
-} Queue;
+    SaryInt	limit;
+    Block	*blocks;
+    SaryInt	nblocks;
+    SaryInt	*losers;
+} Tree;
 
 struct _SaryMerger {
     gchar	*array_name;
+    SaryText	*text;
     Block	*blocks;
     SaryInt	nblocks;
-    Queue	*queue;
+    gint	width;
+    gint	nthreads;
+    SaryInt	fanin;
+    SaryInt	depth;		/* 0 if suffixes are sorted fully */
+    SaryInt	limit;		/* bytes compared */
+    SaryMmap	*runs;		/* runs written by the last pass */
+    gchar	*run_name;
 };
 
-static gboolean		merge			(Queue *queue, 
+/*
+ * The output is divided into `nparts' independent parts by
+ * splitter suffixes. bounds[i * nblocks + j] points to the
+ * first index point of the i-th part in the j-th block, and
+ * starts[i] is the position of the part in the output.
+ */
+typedef struct {
+    SaryMerger		*merger;
+    SaryInt		**bounds;
+    SaryInt		*starts;
+    SaryInt		nparts;
+    SaryInt		next;
+    SaryInt		count;
+    gboolean		result;
+    SaryProgress	*progress;
+    pthread_mutex_t	mutex;
+} Parts;
+
+static gboolean		merge			(SaryText *text,
+						 SaryInt limit,
+						 Block *blocks,
+						 SaryInt nblocks,
 						 SaryProgress *progress, 
 						 SaryWriter *writer);
+static gboolean		copy			(Block *block,
+						 SaryProgress *progress,
+						 SaryWriter *writer);
+static gboolean		parallel_merge		(SaryMerger *merger,
+						 SaryProgress *progress);
+static gboolean		merge_pass		(SaryMerger *merger,
+						 gint pass,
+						 SaryProgressFunc progress_func,
+						 gpointer progress_func_data,
+						 SaryInt nipoints);
+static void		remove_runs		(SaryMerger *merger);
+static void		split			(Parts *parts);
+static SaryInt*		lower_bound		(SaryMerger *merger,
+						 Block *block,
+						 const gchar *suffix);
+static gint		samplecmp		(gconstpointer s1,
+						 gconstpointer s2,
+						 gpointer merger);
+static void		merge_parts		(Parts *parts);
+static gboolean		merge_part		(Parts *parts, 
+						 SaryInt i);
 static inline gboolean	is_block_exhausted	(Block *block);
 static void		update_block_cache	(Block *block, 
-						 SaryText *text);
+						 Tree *tree);
 static inline gint 	suffixcmp		(const gchar *s1, 
 						 const gchar *s2, 
+						 SaryInt limit,
 						 const gchar *eof);
-static inline gint 	queuecmp		(SaryText *text, 
+static inline SaryInt	get_lcp			(const gchar *s1, 
+						 const gchar *s2, 
+						 SaryInt limit,
+						 const gchar *eof,
+						 SaryInt lcp);
+static inline gint 	blockcmp		(Tree *tree, 
 						 Block *b1, 
-						 Block *b2);
-static void 		queue_insert		(Queue *queue, 
-						 Block *block);
-static inline Block*	queue_minimum		(Queue *queue);
-static inline void	queue_downsize		(Queue *queue);
-static inline void	queue_rearrange		(Queue *queue);
-static inline void	swap			(Block *blocks[], 
+						 Block *b2,
+						 SaryInt *lcp);
+static Tree*		tree_new		(SaryText *text,
+						 SaryInt limit,
+						 Block *blocks,
+						 SaryInt nblocks);
+static void		tree_destroy		(Tree *tree);
+static inline Block*	tree_winner		(Tree *tree);
+static void		tree_replay		(Tree *tree);
+static inline SaryInt	play			(Tree *tree,
 						 SaryInt i,
-						 SaryInt j);
+						 SaryInt j,
+						 SaryInt *loser);
 
 SaryMerger*
 sary_merger_new	(SaryText *text, 
@@ -85,17 +166,16 @@ sary_merger_new	(SaryText *text,
 
     merger = g_new(SaryMerger, 1);
     merger->array_name = g_strdup(array_name);
+    merger->text       = text;
     merger->blocks     = g_new(Block, nblocks);
     merger->nblocks    = 0;
-
-    merger->queue          = g_new(Queue, 1);
-    /*
-     * Allocate nblock + 1 for heaps. The 0-th element will
-     * never be used.
-     */
-    merger->queue->qblocks = g_new(Block*, nblocks + 1);
-    merger->queue->len  = 0;
-    merger->queue->text    = text;
+    merger->width      = sizeof(SaryInt) * 8;
+    merger->nthreads   = 1;
+    merger->fanin      = 0;
+    merger->depth      = 0;
+    merger->limit      = sary_text_get_size(text) + 1;
+    merger->runs       = NULL;
+    merger->run_name   = NULL;
 
     return merger;
 }
@@ -103,9 +183,8 @@ sary_merger_new	(SaryText *text,
 void
 sary_merger_destroy (SaryMerger *merger)
 {
+    remove_runs(merger);
     g_free(merger->blocks);
-    g_free(merger->queue->qblocks);
-    g_free(merger->queue);
     g_free(merger->array_name);
     g_free(merger);
 }
@@ -113,21 +192,57 @@ sary_merger_destroy (SaryMerger *merger)
 void
 sary_merger_add_block (SaryMerger *merger, SaryInt *head, SaryInt len)
 {
-    Block block, *added_block;
+    Block *block;
 
     g_assert(head != NULL && len >= 0);
 
-    block.first  = head;
-    block.cursor = head;
-    block.last   = head + len - 1;
-
-    merger->blocks[merger->nblocks] = block;
-    added_block = merger->blocks + merger->nblocks;
-    queue_insert(merger->queue, added_block);
+    block = merger->blocks + merger->nblocks;
+    block->first = head;
+    block->last  = head + len - 1;
 
     merger->nblocks++;
 }
 
+void
+sary_merger_set_offset_width (SaryMerger *merger, gint width)
+{
+    merger->width = width;
+}
+
+void
+sary_merger_set_nthreads (SaryMerger *merger, gint nthreads)
+{
+    g_assert(nthreads > 0);
+    merger->nthreads = nthreads;
+}
+
+/*
+ * Merge at most `fanin' blocks at once. More blocks are
+ * merged by several passes through intermediate run files
+ * named after the array file. 0, the default, merges all
+ * blocks in one pass.
+ */
+void
+sary_merger_set_fanin (SaryMerger *merger, SaryInt fanin)
+{
+    g_assert(fanin == 0 || fanin >= 2);
+    merger->fanin = fanin;
+}
+
+/*
+ * Merge blocks sorted by the first `depth' bytes of
+ * suffixes and then by their positions, which is recorded
+ * in the header of the array file. 0, the default, is for
+ * blocks sorted fully.
+ */
+void
+sary_merger_set_depth (SaryMerger *merger, SaryInt depth)
+{
+    g_assert(depth >= 0);
+    merger->depth = depth;
+    merger->limit = depth > 0 ? depth : sary_text_get_size(merger->text) + 1;
+}
+
 gboolean
 sary_merger_merge(SaryMerger *merger, 
 		  SaryProgressFunc progress_func,
@@ -137,92 +252,505 @@ sary_merger_merge(SaryMerger *merger,
     gboolean result;
     SaryProgress *progress;
     SaryWriter *writer;
+    SaryHeader header;
+    gint pass;
+
+    for (pass = 0; merger->fanin > 0 && merger->nblocks > merger->fanin &&
+	     nipoints > 0; pass++) 
+    {
+	if (merge_pass(merger, pass, progress_func, 
+		       progress_func_data, nipoints) == FALSE) 
+	{
+	    remove_runs(merger);
+	    return FALSE;
+	}
+    }
 
     progress = sary_progress_new("merge", nipoints);
     sary_progress_connect(progress, progress_func, progress_func_data);
 
-    writer = sary_writer_new(merger->array_name);
+    sary_header_init2(&header, merger->width, merger->depth);
+    writer = sary_writer_new_with_header(merger->array_name, &header);
     if (writer == NULL) {
+	sary_progress_destroy(progress);
+	remove_runs(merger);
 	return FALSE;
     }
 
-    g_assert(merger->nblocks == merger->queue->len);
-    result = merge(merger->queue, progress, writer);
+    if (merger->nthreads > 1 && merger->nblocks > 1 && nipoints > 0) {
+	/*
+	 * The file has only the header so far. Each part
+	 * is written by a writer of its own.
+	 */
+	sary_writer_destroy(writer);
+	result = parallel_merge(merger, progress);
+    } else {
+	result = merge(merger->text, merger->limit, merger->blocks, 
+		       merger->nblocks, progress, writer);
+	sary_writer_destroy(writer);
+    }
 
     sary_progress_destroy(progress);
-    sary_writer_destroy(writer);
+    remove_runs(merger);
 
     return result;
 }
 
+/*
+ * Merge every `fanin' blocks into a run and replace the
+ * blocks with the runs. The runs are written one after
+ * another to a file with SaryInt wide offsets, which is
+ * read sequentially by the next pass.
+ */
+static gboolean
+merge_pass (SaryMerger *merger, 
+	    gint pass,
+	    SaryProgressFunc progress_func,
+	    gpointer progress_func_data,
+	    SaryInt nipoints)
+{
+    SaryInt i, j, nruns = 0, count = 0;
+    SaryInt *lens, *payload;
+    SaryProgress *progress;
+    SaryWriter *writer;
+    SaryMmap *runs;
+    SaryHeader header;
+    gchar *run_name;
+    gboolean result = TRUE;
+
+    run_name = g_strdup_printf("%s.%d.tmp", merger->array_name, pass % 2);
+    writer = sary_writer_new(run_name);
+    if (writer == NULL) {
+	g_free(run_name);
+	return FALSE;
+    }
+
+    progress = sary_progress_new("merge", nipoints);
+    sary_progress_connect(progress, progress_func, progress_func_data);
+
+    lens = g_new(SaryInt, merger->nblocks / merger->fanin + 1);
+    for (i = 0; i < merger->nblocks && result == TRUE; i += merger->fanin) {
+	SaryInt n = MIN(merger->fanin, merger->nblocks - i);
+
+	lens[nruns] = 0;
+	for (j = i; j < i + n; j++) {
+	    lens[nruns] += merger->blocks[j].last - merger->blocks[j].first + 1;
+	}
+	result = merge(merger->text, merger->limit, merger->blocks + i, n, 
+		       NULL, writer);
+
+	count += lens[nruns++];
+	sary_progress_set_count(progress, count);
+    }
+
+    sary_progress_destroy(progress);
+    sary_writer_destroy(writer);
+
+    /*
+     * The blocks of this pass are no longer referred to.
+     */
+    remove_runs(merger);
+    merger->run_name = run_name;
+    if (result == FALSE || (runs = sary_mmap(run_name, "r")) == NULL) {
+	g_free(lens);
+	return FALSE;
+    }
+    merger->runs = runs;
+
+#ifdef POSIX_MADV_SEQUENTIAL
+    /*
+     * Every run is read from the head to the tail and never
+     * again so that the kernel should read ahead more and
+     * drop the pages read.
+     */
+    if (runs->len > 0) {
+	posix_madvise(runs->map, runs->len, POSIX_MADV_SEQUENTIAL);
+    }
+#endif
+
+    sary_header_read(&header, runs->map, runs->len);
+    payload = (SaryInt *)((gchar *)runs->map + header.len);
+    merger->nblocks = 0;
+    for (i = 0; i < nruns; i++) {
+	sary_merger_add_block(merger, payload, lens[i]);
+	payload += lens[i];
+    }
+    g_free(lens);
+
+    return TRUE;
+}
+
+static void
+remove_runs (SaryMerger *merger)
+{
+    if (merger->runs != NULL) {
+	sary_munmap(merger->runs);
+	merger->runs = NULL;
+    }
+    if (merger->run_name != NULL) {
+	unlink(merger->run_name);
+	g_free(merger->run_name);
+	merger->run_name = NULL;
+    }
+}
+
 static gboolean
-merge (Queue *queue, SaryProgress *progress, SaryWriter *writer)
+merge (SaryText *text, 
+       SaryInt limit,
+       Block *blocks, 
+       SaryInt nblocks,
+       SaryProgress *progress, 
+       SaryWriter *writer)
 {
     SaryInt count = 0;
+    Block *block;
+    Tree *tree;
+    gboolean result = TRUE;
 
-    while (queue->len > 0) {
-	Block *block = queue_minimum(queue);
+    if (nblocks == 1) {
+	return copy(blocks, progress, writer);
+    }
 
+    tree = tree_new(text, limit, blocks, nblocks);
+    while ((block = tree_winner(tree)) != NULL) {
 	if (sary_writer_write(writer, *block->cursor) == FALSE) {
-	    return FALSE;
+	    result = FALSE;
+	    break;
 	}
+	tree_replay(tree);
 
-	block->cursor++;
-	if (is_block_exhausted(block)) {
-	    queue_downsize(queue);
-	} else {
-	    update_block_cache(block, queue->text);
+	if (progress != NULL) {
+	    sary_progress_set_count(progress, count);
 	}
-	queue_rearrange(queue);
-
-	sary_progress_set_count(progress, count);
 	count++;
     }
-    if (sary_writer_flush(writer) == FALSE) {
+    tree_destroy(tree);
+
+    if (result == FALSE || sary_writer_flush(writer) == FALSE) {
 	return FALSE;
     }
     return TRUE;
 }
 
+/*
+ * A single block is already in order and is only written
+ * out.
+ */
+static gboolean
+copy (Block *block, SaryProgress *progress, SaryWriter *writer)
+{
+    SaryInt *cursor;
+
+    for (cursor = block->first; cursor <= block->last; cursor++) {
+	if (sary_writer_write(writer, *cursor) == FALSE) {
+	    return FALSE;
+	}
+	if (progress != NULL) {
+	    sary_progress_set_count(progress, cursor - block->first);
+	}
+    }
+    return sary_writer_flush(writer);
+}
+
+static gboolean
+parallel_merge (SaryMerger *merger, SaryProgress *progress)
+{
+    Parts parts;
+    SaryInt i;
+    pthread_t *threads;
+
+    parts.merger   = merger;
+    parts.nparts   = merger->nthreads * PARTS_PER_THREAD;
+    parts.bounds   = g_new(SaryInt *, (parts.nparts + 1) * merger->nblocks);
+    parts.starts   = g_new(SaryInt, parts.nparts + 1);
+    parts.next     = 0;
+    parts.count    = 0;
+    parts.result   = TRUE;
+    parts.progress = progress;
+    pthread_mutex_init(&parts.mutex, NULL);
+
+    split(&parts);
+
+    threads = g_new(pthread_t, merger->nthreads);
+    for (i = 0; i < merger->nthreads; i++) {
+	if (pthread_create(&threads[i], NULL, 
+			   (void *)merge_parts, &parts) != 0) 
+	{
+	    g_error("pthread_create: %s", g_strerror(errno));
+	}
+    }
+    for (i = 0; i < merger->nthreads; i++) {
+	pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&parts.mutex);
+    g_free(threads);
+    g_free(parts.starts);
+    g_free(parts.bounds);
+
+    return parts.result;
+}
+
+/*
+ * Sample every block evenly, sort the samples and take
+ * nparts - 1 of them as splitters. Then find where each
+ * splitter falls in every block by binary search. The
+ * indices are scaled in 64 bits since i * len overflows
+ * SaryInt for a large block with many threads.
+ */
+static void
+split (Parts *parts)
+{
+    SaryMerger *merger = parts->merger;
+    SaryText *text = merger->text;
+    SaryInt nblocks = merger->nblocks;
+    SaryInt nparts  = parts->nparts;
+    SaryInt i, j, nsamples = 0;
+    gchar **samples;
+
+    samples = g_new(gchar *, nparts * nblocks);
+    for (j = 0; j < nblocks; j++) {
+	Block *block = merger->blocks + j;
+	SaryInt len  = block->last - block->first + 1;
+
+	for (i = 0; i < nparts && i < len; i++) {
+	    samples[nsamples++] = 
+		sary_i_text(text, block->first + 
+			    (SaryInt)((gint64)i * len / nparts));
+	}
+    }
+    g_qsort_with_data(samples, nsamples, sizeof(gchar *), samplecmp, merger);
+
+    for (j = 0; j < nblocks; j++) {
+	Block *block = merger->blocks + j;
+
+	parts->bounds[j] = block->first;
+	parts->bounds[nparts * nblocks + j] = block->last + 1;
+    }
+    for (i = 1; i < nparts; i++) {
+	gchar *splitter = samples[(gint64)i * nsamples / nparts];
+
+	for (j = 0; j < nblocks; j++) {
+	    parts->bounds[i * nblocks + j] = 
+		lower_bound(merger, merger->blocks + j, splitter);
+	}
+    }
+
+    parts->starts[0] = 0;
+    for (i = 0; i < nparts; i++) {
+	parts->starts[i + 1] = parts->starts[i];
+	for (j = 0; j < nblocks; j++) {
+	    parts->starts[i + 1] += parts->bounds[(i + 1) * nblocks + j] - 
+		parts->bounds[i * nblocks + j];
+	}
+    }
+
+    g_free(samples);
+}
+
+/*
+ * Return the first index point in the block whose suffix is
+ * not smaller than `suffix'.
+ */
+static SaryInt *
+lower_bound (SaryMerger *merger, Block *block, const gchar *suffix)
+{
+    SaryText *text = merger->text;
+    gchar *eof = sary_text_get_eof(text);
+    SaryInt *low  = block->first;
+    SaryInt *high = block->last + 1;
+
+    while (low < high) {
+	SaryInt *mid = low + (high - low) / 2;
+
+	if (suffixcmp(sary_i_text(text, mid), suffix, 
+		      merger->limit, eof) < 0) 
+	{
+	    low = mid + 1;
+	} else {
+	    high = mid;
+	}
+    }
+    return low;
+}
+
+static gint
+samplecmp (gconstpointer s1, gconstpointer s2, gpointer merger)
+{
+    return suffixcmp(*(gchar **)s1, *(gchar **)s2, 
+		     ((SaryMerger *)merger)->limit,
+		     sary_text_get_eof(((SaryMerger *)merger)->text));
+}
+
+static void
+merge_parts (Parts *parts)
+{
+    while (1) {
+	SaryInt i;
+	gboolean result;
+
+	pthread_mutex_lock(&parts->mutex);
+	i = parts->next++;
+	pthread_mutex_unlock(&parts->mutex);
+
+	if (i >= parts->nparts) {
+	    break;
+	}
+
+	result = merge_part(parts, i);
+
+	pthread_mutex_lock(&parts->mutex);
+	if (result == FALSE) {
+	    parts->result = FALSE;
+	}
+	parts->count += parts->starts[i + 1] - parts->starts[i];
+	sary_progress_set_count(parts->progress, parts->count);
+	pthread_mutex_unlock(&parts->mutex);
+    }
+}
+
+/*
+ * Merge the i-th part with a tree of its own and write it
+ * to its final position in the output.
+ */
+static gboolean
+merge_part (Parts *parts, SaryInt i)
+{
+    SaryMerger *merger = parts->merger;
+    SaryInt nblocks = merger->nblocks;
+    SaryInt j;
+    Block *blocks;
+    SaryWriter *writer;
+    SaryHeader header;
+    gboolean result;
+
+    if (parts->starts[i] == parts->starts[i + 1]) {
+	return TRUE;
+    }
+
+    blocks = g_new(Block, nblocks);
+    for (j = 0; j < nblocks; j++) {
+	blocks[j].first = parts->bounds[i * nblocks + j];
+	blocks[j].last  = parts->bounds[(i + 1) * nblocks + j] - 1;
+    }
+
+    sary_header_init2(&header, merger->width, merger->depth);
+    writer = sary_writer_new_at(merger->array_name, &header, 
+				parts->starts[i]);
+    if (writer == NULL) {
+	result = FALSE;
+    } else {
+	result = merge(merger->text, merger->limit, blocks, nblocks, 
+		       NULL, writer);
+	sary_writer_destroy(writer);
+    }
+
+    g_free(blocks);
+
+    return result;
+}
+
 static inline gboolean
 is_block_exhausted(Block *block)
 {
     return block->cursor > block->last;
 }
 
+/*
+ * Compare suffixes up to `limit' bytes and then by their
+ * positions.
+ */
 static inline gint 
-suffixcmp (const gchar *s1, const gchar *s2, const gchar *eof)
+suffixcmp (const gchar *s1, const gchar *s2, SaryInt limit, const gchar *eof)
 {
     gint cmp;
 
-    SaryInt len1 = eof - s1;
-    SaryInt len2 = eof - s2;
+    SaryInt len1 = MIN(eof - s1, limit);
+    SaryInt len2 = MIN(eof - s2, limit);
 
     cmp = memcmp(s1, s2, MIN(len1, len2));
-    if (cmp == 0) {
-	return len1 - len2;  /* compare by length */
-    } else {
+    if (cmp != 0) {
 	return cmp;
+    } else if (len1 != len2) {
+	return len1 < len2 ? -1 : 1;  /* compare by length */
+    } else {
+	return s1 < s2 ? -1 : s1 > s2;
     }
 }
 
+/*
+ * Return the length of the common prefix of s1 and s2
+ * which are known to share the first `lcp' bytes, up to
+ * `limit' bytes.
+ */
+static inline SaryInt
+get_lcp (const gchar *s1, 
+	 const gchar *s2, 
+	 SaryInt limit, 
+	 const gchar *eof, 
+	 SaryInt lcp)
+{
+    SaryInt len = MIN(eof - MAX(s1, s2), limit);
+
+    /*
+     * Compare by words until they differ.
+     */
+    while (lcp + (SaryInt)sizeof(guint64) <= len) {
+	guint64 w1, w2;
+
+	memcpy(&w1, s1 + lcp, sizeof(guint64));
+	memcpy(&w2, s2 + lcp, sizeof(guint64));
+	if (w1 != w2) {
+	    break;
+	}
+	lcp += sizeof(guint64);
+    }
+    while (lcp < len && s1[lcp] == s2[lcp]) {
+	lcp++;
+    }
+    return lcp;
+}
+
+/*
+ * Compare the heads of the blocks skipping the first `lcp'
+ * bytes known to be common and store the length of the
+ * common prefix found to `lcp'. Suffixes sharing the first
+ * `limit' bytes are compared by their positions.
+ */
 static inline gint 
-queuecmp (SaryText *text, Block *b1, Block *b2)
+blockcmp (Tree *tree, Block *b1, Block *b2, SaryInt *lcp)
 {
+    SaryText *text = tree->text;
+    gchar *eof, *suffix1, *suffix2;
+    SaryInt i   = *lcp;
+    SaryInt len = MIN(b1->cache_len, b2->cache_len);
+
     /*
      * Consult cache first.
      */
-    gint len = MIN(b1->cache_len, b2->cache_len);
-    gint cmp = memcmp(b1->cache, b2->cache, len);
-
-    if (cmp == 0) {
-	gchar *eof     = sary_text_get_eof(text);
-	gchar *suffix1 = sary_i_text(text, b1->cursor) + len;
-	gchar *suffix2 = sary_i_text(text, b2->cursor) + len;
+    while (i < len && b1->cache[i] == b2->cache[i]) {
+	i++;
+    }
+    if (i < len) {
+	*lcp = i;
+	return (guchar)b1->cache[i] - (guchar)b2->cache[i];
+    }
 
-	cmp = suffixcmp(suffix1, suffix2, eof);
+    eof     = sary_text_get_eof(text);
+    suffix1 = sary_i_text(text, b1->cursor);
+    suffix2 = sary_i_text(text, b2->cursor);
+
+    i = get_lcp(suffix1, suffix2, tree->limit, eof, i);
+    *lcp = i;
+    if (i == tree->limit) {
+	return suffix1 < suffix2 ? -1 : 1;
+    } else if (suffix1 + i == eof) {
+	return -1;  /* shorter one is smaller */
+    } else if (suffix2 + i == eof) {
+	return 1;
+    } else {
+	return (guchar)suffix1[i] - (guchar)suffix2[i];
     }
-    return cmp;
 }
 
 /*
@@ -230,10 +758,10 @@ queuecmp (SaryText *text, Block *b1, Block *b2)
  * each block.
  */
 static void
-update_block_cache (Block *block, SaryText *text)
+update_block_cache (Block *block, Tree *tree)
 {
-    gchar *suffix = sary_i_text(text, block->cursor);
-    SaryInt len   = sary_text_get_eof(text) - suffix;
+    gchar *suffix = sary_i_text(tree->text, block->cursor);
+    SaryInt len   = MIN(sary_text_get_eof(tree->text) - suffix, tree->limit);
 
     block->cache_len = MIN(len, CACHE_SIZE);
     g_memmove(block->cache, suffix, block->cache_len);
@@ -241,76 +769,148 @@ update_block_cache (Block *block, SaryText *text)
 
 
 /*
- * Priority queue represented with heaps.
+ * LCP-aware tournament tree. The blocks on the path of the
+ * winner hold their lcp with the winner. Then the next head
+ * of its block, knowing its own lcp with the winner, needs
+ * to look at the text only when both lcp are equal and it
+ * starts from there.
  *
- * Reference: 
- * Jon Bentley: Programming Pearls 2nd ed. pp. 147-159.
- * <http://www.programmingpearls.com/>
+ * Reference:
+ * Timo Bingmann, Andreas Eberle, Peter Sanders: "Engineering
+ * Parallel String Sorting," Algorithmica, 2017.
  */
 
-static void 
-queue_insert (Queue *queue, Block *block)
+static Tree *
+tree_new (SaryText *text, SaryInt limit, Block *blocks, SaryInt nblocks)
 {
-    SaryInt i;
-    Block **qblocks = queue->qblocks;
-
-    queue->len++;
-    qblocks[queue->len] = block;
+    SaryInt i, *winners;
+    Tree *tree;
+
+    tree = g_new(Tree, 1);
+    tree->text    = text;
+    tree->limit   = limit;
+    tree->blocks  = blocks;
+    tree->nblocks = nblocks;
+    tree->losers  = g_new(SaryInt, MAX(nblocks, 1));
+    tree->losers[0] = 0;
+
+    for (i = 0; i < nblocks; i++) {
+	Block *block = blocks + i;
+
+	block->cursor = block->first;
+	block->lcp    = 0;
+	if (!is_block_exhausted(block)) {
+	    update_block_cache(block, tree);
+	}
+    }
 
-    update_block_cache(block, queue->text);
+    /*
+     * Play the games from the bottom. winners[i] is the
+     * winner at the i-th node.
+     */
+    winners = g_new(SaryInt, MAX(nblocks, 1));
+    for (i = nblocks - 1; i >= 1; i--) {
+	SaryInt c1 = 2 * i, c2 = 2 * i + 1;
 
-    for (i = queue->len; i > 1 && 
-	     queuecmp(queue->text, qblocks[i / 2],  qblocks[i]) > 0; i /= 2) 
-    {
-	swap(qblocks, i / 2, i);
+	c1 = c1 >= nblocks ? c1 - nblocks : winners[c1];
+	c2 = c2 >= nblocks ? c2 - nblocks : winners[c2];
+	winners[i] = play(tree, c1, c2, tree->losers + i);
+    }
+    if (nblocks > 1) {
+	tree->losers[0] = winners[1];
     }
+    g_free(winners);
 
+    return tree;
 }
 
-static inline Block *
-queue_minimum (Queue *queue)
+static void
+tree_destroy (Tree *tree)
 {
-    return queue->qblocks[1];
+    g_free(tree->losers);
+    g_free(tree);
 }
 
-static inline void
-queue_downsize (Queue *queue)
+/*
+ * Return NULL if all blocks are exhausted.
+ */
+static inline Block *
+tree_winner (Tree *tree)
 {
-    queue->qblocks[1] = queue->qblocks[queue->len];
-    queue->len--;
+    Block *block;
+
+    if (tree->nblocks == 0) {
+	return NULL;
+    }
+    block = tree->blocks + tree->losers[0];
+    return is_block_exhausted(block) ? NULL : block;
 }
 
 /*
- * Rearrange heap structure. Relocate the 1st element to the
- * appropriate position.
+ * Advance the winner's block and replay the games on its
+ * path to the root.
  */
-static inline void
-queue_rearrange (Queue *queue)
+static void
+tree_replay (Tree *tree)
 {
-    SaryInt i, c;
-    Block **qblocks = queue->qblocks;
+    SaryInt i, winner = tree->losers[0];
+    Block *block = tree->blocks + winner;
+    gchar *prev  = sary_i_text(tree->text, block->cursor);
+
+    block->cursor++;
+    if (!is_block_exhausted(block)) {
+	block->lcp = get_lcp(sary_i_text(tree->text, block->cursor), prev,
+			     tree->limit, sary_text_get_eof(tree->text), 0);
+	update_block_cache(block, tree);
+    }
 
-    for (i = 1; i * 2 <= queue->len; i = c) {
-	c = 2 * i;
-	if (c + 1 <= queue->len && 
-	    queuecmp(queue->text, qblocks[c + 1], qblocks[c]) < 0) 
-	{
-	    c++;
-	}
-	if (queuecmp(queue->text, qblocks[i], qblocks[c]) <= 0) {
-	    break;
-	}
-	swap(qblocks, c, i);
+    for (i = (tree->nblocks + winner) / 2; i >= 1; i /= 2) {
+	winner = play(tree, winner, tree->losers[i], tree->losers + i);
     }
+    tree->losers[0] = winner;
 }
 
-static inline void 
-swap (Block **qblocks, SaryInt i, SaryInt j)
+/*
+ * Play a game between the i-th and j-th blocks whose lcp
+ * are relative to the same suffix. Return the winner and
+ * store the loser to `loser' with its lcp made relative to
+ * the winner. An exhausted block always loses.
+ */
+static inline SaryInt
+play (Tree *tree, SaryInt i, SaryInt j, SaryInt *loser)
 {
-    Block *tmp;
+    Block *b1 = tree->blocks + i;
+    Block *b2 = tree->blocks + j;
+    SaryInt lcp;
+
+    if (is_block_exhausted(b2)) {
+	*loser = j;
+	return i;
+    } else if (is_block_exhausted(b1)) {
+	*loser = i;
+	return j;
+    }
 
-    tmp  = qblocks[i];
-    qblocks[i] = qblocks[j];
-    qblocks[j] = tmp;
-}
+    /*
+     * The one sharing a longer prefix with the common
+     * suffix is smaller and the other's lcp stays as is.
+     */
+    if (b1->lcp > b2->lcp) {
+	*loser = j;
+	return i;
+    } else if (b1->lcp < b2->lcp) {
+	*loser = i;
+	return j;
+    }
 
+    lcp = b1->lcp;
+    if (blockcmp(tree, b1, b2, &lcp) < 0) {
+	b2->lcp = lcp;
+	*loser  = j;
+	return i;
+    } else {
+	b1->lcp = lcp;
+	*loser  = i;
+	return j;
+    }
+}
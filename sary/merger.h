@@ -18,6 +18,14 @@ void		sary_merger_destroy	(SaryMerger *merger);
 void		sary_merger_add_block	(SaryMerger *merger,
 					 SaryInt *head, 
 					 SaryInt len);
+void		sary_merger_set_offset_width	(SaryMerger *merger,
+						 gint width);
+void		sary_merger_set_nthreads	(SaryMerger *merger,
+						 gint nthreads);
+void		sary_merger_set_fanin	(SaryMerger *merger,
+					 SaryInt fanin);
+void		sary_merger_set_depth	(SaryMerger *merger,
+					 SaryInt depth);
 gboolean	sary_merger_merge	(SaryMerger *merger, 
 					 SaryProgressFunc progress_func,
 					 gpointer progress_func_data,
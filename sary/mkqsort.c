@@ -26,6 +26,9 @@
 #include <glib.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
 #include <sary.h>
 
 /*
@@ -34,30 +37,246 @@
  * Searching Strings," Proceedings of the Eighth Annual ACM-SIAM
  * Symposium on Discrete Algorithms, 1997.
  * <http://www.cs.princeton.edu/~rs/strings/>
+ *
+ * The recursion is replaced with an explicit stack. The
+ * smallest of the three partitions is sorted next and the
+ * others are pushed so that the stack never exceeds
+ * STACK_SIZE even if the text is highly repetitive. Pivots
+ * are chosen by median-of-3 or ninther without rand(3)
+ * which serializes threads with its global state.
+ *
+ * With several threads, partitions larger than TASK_SIZE
+ * are handed to other threads through work-stealing deques.
+ *
+ * A bounded sort compares suffixes up to `limit' bytes and
+ * sorts the ones sharing the first `limit' bytes by their
+ * positions. Partitions reaching the limit are sorted with
+ * qsort(3) at once instead of going deeper into repeats.
  */
 
-static void		insertion_sort	(SaryInt *array, 
-					 gint len, 
-					 gint depth, 
-					 const gchar *bof, 
+/*
+ * A partition to be sorted. `first' points to either
+ * SaryInt or Suffix.
+ */
+typedef struct {
+    gpointer	first;
+    SaryInt	len;
+    SaryInt	depth;
+} Range;
+
+/*
+ * An element for the cached sorting. `key' holds
+ * the next KEY_LEN bytes of the suffix from the current
+ * depth in big endian and padded with 0 beyond eof.
+ */
+typedef struct {
+    guint64	key;
+    SaryInt	offset;  /* in native byte order */
+} Suffix;
+
+typedef void	(*InsertionSortFunc)	(gpointer first,
+					 SaryInt len,
+					 SaryInt depth,
+					 SaryInt limit,
+					 const gchar *bof,
 					 const gchar *eof);
+typedef void	(*PartitionFunc)	(gpointer first,
+					 SaryInt len,
+					 SaryInt depth,
+					 SaryInt limit,
+					 const gchar *bof,
+					 const gchar *eof,
+					 Range *ranges);
+typedef void	(*TieSortFunc)		(gpointer first,
+					 SaryInt len);
 
+typedef struct {
+    InsertionSortFunc	insertion_sort;
+    PartitionFunc	partition;
+    TieSortFunc		sort_ties;
+} Algorithm;
+
+/*
+ * A work-stealing deque. The owner pushes and pops tasks at
+ * the tail and the others steal them from the head.
+ */
+typedef struct {
+    Range		*tasks;
+    SaryInt		head;
+    SaryInt		tail;
+    SaryInt		size;
+    pthread_mutex_t	mutex;
+} Deque;
+
+typedef struct {
+    const Algorithm	*algorithm;
+    const gchar		*bof;
+    const gchar		*eof;
+    SaryInt		limit;
+    Deque		*deques;
+    gint		nthreads;
+    SaryInt		npending;  /* number of unfinished tasks */
+    SaryInt		nqueued;   /* number of tasks in deques */
+    SaryProgress	*progress;
+    pthread_mutex_t	mutex;
+    pthread_cond_t	cond;
+} Pool;
+
+typedef struct {
+    Pool	*pool;
+    gint	id;
+} Worker;
+
+enum { 
+    STACK_SIZE = sizeof(SaryInt) * 8 * 2,
+    KEY_LEN    = sizeof(guint64),
+    TASK_SIZE  = 16 * 1024
+};
+
+static void		sort_range	(const Algorithm *algorithm,
+					 SaryProgress *progress,
+					 Range range,
+					 SaryInt limit,
+					 const gchar *bof,
+					 const gchar *eof);
+static void		parallel_sort	(const Algorithm *algorithm,
+					 SaryProgress *progress,
+					 Range range,
+					 SaryInt limit,
+					 const gchar *bof,
+					 const gchar *eof,
+					 gint nthreads);
+static inline SaryInt	get_limit	(SaryInt limit,
+					 const gchar *bof,
+					 const gchar *eof);
+static void		work		(Worker *worker);
+static gboolean		get_task	(Pool *pool, 
+					 gint id, 
+					 Range *task);
+static void		add_task	(Pool *pool, 
+					 gint id, 
+					 Range *task);
+static void		finish_task	(Pool *pool, 
+					 SaryInt nsorted);
+static void		push_ranges	(Range *ranges, 
+					 Range **sp,
+					 Range *next);
+static void		partition	(gpointer first,
+					 SaryInt len,
+					 SaryInt depth,
+					 SaryInt limit,
+					 const gchar *bof,
+					 const gchar *eof,
+					 Range *ranges);
+static void		insertion_sort	(gpointer first, 
+					 SaryInt len, 
+					 SaryInt depth, 
+					 SaryInt limit,
+					 const gchar *bof, 
+					 const gchar *eof);
+static void		sort_ties	(gpointer first, SaryInt len);
+static gint		offsetcmp	(gconstpointer p1, gconstpointer p2);
+static inline gint	suffixcmp	(SaryInt offset1,
+					 SaryInt offset2,
+					 SaryInt depth,
+					 SaryInt limit,
+					 const gchar *bof,
+					 const gchar *eof);
+static SaryInt		choose_pivot	(SaryInt *array,
+					 SaryInt len,
+					 SaryInt depth,
+					 const gchar *bof,
+					 const gchar *eof);
+static inline SaryInt	med3		(SaryInt *array,
+					 SaryInt i,
+					 SaryInt j,
+					 SaryInt k,
+					 SaryInt depth,
+					 const gchar *bof,
+					 const gchar *eof);
 static inline void	swap		(SaryInt *array, 
 					 SaryInt a, 
 					 SaryInt b);
-					
 static inline void	vecswap 	(SaryInt i,
 					 SaryInt j, 
 					 SaryInt n, 
 					 SaryInt *array);
-					
 static inline gint	ref		(const gchar *bof, 
 					 SaryInt offset, 
 					 SaryInt depth, 
 					 const gchar *eof);
-
 static inline void	swap2		(SaryInt *a, SaryInt *b);
 
+static Suffix*		new_suffixes	(SaryInt *array,
+					 SaryInt len,
+					 SaryInt depth,
+					 SaryInt limit,
+					 const gchar *bof,
+					 const gchar *eof);
+static void		destroy_suffixes(Suffix *suffixes,
+					 SaryInt *array,
+					 SaryInt len);
+static void		cached_partition
+					(gpointer first,
+					 SaryInt len,
+					 SaryInt depth,
+					 SaryInt limit,
+					 const gchar *bof,
+					 const gchar *eof,
+					 Range *ranges);
+static void		cached_insertion_sort
+					(gpointer first,
+					 SaryInt len,
+					 SaryInt depth,
+					 SaryInt limit,
+					 const gchar *bof,
+					 const gchar *eof);
+static void		cached_sort_ties
+					(gpointer first, SaryInt len);
+static gint		cached_offsetcmp
+					(gconstpointer p1, gconstpointer p2);
+static SaryInt		cached_choose_pivot
+					(Suffix *suffixes,
+					 SaryInt len,
+					 SaryInt depth,
+					 SaryInt limit,
+					 const gchar *bof,
+					 const gchar *eof);
+static inline SaryInt	cached_med3	(Suffix *suffixes,
+					 SaryInt i,
+					 SaryInt j,
+					 SaryInt k,
+					 SaryInt depth,
+					 SaryInt limit,
+					 const gchar *bof,
+					 const gchar *eof);
+static void		load_keys	(Suffix *suffixes,
+					 SaryInt len,
+					 SaryInt depth,
+					 SaryInt limit,
+					 const gchar *bof,
+					 const gchar *eof);
+static inline gint	keylen		(const Suffix *suffix,
+					 SaryInt depth,
+					 SaryInt limit,
+					 const gchar *bof,
+					 const gchar *eof);
+static inline gint	keycmp		(const Suffix *s1,
+					 const Suffix *s2,
+					 SaryInt depth,
+					 SaryInt limit,
+					 const gchar *bof,
+					 const gchar *eof);
+static inline void	swap_suffix	(Suffix *a, Suffix *b);
+static inline void	vecswap_suffix	(Suffix *a, Suffix *b, SaryInt n);
+
+static const Algorithm plain_algorithm  = { 
+    insertion_sort, partition, sort_ties 
+};
+static const Algorithm cached_algorithm = { 
+    cached_insertion_sort, cached_partition, cached_sort_ties 
+};
+
 void
 sary_multikey_qsort (SaryProgress *progress,
 		     SaryInt *array,
@@ -66,44 +285,374 @@ sary_multikey_qsort (SaryProgress *progress,
 		     const gchar *bof,
 		     const gchar *eof)
 {
-    SaryInt  a, b, c, d, r, v;
+    sary_multikey_qsort_bounded(progress, array, len, depth, 0, bof, eof,
+				FALSE, 1);
+}
+
+/*
+ * Sort suffixes by their first `limit' bytes and the ones
+ * sharing them by their positions. 0 for `limit' sorts them
+ * fully.
+ *
+ * If `cached', KEY_LEN bytes of suffixes are compared at
+ * once with keys cached in a working array. The text is
+ * referenced only to load the keys when they tie so that
+ * it is much faster for a text larger than the CPU cache.
+ * It needs additional memory of sizeof(Suffix) per index
+ * point.
+ *
+ * `nthreads' threads sort the array if it is more than 1.
+ * `progress' is then updated with a lock so that it can be
+ * shared.
+ */
+void
+sary_multikey_qsort_bounded (SaryProgress *progress,
+			     SaryInt *array,
+			     SaryInt len,
+			     SaryInt depth,
+			     SaryInt limit,
+			     const gchar *bof,
+			     const gchar *eof,
+			     gboolean cached,
+			     gint nthreads)
+{
+    const Algorithm *algorithm;
+    Range range;
+
+    limit = get_limit(limit, bof, eof);
+    if (cached) {
+	algorithm   = &cached_algorithm;
+	range.first = new_suffixes(array, len, depth, limit, bof, eof);
+    } else {
+	algorithm   = &plain_algorithm;
+	range.first = array;
+    }
+    range.len   = len;
+    range.depth = depth;
+
+    if (nthreads > 1) {
+	parallel_sort(algorithm, progress, range, limit, bof, eof, nthreads);
+    } else {
+	sort_range(algorithm, progress, range, limit, bof, eof);
+    }
+
+    if (cached) {
+	destroy_suffixes(range.first, array, len);
+    }
+}
+
+static void
+sort_range (const Algorithm *algorithm,
+	    SaryProgress *progress,
+	    Range range,
+	    SaryInt limit,
+	    const gchar *bof,
+	    const gchar *eof)
+{
+    Range stack[STACK_SIZE], *sp = stack;
+    Range ranges[3];
+
+    while (1) {
+	if (range.len <= 10 || range.depth >= limit) {
+	    if (range.len <= 10) {
+		algorithm->insertion_sort(range.first, range.len, 
+					  range.depth, limit, bof, eof);
+	    } else {
+		algorithm->sort_ties(range.first, range.len);
+	    }
+	    if (progress != NULL) {
+		sary_progress_set_count(progress, 
+					progress->current + range.len);
+	    }
+	    if (sp == stack) {
+		break;
+	    }
+	    range = *--sp;
+	    continue;
+	}
+
+	algorithm->partition(range.first, range.len, range.depth, limit,
+			     bof, eof, ranges);
+	push_ranges(ranges, &sp, &range);
+	g_assert(sp <= stack + STACK_SIZE);
+    }
+}
+
+static void
+parallel_sort (const Algorithm *algorithm,
+	       SaryProgress *progress,
+	       Range range,
+	       SaryInt limit,
+	       const gchar *bof,
+	       const gchar *eof,
+	       gint nthreads)
+{
+    Pool pool;
+    Worker *workers;
+    pthread_t *threads;
+    gint i;
+
+    g_assert(nthreads > 0);
+
+    pool.algorithm = algorithm;
+    pool.bof       = bof;
+    pool.eof       = eof;
+    pool.limit     = limit;
+    pool.nthreads  = nthreads;
+    pool.npending  = 0;
+    pool.nqueued   = 0;
+    pool.progress  = progress;
+    pool.deques    = g_new(Deque, nthreads);
+    pthread_mutex_init(&pool.mutex, NULL);
+    pthread_cond_init(&pool.cond, NULL);
+    for (i = 0; i < nthreads; i++) {
+	pool.deques[i].tasks = NULL;
+	pool.deques[i].head  = 0;
+	pool.deques[i].tail  = 0;
+	pool.deques[i].size  = 0;
+	pthread_mutex_init(&pool.deques[i].mutex, NULL);
+    }
+    add_task(&pool, 0, &range);
+
+    workers = g_new(Worker, nthreads);
+    threads = g_new(pthread_t, nthreads);
+    for (i = 0; i < nthreads; i++) {
+	workers[i].pool = &pool;
+	workers[i].id   = i;
+	if (pthread_create(&threads[i], NULL, 
+			   (void *)work, workers + i) != 0) 
+	{
+	    g_error("pthread_create: %s", g_strerror(errno));
+	}
+    }
+    for (i = 0; i < nthreads; i++) {
+	pthread_join(threads[i], NULL);
+    }
+
+    for (i = 0; i < nthreads; i++) {
+	g_free(pool.deques[i].tasks);
+	pthread_mutex_destroy(&pool.deques[i].mutex);
+    }
+    pthread_cond_destroy(&pool.cond);
+    pthread_mutex_destroy(&pool.mutex);
+    g_free(pool.deques);
+    g_free(workers);
+    g_free(threads);
+}
+
+/*
+ * Partition a task until it becomes smaller than TASK_SIZE
+ * and sort it sequentially. The other partitions are left
+ * in the deque to be stolen by idle threads.
+ */
+static void
+work (Worker *worker)
+{
+    Pool *pool = worker->pool;
+    const Algorithm *algorithm = pool->algorithm;
+    Range task, ranges[3];
+    gint i;
+
+    while (get_task(pool, worker->id, &task)) {
+	SaryInt nsorted = task.len;
 
-    if (len <= 10) {
-	insertion_sort(array, len, depth, bof, eof);
-	if (progress != NULL) {
-	    sary_progress_set_count(progress, progress->current + len);
+	while (task.len > TASK_SIZE && task.depth < pool->limit) {
+	    algorithm->partition(task.first, task.len, task.depth, 
+				 pool->limit, pool->bof, pool->eof, ranges);
+
+	    /*
+	     * Keep the largest partition and give the others.
+	     */
+	    task = ranges[0];
+	    for (i = 1; i < 3; i++) {
+		if (ranges[i].len > task.len) {
+		    Range t = task;
+		    task = ranges[i];
+		    ranges[i] = t;
+		}
+	    }
+	    for (i = 1; i < 3; i++) {
+		if (ranges[i].len > 0) {
+		    add_task(pool, worker->id, ranges + i);
+		    nsorted -= ranges[i].len;
+		}
+	    }
 	}
-	return;
+	sort_range(algorithm, NULL, task, pool->limit, pool->bof, pool->eof);
+	finish_task(pool, nsorted);
     }
+}
 
-    a = rand() % len;
-    swap(array, 0, a);
+/*
+ * Get a task from the own deque or steal one from the
+ * others. Wait while other threads may add a task and
+ * return FALSE if all tasks are finished.
+ */
+static gboolean
+get_task (Pool *pool, gint id, Range *task)
+{
+    gint i;
+
+    while (1) {
+	for (i = 0; i < pool->nthreads; i++) {
+	    Deque *deque = pool->deques + (id + i) % pool->nthreads;
+	    gboolean found = FALSE;
+
+	    pthread_mutex_lock(&deque->mutex);
+	    if (deque->head < deque->tail) {
+		if (i == 0) {
+		    *task = deque->tasks[--deque->tail];
+		} else {
+		    *task = deque->tasks[deque->head++];
+		}
+		found = TRUE;
+	    }
+	    pthread_mutex_unlock(&deque->mutex);
+	    if (found) {
+		pthread_mutex_lock(&pool->mutex);
+		pool->nqueued--;
+		pthread_mutex_unlock(&pool->mutex);
+		return TRUE;
+	    }
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	if (pool->npending == 0) {
+	    pthread_mutex_unlock(&pool->mutex);
+	    return FALSE;
+	}
+	if (pool->nqueued <= 0) {
+	    pthread_cond_wait(&pool->cond, &pool->mutex);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+static void
+add_task (Pool *pool, gint id, Range *task)
+{
+    Deque *deque = pool->deques + id;
+
+    /*
+     * Count it before it can be stolen and finished.
+     */
+    pthread_mutex_lock(&pool->mutex);
+    pool->npending++;
+    pthread_mutex_unlock(&pool->mutex);
+
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->head == deque->tail) {
+	deque->head = deque->tail = 0;
+    }
+    if (deque->tail == deque->size) {
+	deque->size  = MAX(deque->size * 2, 16);
+	deque->tasks = g_renew(Range, deque->tasks, deque->size);
+    }
+    deque->tasks[deque->tail++] = *task;
+    pthread_mutex_unlock(&deque->mutex);
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->nqueued++;
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+static void
+finish_task (Pool *pool, SaryInt nsorted)
+{
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->progress != NULL) {
+	sary_progress_set_count(pool->progress, 
+				pool->progress->current + nsorted);
+    }
+    pool->npending--;
+    if (pool->npending == 0) {
+	pthread_cond_broadcast(&pool->cond);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/*
+ * No suffix is longer than the text so that its length
+ * plus one stands for no limit.
+ */
+static inline SaryInt
+get_limit (SaryInt limit, const gchar *bof, const gchar *eof)
+{
+    g_assert(limit >= 0);
+    return limit > 0 ? limit : eof - bof + 1;
+}
+
+/*
+ * Push the two larger ones of the three `ranges' onto the
+ * stack and store the smallest one to `next'. Empty ranges
+ * are not pushed.
+ */
+static void
+push_ranges (Range *ranges, Range **sp, Range *next)
+{
+    Range t;
+    gint i, j;
+
+    for (i = 1; i < 3; i++) {
+	for (j = i; j > 0 && ranges[j - 1].len < ranges[j].len; j--) {
+	    t = ranges[j];
+	    ranges[j] = ranges[j - 1];
+	    ranges[j - 1] = t;
+	}
+    }
+    for (i = 0; i < 2; i++) {
+	if (ranges[i].len > 0) {
+	    *(*sp)++ = ranges[i];
+	}
+    }
+    *next = ranges[2];
+}
+
+/*
+ * Partition suffixes into ones smaller than, equal to and
+ * larger than the pivot at `depth' and store them to
+ * `ranges'.
+ */
+static void
+partition (gpointer first,
+	   SaryInt len,
+	   SaryInt depth,
+	   SaryInt limit,
+	   const gchar *bof,
+	   const gchar *eof,
+	   Range *ranges)
+{
+    SaryInt *array = first;
+    SaryInt  a, b, c, d, r, v;
+
+    swap(array, 0, choose_pivot(array, len, depth, bof, eof));
 
     v = ref(bof, array[0], depth, eof);
     a = b = 1;
     c = d = len - 1;
 
     while (1) {
-        while (b <= c && (r = ref(bof, array[b], depth, eof) - v) <= 0) {
-            if (r == 0) {
+	while (b <= c && (r = ref(bof, array[b], depth, eof) - v) <= 0) {
+	    if (r == 0) {
 		swap(array, a, b); 
 		a++;
 	    }
-            b++;
-        }
-        while (b <= c && (r = ref(bof, array[c], depth, eof) - v) >= 0) {
-            if (r == 0) {
+	    b++;
+	}
+	while (b <= c && (r = ref(bof, array[c], depth, eof) - v) >= 0) {
+	    if (r == 0) {
 		swap(array, c, d); 
 		d--;
 	    }
-            c--;
-        }
-        if (b > c) {
+	    c--;
+	}
+	if (b > c) {
 	    break;
 	}
-        swap(array, b, c);
-        b++;
-        c--;
+	swap(array, b, c);
+	b++;
+	c--;
     }
 
     r = MIN(a, b - a);
@@ -113,32 +662,79 @@ sary_multikey_qsort (SaryProgress *progress,
     vecswap(b, len - r, r, array);
 
     r = b - a;
-    sary_multikey_qsort(progress, array, r, depth, bof, eof);
+    ranges[0].first = array;
+    ranges[0].len   = r;
+    ranges[0].depth = depth;
+
+    /*
+     * Suffixes equal to the pivot which reached eof are the
+     * same one and already sorted.
+     */
+    ranges[1].first = array + r;
+    ranges[1].len   = v != EOF ? a + len - d - 1 : 0;
+    ranges[1].depth = depth + 1;
 
-    if (ref(bof, array[r], depth, eof) != EOF) {
-        sary_multikey_qsort(progress, array + r, 
-			    a + len - d - 1, depth + 1, bof, eof);
-    }
     r = d - c;
-    sary_multikey_qsort(progress, array + len - r, r, depth, bof, eof);
+    ranges[2].first = array + len - r;
+    ranges[2].len   = r;
+    ranges[2].depth = depth;
+}
+
+/*
+ * Median-of-3 for small arrays and Tukey's ninther for
+ * large ones.
+ */
+static SaryInt
+choose_pivot (SaryInt *array,
+	      SaryInt len,
+	      SaryInt depth,
+	      const gchar *bof,
+	      const gchar *eof)
+{
+    SaryInt l = 0, m = len / 2, n = len - 1;
+
+    if (len > 40) {
+	SaryInt s = len / 8;
+
+	l = med3(array, l, l + s, l + 2 * s, depth, bof, eof);
+	m = med3(array, m - s, m, m + s, depth, bof, eof);
+	n = med3(array, n - 2 * s, n - s, n, depth, bof, eof);
+    }
+    return med3(array, l, m, n, depth, bof, eof);
+}
+
+static inline SaryInt
+med3 (SaryInt *array, 
+      SaryInt i, 
+      SaryInt j, 
+      SaryInt k, 
+      SaryInt depth,
+      const gchar *bof,
+      const gchar *eof)
+{
+    gint vi = ref(bof, array[i], depth, eof);
+    gint vj = ref(bof, array[j], depth, eof);
+    gint vk = ref(bof, array[k], depth, eof);
+
+    return vi < vj ?
+	(vj < vk ? j : vi < vk ? k : i) :
+	(vj > vk ? j : vi < vk ? i : k);
 }
 
 static void
-insertion_sort(SaryInt *array, gint len, gint depth, 
+insertion_sort(gpointer first, SaryInt len, SaryInt depth, SaryInt limit,
 	       const gchar *bof, const gchar *eof)
 {
+    SaryInt *array = first;
     SaryInt *pi, *pj;
 
     g_assert(len <= 10);
 
     for (pi = array + 1; --len > 0; pi++) {
         for (pj = pi; pj > array; pj--) {
-	    const gchar *s = bof + GINT_FROM_BE(*(pj - 1)) + depth;
-	    const gchar *t = bof + GINT_FROM_BE(*pj) + depth;
-
-	    for (; s < eof && t < eof && *s == *t; s++, t++)
-		;
-	    if (s == eof || (t != eof && (guchar)*s <= (guchar)*t)) {
+	    if (suffixcmp(SARY_INT_FROM_BE(*(pj - 1)), SARY_INT_FROM_BE(*pj),
+			  depth, limit, bof, eof) <= 0) 
+	    {
 		break;
 	    }
 	    swap2(pj, pj - 1);
@@ -146,6 +742,54 @@ insertion_sort(SaryInt *array, gint len, gint depth,
     }
 }
 
+/*
+ * Sort suffixes sharing the first `limit' bytes by their
+ * positions.
+ */
+static void
+sort_ties (gpointer first, SaryInt len)
+{
+    qsort(first, len, sizeof(SaryInt), offsetcmp);
+}
+
+static gint
+offsetcmp (gconstpointer p1, gconstpointer p2)
+{
+    SaryInt offset1 = SARY_INT_FROM_BE(*(const SaryInt *)p1);
+    SaryInt offset2 = SARY_INT_FROM_BE(*(const SaryInt *)p2);
+
+    return offset1 < offset2 ? -1 : offset1 > offset2;
+}
+
+/*
+ * Compare two suffixes from `depth' up to `limit' bytes and
+ * then by their positions.
+ */
+static inline gint
+suffixcmp (SaryInt offset1, 
+	   SaryInt offset2, 
+	   SaryInt depth, 
+	   SaryInt limit,
+	   const gchar *bof, 
+	   const gchar *eof)
+{
+    const gchar *s = bof + offset1 + depth;
+    const gchar *t = bof + offset2 + depth;
+    SaryInt len1 = MIN(eof - bof - offset1, limit) - depth;
+    SaryInt len2 = MIN(eof - bof - offset2, limit) - depth;
+    SaryInt i, len = MIN(len1, len2);
+
+    for (i = 0; i < len && s[i] == t[i]; i++)
+	;
+    if (i < len) {
+	return (guchar)s[i] - (guchar)t[i];
+    } else if (len1 != len2) {
+	return len1 < len2 ? -1 : 1;  /* shorter one is smaller */
+    } else {
+	return offset1 < offset2 ? -1 : offset1 > offset2;
+    }
+}
+
 
 
 static inline void
@@ -176,7 +820,7 @@ ref (const gchar *bof,
      SaryInt depth, 
      const gchar *eof)
 {
-    const gchar *pos = bof + GINT_FROM_BE(offset) + depth;
+    const gchar *pos = bof + SARY_INT_FROM_BE(offset) + depth;
     return pos < eof ? (guchar)*pos : EOF;
 }
 
@@ -189,3 +833,299 @@ swap2 (SaryInt *a, SaryInt *b)
     *b = t;
 }
 
+
+static Suffix *
+new_suffixes (SaryInt *array,
+	      SaryInt len,
+	      SaryInt depth,
+	      SaryInt limit,
+	      const gchar *bof,
+	      const gchar *eof)
+{
+    SaryInt i;
+    Suffix *suffixes;
+
+    suffixes = g_new(Suffix, len);
+    for (i = 0; i < len; i++) {
+	suffixes[i].offset = SARY_INT_FROM_BE(array[i]);
+    }
+    load_keys(suffixes, len, depth, limit, bof, eof);
+
+    return suffixes;
+}
+
+/*
+ * Store the sorted offsets back to `array' and free
+ * `suffixes'.
+ */
+static void
+destroy_suffixes (Suffix *suffixes, SaryInt *array, SaryInt len)
+{
+    SaryInt i;
+
+    for (i = 0; i < len; i++) {
+	array[i] = SARY_INT_TO_BE(suffixes[i].offset);
+    }
+    g_free(suffixes);
+}
+
+static void
+cached_partition (gpointer first,
+		  SaryInt len,
+		  SaryInt depth,
+		  SaryInt limit,
+		  const gchar *bof,
+		  const gchar *eof,
+		  Range *ranges)
+{
+    Suffix *suffixes = first;
+    SaryInt a, b, c, d, r;
+    Suffix v;
+    gint cmp;
+
+    swap_suffix(suffixes, 
+		suffixes + cached_choose_pivot(suffixes, len, depth, 
+					       limit, bof, eof));
+
+    v = suffixes[0];
+    a = b = 1;
+    c = d = len - 1;
+
+    while (1) {
+	while (b <= c && 
+	       (cmp = keycmp(suffixes + b, &v, depth, limit, bof, eof)) <= 0) 
+	{
+	    if (cmp == 0) {
+		swap_suffix(suffixes + a, suffixes + b);
+		a++;
+	    }
+	    b++;
+	}
+	while (b <= c && 
+	       (cmp = keycmp(suffixes + c, &v, depth, limit, bof, eof)) >= 0) 
+	{
+	    if (cmp == 0) {
+		swap_suffix(suffixes + c, suffixes + d);
+		d--;
+	    }
+	    c--;
+	}
+	if (b > c) {
+	    break;
+	}
+	swap_suffix(suffixes + b, suffixes + c);
+	b++;
+	c--;
+    }
+
+    r = MIN(a, b - a);
+    vecswap_suffix(suffixes, suffixes + b - r, r);
+
+    r = MIN(d - c, len - d - 1);
+    vecswap_suffix(suffixes + b, suffixes + len - r, r);
+
+    r = b - a;
+    ranges[0].first = suffixes;
+    ranges[0].len   = r;
+    ranges[0].depth = depth;
+
+    /*
+     * Suffixes with equal keys which end before KEY_LEN and
+     * `limit' are the same suffix. Otherwise load the next
+     * keys unless they reach the limit and tie.
+     */
+    ranges[1].first = suffixes + r;
+    ranges[1].len   = 0;
+    ranges[1].depth = depth + KEY_LEN;
+    r = keylen(&v, depth, limit, bof, eof);
+    if (r == KEY_LEN || depth + r == limit) {
+	ranges[1].len = a + len - d - 1;
+	if (ranges[1].depth < limit) {
+	    load_keys(ranges[1].first, ranges[1].len, 
+		      ranges[1].depth, limit, bof, eof);
+	}
+    }
+
+    r = d - c;
+    ranges[2].first = suffixes + len - r;
+    ranges[2].len   = r;
+    ranges[2].depth = depth;
+}
+
+static void
+cached_insertion_sort (gpointer first, 
+		       SaryInt len, 
+		       SaryInt depth, 
+		       SaryInt limit,
+		       const gchar *bof, 
+		       const gchar *eof)
+{
+    Suffix *suffixes = first;
+    Suffix *pi, *pj;
+
+    g_assert(len <= 10);
+
+    for (pi = suffixes + 1; --len > 0; pi++) {
+	for (pj = pi; pj > suffixes; pj--) {
+	    gint cmp = keycmp(pj - 1, pj, depth, limit, bof, eof);
+
+	    /*
+	     * Equal keys are compared further from where they
+	     * end, which compares the positions at the limit.
+	     */
+	    if (cmp == 0) {
+		cmp = suffixcmp((pj - 1)->offset, pj->offset, 
+				depth + keylen(pj, depth, limit, bof, eof),
+				limit, bof, eof);
+	    }
+	    if (cmp <= 0) {
+		break;
+	    }
+	    swap_suffix(pj, pj - 1);
+	}
+    }
+}
+
+static void
+cached_sort_ties (gpointer first, SaryInt len)
+{
+    qsort(first, len, sizeof(Suffix), cached_offsetcmp);
+}
+
+static gint
+cached_offsetcmp (gconstpointer p1, gconstpointer p2)
+{
+    SaryInt offset1 = ((const Suffix *)p1)->offset;
+    SaryInt offset2 = ((const Suffix *)p2)->offset;
+
+    return offset1 < offset2 ? -1 : offset1 > offset2;
+}
+
+static SaryInt
+cached_choose_pivot (Suffix *suffixes,
+		     SaryInt len,
+		     SaryInt depth,
+		     SaryInt limit,
+		     const gchar *bof,
+		     const gchar *eof)
+{
+    SaryInt l = 0, m = len / 2, n = len - 1;
+
+    if (len > 40) {
+	SaryInt s = len / 8;
+
+	l = cached_med3(suffixes, l, l + s, l + 2 * s, 
+			depth, limit, bof, eof);
+	m = cached_med3(suffixes, m - s, m, m + s, 
+			depth, limit, bof, eof);
+	n = cached_med3(suffixes, n - 2 * s, n - s, n, 
+			depth, limit, bof, eof);
+    }
+    return cached_med3(suffixes, l, m, n, depth, limit, bof, eof);
+}
+
+static inline SaryInt
+cached_med3 (Suffix *suffixes,
+	     SaryInt i,
+	     SaryInt j,
+	     SaryInt k,
+	     SaryInt depth,
+	     SaryInt limit,
+	     const gchar *bof,
+	     const gchar *eof)
+{
+    Suffix *si = suffixes + i, *sj = suffixes + j, *sk = suffixes + k;
+
+    return keycmp(si, sj, depth, limit, bof, eof) < 0 ?
+	(keycmp(sj, sk, depth, limit, bof, eof) < 0 ? j : 
+	 keycmp(si, sk, depth, limit, bof, eof) < 0 ? k : i) :
+	(keycmp(sj, sk, depth, limit, bof, eof) > 0 ? j : 
+	 keycmp(si, sk, depth, limit, bof, eof) < 0 ? i : k);
+}
+
+/*
+ * Bytes beyond `limit' are padding as well as the ones
+ * beyond eof.
+ */
+static void
+load_keys (Suffix *suffixes,
+	   SaryInt len,
+	   SaryInt depth,
+	   SaryInt limit,
+	   const gchar *bof,
+	   const gchar *eof)
+{
+    SaryInt i;
+
+    for (i = 0; i < len; i++) {
+	const gchar *pos = bof + suffixes[i].offset + depth;
+	SaryInt rest = MIN(eof - pos, limit - depth);
+	guint64 key = 0;
+
+	if (rest >= KEY_LEN) {
+	    memcpy(&key, pos, KEY_LEN);
+	    key = GUINT64_FROM_BE(key);
+	} else {
+	    gint j;
+
+	    for (j = 0; j < KEY_LEN; j++) {
+		key <<= 8;
+		if (j < rest) {
+		    key |= (guchar)pos[j];
+		}
+	    }
+	}
+	suffixes[i].key = key;
+    }
+}
+
+/*
+ * Return the number of bytes in the key which are not
+ * padding.
+ */
+static inline gint
+keylen (const Suffix *suffix, 
+	SaryInt depth, 
+	SaryInt limit,
+	const gchar *bof, 
+	const gchar *eof)
+{
+    SaryInt rest = MIN(eof - bof - suffix->offset, limit) - depth;
+
+    return rest < KEY_LEN ? MAX(rest, 0) : KEY_LEN;
+}
+
+/*
+ * Compare keys. A key shorter than the other one is smaller
+ * if they are equal in padded form since it is a prefix.
+ */
+static inline gint
+keycmp (const Suffix *s1, 
+	const Suffix *s2, 
+	SaryInt depth, 
+	SaryInt limit,
+	const gchar *bof, 
+	const gchar *eof)
+{
+    if (s1->key != s2->key) {
+	return s1->key < s2->key ? -1 : 1;
+    }
+    return keylen(s1, depth, limit, bof, eof) - 
+	keylen(s2, depth, limit, bof, eof);
+}
+
+static inline void
+swap_suffix (Suffix *a, Suffix *b)
+{
+    Suffix t = *a;
+    *a = *b;
+    *b = t;
+}
+
+static inline void
+vecswap_suffix (Suffix *a, Suffix *b, SaryInt n)
+{
+    while (n-- > 0) {
+	swap_suffix(a++, b++);
+    }
+}
@@ -14,6 +14,16 @@ void	sary_multikey_qsort (SaryProgress *progress,
 			     SaryInt depth,
 			     const gchar *bof,
 			     const gchar *eof);
+void	sary_multikey_qsort_bounded 
+			    (SaryProgress *progress,
+			     SaryInt *array,
+			     SaryInt len,
+			     SaryInt depth,
+			     SaryInt limit,
+			     const gchar *bof,
+			     const gchar *eof,
+			     gboolean cached,
+			     gint nthreads);
 
 #ifdef __cplusplus
 }
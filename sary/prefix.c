@@ -0,0 +1,383 @@
+/*
+ * sary - a suffix array library
+ *
+ * $Id$
+ *
+ * Copyright (C) 2000  Satoru Takabayashi <satoru@namazu.org>
+ * All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <glib.h>
+#include <sary.h>
+#include <sary/bytes.h>
+
+/*
+ * Prefix file, a sidecar of an array file (all numbers in
+ * big endian):
+ *
+ *   0  8  magic "\211SPFX\r\n\032"
+ *   8  4  version
+ *  12  4  length of the header
+ *  16  8  number of index points
+ *  24  4  depth of sorting of the array, 0 if full
+ *  28  4  number of bytes of a prefix, from 1 to 3
+ *  32     8 byte start of each bucket and the number of
+ *	   index points at last
+ *
+ * Suffixes fall into buckets by their first bytes, where
+ * the end of the text counts as a symbol smaller than any
+ * byte, and a bucket is numbered in base 257 as bucket.c
+ * does. The buckets are in the order of the array and the
+ * i-th one holds the index points from the i-th start to
+ * the (i+1)-th start exclusive.
+ */
+
+enum {
+    PREFIX_VERSION     = 1,
+    PREFIX_HEADER_SIZE = 32,
+    PREFIX_MAX_NBYTES  = 3,
+    NSYMBOLS	       = 257  /* a byte or eof */
+};
+
+static const gchar magic[8] = "\211SPFX\r\n\032";
+
+struct _SaryPrefix {
+    SaryMmap	*file;
+    guchar	*starts;
+    SaryInt	len;
+    SaryInt	depth;
+    gint	nbytes;
+};
+
+typedef struct {
+    const gchar		*bof;
+    const gchar		*eof;
+    SaryHeader		header;
+    gconstpointer	payload;
+    SaryInt		nipoints;
+    gint		nbytes;
+} Array;
+
+static void		fill_starts	(Array *array,
+					 SaryInt *starts,
+					 SaryInt nbuckets);
+static SaryInt		find_end	(Array *array,
+					 SaryInt first,
+					 SaryInt bucket);
+static inline SaryInt	get_bucket	(Array *array, SaryInt idx);
+static SaryInt		count_buckets	(gint nbytes);
+static gboolean		write_prefix	(Array *array,
+					 SaryInt *starts,
+					 SaryInt nbuckets,
+					 const gchar *prefix_name);
+static SaryInt		get_start	(SaryPrefix *prefix, SaryInt bucket);
+
+
+/*
+ * Write the start of the range of every `nbytes' byte
+ * prefix in the sorted array file `array_name' to
+ * `prefix_name'. A search looks up the range of a short
+ * pattern there and narrows the search of a longer one to
+ * the range of its prefix without probing the array.
+ *
+ * The table has 257 ** nbytes entries of 8 bytes: 2 KB,
+ * 516 KB or 130 MB. `nbytes' is cut down to the depth of
+ * an array sorted to a bounded depth, beyond which the
+ * order of suffixes is that of their positions.
+ */
+gboolean
+sary_prefix_make (SaryText *text,
+		  const gchar *array_name,
+		  const gchar *prefix_name,
+		  gint nbytes)
+{
+    SaryMmap *map;
+    Array array;
+    SaryInt *starts, nbuckets;
+    gboolean result;
+
+    g_assert(nbytes > 0 && nbytes <= PREFIX_MAX_NBYTES);
+
+    map = sary_mmap(array_name, "r");
+    if (map == NULL) {
+	return FALSE;
+    }
+    if (sary_header_read(&array.header, map->map, map->len) == FALSE) {
+	g_warning("%s: unsupported array format", array_name);
+	sary_munmap(map);
+	errno = EINVAL;
+	return FALSE;
+    }
+
+    array.bof	   = sary_text_get_bof(text);
+    array.eof	   = sary_text_get_eof(text);
+    array.payload  = (const gchar *)map->map + array.header.len;
+    array.nipoints = sary_header_count_offsets(&array.header, map->len);
+    array.nbytes   = nbytes;
+    if (array.header.depth > 0 && array.header.depth < nbytes) {
+	array.nbytes = array.header.depth;
+    }
+
+    nbuckets = count_buckets(array.nbytes);
+    starts   = g_new(SaryInt, nbuckets + 1);
+    fill_starts(&array, starts, nbuckets);
+    sary_munmap(map);
+
+    result = write_prefix(&array, starts, nbuckets, prefix_name);
+    g_free(starts);
+
+    return result;
+}
+
+/* The prefix file name. See sary_sidecar_file_name(). */
+gchar *
+sary_prefix_file_name (const gchar *array_name)
+{
+    return sary_sidecar_file_name(array_name, ".pfx");
+}
+
+SaryPrefix *
+sary_prefix_new (const gchar *prefix_name)
+{
+    SaryPrefix *prefix;
+    SaryMmap *file;
+    guchar *p;
+    gint nbytes;
+
+    file = sary_mmap(prefix_name, "r");
+    if (file == NULL) {
+	return NULL;
+    }
+
+    p = file->map;
+    if (file->len < PREFIX_HEADER_SIZE ||
+	memcmp(p, magic, sizeof(magic)) != 0 ||
+	sary_get_uint32(p + 8)  != PREFIX_VERSION ||
+	sary_get_uint32(p + 12) != PREFIX_HEADER_SIZE)
+    {
+	goto broken;
+    }
+    nbytes = sary_get_uint32(p + 28);
+    if (nbytes < 1 || nbytes > PREFIX_MAX_NBYTES ||
+	file->len != PREFIX_HEADER_SIZE + (count_buckets(nbytes) + 1) * 8)
+    {
+	goto broken;
+    }
+
+    prefix = g_new(SaryPrefix, 1);
+    prefix->file   = file;
+    prefix->starts = p + PREFIX_HEADER_SIZE;
+    prefix->len	   = sary_get_uint64(p + 16);
+    prefix->depth  = sary_get_uint32(p + 24);
+    prefix->nbytes = nbytes;
+
+    return prefix;
+
+ broken:
+    g_warning("%s: unsupported prefix format", prefix_name);
+    sary_munmap(file);
+    errno = EINVAL;
+    return NULL;
+}
+
+void
+sary_prefix_destroy (SaryPrefix *prefix)
+{
+    sary_munmap(prefix->file);
+    g_free(prefix);
+}
+
+/*
+ * Return the number of suffixes prefixed with the pattern,
+ * or with its first bytes of the length of a prefix if it
+ * is longer, and store the index of the first one in
+ * `first'.
+ */
+SaryInt
+sary_prefix_lookup (SaryPrefix *prefix,
+		    const gchar *pattern,
+		    SaryInt len,
+		    SaryInt *first)
+{
+    SaryInt low = 0, high = 0;
+    gint i;
+
+    /*
+     * A short pattern spans the buckets from the one
+     * followed by eof to the one followed by 0xff.
+     */
+    for (i = 0; i < prefix->nbytes; i++) {
+	low  *= NSYMBOLS;
+	high *= NSYMBOLS;
+	if (i < len) {
+	    low	 += (guchar)pattern[i] + 1;
+	    high += (guchar)pattern[i] + 1;
+	} else {
+	    high += NSYMBOLS - 1;
+	}
+    }
+
+    *first = get_start(prefix, low);
+    return get_start(prefix, high + 1) - *first;
+}
+
+SaryInt
+sary_prefix_get_len (SaryPrefix *prefix)
+{
+    return prefix->len;
+}
+
+SaryInt
+sary_prefix_get_depth (SaryPrefix *prefix)
+{
+    return prefix->depth;
+}
+
+gint
+sary_prefix_get_nbytes (SaryPrefix *prefix)
+{
+    return prefix->nbytes;
+}
+
+/*
+ * Walk the array bucket by bucket, finding the end of each
+ * one by exponential search, so that the text is read
+ * O(log n) times per bucket present rather than per index
+ * point. Empty buckets start where the next one does.
+ */
+static void
+fill_starts (Array *array, SaryInt *starts, SaryInt nbuckets)
+{
+    SaryInt i = 0, next = 0;
+
+    while (i < array->nipoints) {
+	SaryInt bucket = get_bucket(array, i);
+
+	while (next <= bucket) {
+	    starts[next++] = i;
+	}
+	i = find_end(array, i, bucket);
+    }
+    while (next <= nbuckets) {
+	starts[next++] = array->nipoints;
+    }
+}
+
+/*
+ * Return the index past the last one of `bucket', which
+ * starts at `first'.
+ */
+static SaryInt
+find_end (Array *array, SaryInt first, SaryInt bucket)
+{
+    SaryInt low = first, high = first + 1, step = 1;
+
+    while (high < array->nipoints && get_bucket(array, high) == bucket) {
+	low   = high;
+	step *= 2;
+	high  = low + step;
+    }
+    high = MIN(high, array->nipoints);
+
+    while (low + 1 < high) {
+	SaryInt mid = low + (high - low) / 2;
+
+	if (get_bucket(array, mid) == bucket) {
+	    low = mid;
+	} else {
+	    high = mid;
+	}
+    }
+    return high;
+}
+
+static inline SaryInt
+get_bucket (Array *array, SaryInt idx)
+{
+    const gchar *suffix = array->bof +
+	sary_header_get_offset(&array->header, array->payload, idx);
+    SaryInt bucket = 0;
+    gint i;
+
+    for (i = 0; i < array->nbytes; i++) {
+	bucket *= NSYMBOLS;
+	if (suffix + i < array->eof) {
+	    bucket += (guchar)suffix[i] + 1;
+	}
+    }
+    return bucket;
+}
+
+static SaryInt
+count_buckets (gint nbytes)
+{
+    SaryInt nbuckets = 1;
+
+    while (nbytes-- > 0) {
+	nbuckets *= NSYMBOLS;
+    }
+    return nbuckets;
+}
+
+static gboolean
+write_prefix (Array *array,
+	      SaryInt *starts,
+	      SaryInt nbuckets,
+	      const gchar *prefix_name)
+{
+    FILE *fp;
+    guchar buf[PREFIX_HEADER_SIZE];
+    SaryInt i;
+    gint saved_errno;
+
+    fp = fopen(prefix_name, "wb");
+    if (fp == NULL) {
+	return FALSE;
+    }
+
+    memcpy(buf, magic, sizeof(magic));
+    sary_put_uint32(buf + 8,	 PREFIX_VERSION);
+    sary_put_uint32(buf + 12, PREFIX_HEADER_SIZE);
+    sary_put_uint64(buf + 16, array->nipoints);
+    sary_put_uint32(buf + 24, array->header.depth);
+    sary_put_uint32(buf + 28, array->nbytes);
+    fwrite(buf, 1, PREFIX_HEADER_SIZE, fp);
+
+    for (i = 0; i <= nbuckets; i++) {
+	sary_put_uint64(buf, starts[i]);
+	fwrite(buf, 1, 8, fp);
+    }
+
+    if (ferror(fp)) {
+	saved_errno = errno;
+	fclose(fp);
+	errno = saved_errno;
+	return FALSE;
+    }
+    return fclose(fp) == 0;
+}
+
+static SaryInt
+get_start (SaryPrefix *prefix, SaryInt bucket)
+{
+    return sary_get_uint64(prefix->starts + bucket * 8);
+}
@@ -0,0 +1,33 @@
+#ifndef __SARY_PREFIX_H__
+#define __SARY_PREFIX_H__
+
+#include <glib.h>
+#include <sary/saryconfig.h>
+#include <sary/text.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct _SaryPrefix SaryPrefix;
+
+gboolean	sary_prefix_make	(SaryText *text,
+					 const gchar *array_name,
+					 const gchar *prefix_name,
+					 gint nbytes);
+gchar*		sary_prefix_file_name	(const gchar *array_name);
+SaryPrefix*	sary_prefix_new		(const gchar *prefix_name);
+void		sary_prefix_destroy	(SaryPrefix *prefix);
+SaryInt		sary_prefix_lookup	(SaryPrefix *prefix,
+					 const gchar *pattern,
+					 SaryInt len,
+					 SaryInt *first);
+SaryInt		sary_prefix_get_len	(SaryPrefix *prefix);
+SaryInt		sary_prefix_get_depth	(SaryPrefix *prefix);
+gint		sary_prefix_get_nbytes	(SaryPrefix *prefix);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __SARY_PREFIX_H__ */
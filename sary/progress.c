@@ -43,6 +43,7 @@ sary_progress_new (const gchar *task, SaryInt total)
     progress->task     = g_strdup(task);
     progress->func     = do_nothing;
     progress->func_data   = NULL;
+    progress->message     = NULL;
     progress->is_finished = FALSE;
     progress->start_processer_time =  clock();
     progress->start_time = time(NULL);
@@ -71,6 +72,7 @@ sary_progress_destroy (SaryProgress *progress)
     progress->is_finished = TRUE;
     progress->func(progress);
 
+    g_free(progress->message);
     g_free(progress->task);
     g_free(progress);
 }
@@ -85,6 +87,17 @@ sary_progress_set_count (SaryProgress *progress, SaryInt count)
     progress->previous = count;
 }
 
+/*
+ * Attach a message describing the task, which is shown
+ * to the progress function from the next call.
+ */
+void
+sary_progress_set_message (SaryProgress *progress, const gchar *message)
+{
+    g_free(progress->message);
+    progress->message = g_strdup(message);
+}
+
 static void
 do_nothing (SaryProgress *progress)
 {
@@ -22,6 +22,7 @@ struct _SaryProgress {
     gboolean		is_finished;
     SaryProgressFunc	func;
     gpointer		func_data;
+    gchar		*message;	/* NULL unless set */
 };
 
 SaryProgress*	sary_progress_new	(const gchar *task, 
@@ -35,6 +36,8 @@ void		sary_progress_destroy	(SaryProgress *progress);
 
 void		sary_progress_set_count	(SaryProgress *progress, 
 					 SaryInt count);
+void		sary_progress_set_message	(SaryProgress *progress,
+						 const gchar *message);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,382 @@
+/*
+ * sary - a suffix array library
+ *
+ * $Id$
+ *
+ * Copyright (C) 2000  Satoru Takabayashi <satoru@namazu.org>
+ * All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sary.h>
+
+/*
+ * Prefix Doubling:
+ * N. Jesper Larsson, Kunihiko Sadakane: "Faster Suffix
+ * Sorting," Theoretical Computer Science 387(3), 2007.
+ *
+ * Suffixes sorted by their first h bytes form groups and
+ * each pass sorts every unsorted group by the group number
+ * of the suffix h bytes later, which doubles h. The number
+ * of passes is the logarithm of the longest repeat so that
+ * it is robust against repetitive texts where Multikey
+ * Quicksort goes deep.
+ *
+ * A virtual sentinel, smaller than any byte, is assumed
+ * at eof as sary_sais() does.
+ */
+
+enum {
+    SELECT_SORT_LEN = 7
+};
+
+/*
+ * `sa' holds the suffixes in the order known so far. A run
+ * of sorted suffixes is marked by its negated length at
+ * its head. `rank' is the group number of each suffix,
+ * which is the position of the last suffix of its group
+ * in `sa'. `h' is the length of the prefixes sorted.
+ */
+typedef struct {
+    SaryInt	*sa;
+    SaryInt	*rank;
+    SaryInt	h;
+} Doubling;
+
+static void		sort_full	(Doubling *d,
+					 SaryProgress *progress,
+					 SaryInt nipoints,
+					 const gchar *bof,
+					 SaryInt n);
+static void		sort_split	(Doubling *d,
+					 SaryInt *p,
+					 SaryInt n);
+static void		select_sort_split	(Doubling *d,
+						 SaryInt *p,
+						 SaryInt n);
+static SaryInt		choose_pivot	(Doubling *d,
+					 SaryInt *p,
+					 SaryInt n);
+static void		update_group	(Doubling *d,
+					 SaryInt *first,
+					 SaryInt *last);
+static inline SaryInt	key		(Doubling *d, SaryInt *p);
+static inline SaryInt*	med3		(Doubling *d,
+					 SaryInt *a,
+					 SaryInt *b,
+					 SaryInt *c);
+static inline void	swap		(SaryInt *a, SaryInt *b);
+
+/*
+ * Sort `len' index points in big endian in `array' by
+ * building the suffix array of the whole text and taking
+ * the index points from it in order. Any index points can
+ * be sorted, while it needs memory of 2 * sizeof(SaryInt)
+ * per byte of the text.
+ */
+void
+sary_qsufsort (SaryProgress *progress,
+	       SaryInt *array,
+	       SaryInt len,
+	       const gchar *bof,
+	       const gchar *eof)
+{
+    SaryInt i, j, n = eof - bof;
+    guchar *is_ipoint;
+    Doubling d;
+
+    g_assert(n >= 0 && len <= n + 1);
+    if (len == 0) {
+	return;
+    }
+
+    d.sa   = g_new(SaryInt, n + 1);
+    d.rank = g_new(SaryInt, n + 1);
+    sort_full(&d, progress, len, bof, n);
+
+    /*
+     * Take the index points in the order of the suffix
+     * array. eof, the position of the sentinel, comes first
+     * if it is an index point as sary_ipoint_word() may
+     * return.
+     */
+    is_ipoint = g_new0(guchar, n / 8 + 1);
+    for (i = 0; i < len; i++) {
+	SaryInt pos = SARY_INT_FROM_BE(array[i]);
+
+	is_ipoint[pos / 8] |= 1 << (pos % 8);
+    }
+    for (i = 0, j = 0; i <= n; i++) {
+	SaryInt pos = d.sa[i];
+
+	if (is_ipoint[pos / 8] & (1 << (pos % 8))) {
+	    array[j++] = SARY_INT_TO_BE(pos);
+	}
+    }
+    g_assert(j == len);
+    g_free(is_ipoint);
+
+    g_free(d.rank);
+    g_free(d.sa);
+}
+
+/*
+ * Build the suffix array of n + 1 suffixes including the
+ * sentinel into d->sa.
+ */
+static void
+sort_full (Doubling *d,
+	   SaryProgress *progress,
+	   SaryInt nipoints,
+	   const gchar *bof,
+	   SaryInt n)
+{
+    SaryInt i, c, sl, nsorted, *p;
+    SaryInt *sa = d->sa, *rank = d->rank;
+    SaryInt bkt[257];
+
+    /*
+     * Sort by the first byte with counting sort. The
+     * sentinel is 0 and bytes are shifted by one.
+     */
+    for (c = 0; c < 257; c++) {
+	bkt[c] = 0;
+    }
+    bkt[0] = 1;
+    for (i = 0; i < n; i++) {
+	bkt[(guchar)bof[i] + 1]++;
+    }
+    for (c = 1; c < 257; c++) {
+	bkt[c] += bkt[c - 1];
+    }
+    for (i = 0; i < n; i++) {
+	rank[i] = bkt[(guchar)bof[i] + 1] - 1;
+    }
+    rank[n] = 0;
+    for (i = n; i >= 0; i--) {
+	c = i == n ? 0 : (guchar)bof[i] + 1;
+	sa[--bkt[c]] = i;
+    }
+    for (c = 0; c < 257; c++) {
+	SaryInt first = bkt[c];
+	SaryInt last  = c < 256 ? bkt[c + 1] - 1 : n;
+
+	if (first == last) {
+	    sa[first] = -1;
+	}
+    }
+
+    for (d->h = 1; sa[0] > -(n + 1); d->h *= 2) {
+	p  = sa;
+	sl = 0;
+	nsorted = 0;
+	while (p <= sa + n) {
+	    SaryInt s = *p;
+
+	    if (s < 0) {
+		p  -= s;
+		sl += s;
+		nsorted -= s;
+	    } else {
+		if (sl != 0) {
+		    *(p + sl) = sl;  /* combine sorted runs */
+		    sl = 0;
+		}
+		i = rank[s] + 1;
+		sort_split(d, p, sa + i - p);
+		p = sa + i;
+	    }
+	}
+	if (sl != 0) {
+	    *(p + sl) = sl;
+	}
+
+	if (progress != NULL) {
+	    sary_progress_set_count(progress,
+				    (gdouble)nsorted * nipoints / (n + 1));
+	}
+    }
+
+    for (i = 0; i <= n; i++) {
+	sa[rank[i]] = i;
+    }
+}
+
+/*
+ * Ternary-split Quicksort of a group by key(). The groups
+ * split are updated as soon as they are found, which is
+ * still valid because group numbers only get refined.
+ */
+static void
+sort_split (Doubling *d, SaryInt *p, SaryInt n)
+{
+    SaryInt *pa, *pb, *pc, *pd, *pl, *pm, *pn;
+    SaryInt f, v, s, t;
+
+    if (n < SELECT_SORT_LEN) {
+	select_sort_split(d, p, n);
+	return;
+    }
+
+    v  = choose_pivot(d, p, n);
+    pa = pb = p;
+    pc = pd = p + n - 1;
+    while (1) {
+	while (pb <= pc && (f = key(d, pb)) <= v) {
+	    if (f == v) {
+		swap(pa, pb);
+		pa++;
+	    }
+	    pb++;
+	}
+	while (pc >= pb && (f = key(d, pc)) >= v) {
+	    if (f == v) {
+		swap(pc, pd);
+		pd--;
+	    }
+	    pc--;
+	}
+	if (pb > pc) {
+	    break;
+	}
+	swap(pb, pc);
+	pb++;
+	pc--;
+    }
+
+    /*
+     * Move the ones equal to the pivot to the middle.
+     */
+    pn = p + n;
+    s  = MIN(pa - p, pb - pa);
+    for (pl = p, pm = pb - s; s > 0; s--, pl++, pm++) {
+	swap(pl, pm);
+    }
+    s = MIN(pd - pc, pn - pd - 1);
+    for (pl = pb, pm = pn - s; s > 0; s--, pl++, pm++) {
+	swap(pl, pm);
+    }
+
+    s = pb - pa;
+    t = pd - pc;
+    if (s > 0) {
+	sort_split(d, p, s);
+    }
+    update_group(d, p + s, p + n - t - 1);
+    if (t > 0) {
+	sort_split(d, p + n - t, t);
+    }
+}
+
+/*
+ * Selection sort for small groups, which picks out the
+ * ones with the smallest key at a time.
+ */
+static void
+select_sort_split (Doubling *d, SaryInt *p, SaryInt n)
+{
+    SaryInt *pa, *pb, *pi, *pn;
+    SaryInt f, v;
+
+    pa = p;
+    pn = p + n - 1;
+    while (pa < pn) {
+	f = key(d, pa);
+	for (pi = pb = pa + 1; pi <= pn; pi++) {
+	    v = key(d, pi);
+	    if (v < f) {
+		f = v;
+		swap(pi, pa);
+		pb = pa + 1;
+	    } else if (v == f) {
+		swap(pi, pb);
+		pb++;
+	    }
+	}
+	update_group(d, pa, pb - 1);
+	pa = pb;
+    }
+    if (pa == pn) {
+	d->rank[*pa] = pa - d->sa;
+	*pa = -1;
+    }
+}
+
+static SaryInt
+choose_pivot (Doubling *d, SaryInt *p, SaryInt n)
+{
+    SaryInt *pl = p, *pm = p + n / 2, *pn = p + n - 1;
+
+    if (n > 40) {
+	SaryInt s = n / 8;
+
+	pl = med3(d, pl, pl + s, pl + 2 * s);
+	pm = med3(d, pm - s, pm, pm + s);
+	pn = med3(d, pn - 2 * s, pn - s, pn);
+    }
+    return key(d, med3(d, pl, pm, pn));
+}
+
+/*
+ * Give the suffixes between `first' and `last' the group
+ * number of `last'. A group of one suffix is sorted.
+ */
+static void
+update_group (Doubling *d, SaryInt *first, SaryInt *last)
+{
+    SaryInt g = last - d->sa;
+
+    d->rank[*first] = g;
+    if (first == last) {
+	*first = -1;
+    } else {
+	do {
+	    d->rank[*++first] = g;
+	} while (first < last);
+    }
+}
+
+static inline SaryInt
+key (Doubling *d, SaryInt *p)
+{
+    return d->rank[*p + d->h];
+}
+
+static inline SaryInt *
+med3 (Doubling *d, SaryInt *a, SaryInt *b, SaryInt *c)
+{
+    SaryInt ka = key(d, a), kb = key(d, b), kc = key(d, c);
+
+    if (ka < kb) {
+	return kb < kc ? b : (ka < kc ? c : a);
+    } else {
+	return kb > kc ? b : (ka > kc ? c : a);
+    }
+}
+
+static inline void
+swap (SaryInt *a, SaryInt *b)
+{
+    SaryInt tmp = *a;
+
+    *a = *b;
+    *b = tmp;
+}
@@ -0,0 +1,22 @@
+#ifndef __SARY_QSUFSORT_H__
+#define __SARY_QSUFSORT_H__
+
+#include <glib.h>
+#include <sary/progress.h>
+#include <sary/saryconfig.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+void	sary_qsufsort	(SaryProgress *progress,
+			 SaryInt *array,
+			 SaryInt len,
+			 const gchar *bof,
+			 const gchar *eof);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __SARY_QSUFSORT_H__ */
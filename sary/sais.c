@@ -0,0 +1,330 @@
+/*
+ * sary - a suffix array library
+ *
+ * $Id$
+ *
+ * Copyright (C) 2000  Satoru Takabayashi <satoru@namazu.org>
+ * All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sary.h>
+
+/*
+ * Induced Sorting:
+ * Ge Nong, Sen Zhang, Wai Hong Chan: "Linear Suffix Array
+ * Construction by Almost Pure Induced-Sorting," Proceedings
+ * of the Data Compression Conference, 2009.
+ *
+ * The text has no sentinel character of its own, so a
+ * virtual one, smaller than any byte, is assumed just after
+ * eof.  This yields the same order as sary_multikey_qsort()
+ * where a suffix is smaller than any longer suffix sharing
+ * it as a prefix.
+ *
+ * Characters of the text are guchar. Characters of the
+ * reduced strings in the recursion are SaryInt; `cs' tells
+ * which one is in use.
+ */
+
+static void		sais		(gconstpointer s,
+					 SaryInt *sa,
+					 SaryInt n,
+					 SaryInt k,
+					 gint cs);
+static void		get_buckets	(gconstpointer s,
+					 SaryInt *bkt,
+					 SaryInt n,
+					 SaryInt k,
+					 gint cs,
+					 gboolean end);
+static void		induce_l	(gconstpointer s,
+					 SaryInt *sa,
+					 const guchar *t,
+					 SaryInt *bkt,
+					 SaryInt n,
+					 SaryInt k,
+					 gint cs);
+static void		induce_s	(gconstpointer s,
+					 SaryInt *sa,
+					 const guchar *t,
+					 SaryInt *bkt,
+					 SaryInt n,
+					 SaryInt k,
+					 gint cs);
+static inline SaryInt	chr		(gconstpointer s,
+					 SaryInt i,
+					 gint cs);
+static inline gboolean	is_stype	(const guchar *t, SaryInt i);
+static inline void	set_stype	(guchar *t, SaryInt i);
+static inline gboolean	is_lms		(const guchar *t, SaryInt i);
+
+/*
+ * Construct the suffix array of the whole text between
+ * `bof' and `eof' into `array' which must have room for
+ * eof - bof index points.  The result is stored in big
+ * endian like the one sary_multikey_qsort() produces.
+ */
+void
+sary_sais (SaryInt *array, const gchar *bof, const gchar *eof)
+{
+    SaryInt i, n = eof - bof;
+
+    g_assert(n >= 0);
+    if (n == 0) {
+	return;
+    }
+
+    sais(bof, array, n, 256, sizeof(guchar));
+
+    for (i = 0; i < n; i++) {
+	array[i] = SARY_INT_TO_BE(array[i]);
+    }
+}
+
+static void
+sais (gconstpointer s, SaryInt *sa, SaryInt n, SaryInt k, gint cs)
+{
+    SaryInt i, j, n1, name, prev;
+    SaryInt *bkt, *s1;
+    guchar *t;
+
+    if (n == 1) {
+	sa[0] = 0;
+	return;
+    }
+
+    /*
+     * Classify the suffixes into S-type and L-type. The last
+     * one is always L-type as it is larger than the sentinel.
+     */
+    t = g_new0(guchar, n / 8 + 1);
+    for (i = n - 2; i >= 0; i--) {
+	SaryInt c0 = chr(s, i, cs), c1 = chr(s, i + 1, cs);
+
+	if (c0 < c1 || (c0 == c1 && is_stype(t, i + 1))) {
+	    set_stype(t, i);
+	}
+    }
+
+    /*
+     * Stage 1: sort the LMS-substrings by induction.
+     */
+    bkt = g_new(SaryInt, k);
+    get_buckets(s, bkt, n, k, cs, TRUE);
+    for (i = 0; i < n; i++) {
+	sa[i] = -1;
+    }
+    for (i = n - 1; i >= 1; i--) {
+	if (is_lms(t, i)) {
+	    sa[--bkt[chr(s, i, cs)]] = i;
+	}
+    }
+    induce_l(s, sa, t, bkt, n, k, cs);
+    induce_s(s, sa, t, bkt, n, k, cs);
+
+    /*
+     * Gather the sorted LMS-substrings into the first n1
+     * items and name them. Names are stored at sa[n1 + pos/2]
+     * which never collide because LMS positions are at least
+     * two bytes apart.
+     */
+    for (n1 = 0, i = 0; i < n; i++) {
+	if (is_lms(t, sa[i])) {
+	    sa[n1++] = sa[i];
+	}
+    }
+    for (i = n1; i < n; i++) {
+	sa[i] = -1;
+    }
+    for (name = 0, prev = -1, i = 0; i < n1; i++) {
+	SaryInt d, pos = sa[i];
+	gboolean diff = FALSE;
+
+	for (d = 0; d < n; d++) {
+	    /*
+	     * An LMS-substring reaching the sentinel is unique.
+	     */
+	    if (prev == -1 || pos + d == n || prev + d == n ||
+		chr(s, pos + d, cs) != chr(s, prev + d, cs) ||
+		is_stype(t, pos + d) != is_stype(t, prev + d))
+	    {
+		diff = TRUE;
+		break;
+	    } else if (d > 0 && (is_lms(t, pos + d) || is_lms(t, prev + d))) {
+		break;
+	    }
+	}
+	if (diff) {
+	    name++;
+	    prev = pos;
+	}
+	sa[n1 + pos / 2] = name - 1;
+    }
+    for (i = n - 1, j = n - 1; i >= n1; i--) {
+	if (sa[i] >= 0) {
+	    sa[j--] = sa[i];
+	}
+    }
+
+    /*
+     * Stage 2: sort the reduced string. Recurse unless every
+     * name is unique.
+     */
+    s1 = sa + n - n1;
+    if (name < n1) {
+	sais(s1, sa, n1, name, sizeof(SaryInt));
+    } else {
+	for (i = 0; i < n1; i++) {
+	    sa[s1[i]] = i;
+	}
+    }
+
+    /*
+     * Stage 3: induce the whole suffix array from the sorted
+     * LMS-suffixes.
+     */
+    get_buckets(s, bkt, n, k, cs, TRUE);
+    for (i = 1, j = 0; i < n; i++) {
+	if (is_lms(t, i)) {
+	    s1[j++] = i;
+	}
+    }
+    for (i = 0; i < n1; i++) {
+	sa[i] = s1[sa[i]];
+    }
+    for (i = n1; i < n; i++) {
+	sa[i] = -1;
+    }
+    for (i = n1 - 1; i >= 0; i--) {
+	j = sa[i];
+	sa[i] = -1;
+	sa[--bkt[chr(s, j, cs)]] = j;
+    }
+    induce_l(s, sa, t, bkt, n, k, cs);
+    induce_s(s, sa, t, bkt, n, k, cs);
+
+    g_free(bkt);
+    g_free(t);
+}
+
+/*
+ * Compute the heads (or the ends if `end' is TRUE) of the
+ * buckets for each character.
+ */
+static void
+get_buckets (gconstpointer s,
+	     SaryInt *bkt,
+	     SaryInt n,
+	     SaryInt k,
+	     gint cs,
+	     gboolean end)
+{
+    SaryInt i, sum = 0;
+
+    for (i = 0; i < k; i++) {
+	bkt[i] = 0;
+    }
+    for (i = 0; i < n; i++) {
+	bkt[chr(s, i, cs)]++;
+    }
+    for (i = 0; i < k; i++) {
+	sum += bkt[i];
+	bkt[i] = end ? sum : sum - bkt[i];
+    }
+}
+
+static void
+induce_l (gconstpointer s,
+	  SaryInt *sa,
+	  const guchar *t,
+	  SaryInt *bkt,
+	  SaryInt n,
+	  SaryInt k,
+	  gint cs)
+{
+    SaryInt i, j;
+
+    get_buckets(s, bkt, n, k, cs, FALSE);
+
+    /*
+     * The sentinel is the smallest suffix and it induces the
+     * last suffix first.
+     */
+    sa[bkt[chr(s, n - 1, cs)]++] = n - 1;
+    for (i = 0; i < n; i++) {
+	j = sa[i] - 1;
+	if (sa[i] > 0 && !is_stype(t, j)) {
+	    sa[bkt[chr(s, j, cs)]++] = j;
+	}
+    }
+}
+
+static void
+induce_s (gconstpointer s,
+	  SaryInt *sa,
+	  const guchar *t,
+	  SaryInt *bkt,
+	  SaryInt n,
+	  SaryInt k,
+	  gint cs)
+{
+    SaryInt i, j;
+
+    get_buckets(s, bkt, n, k, cs, TRUE);
+    for (i = n - 1; i >= 0; i--) {
+	j = sa[i] - 1;
+	if (sa[i] > 0 && is_stype(t, j)) {
+	    sa[--bkt[chr(s, j, cs)]] = j;
+	}
+    }
+}
+
+static inline SaryInt
+chr (gconstpointer s, SaryInt i, gint cs)
+{
+    if (cs == sizeof(SaryInt)) {
+	return ((const SaryInt *)s)[i];
+    } else {
+	return ((const guchar *)s)[i];
+    }
+}
+
+static inline gboolean
+is_stype (const guchar *t, SaryInt i)
+{
+    return (t[i / 8] >> (i % 8)) & 1;
+}
+
+static inline void
+set_stype (guchar *t, SaryInt i)
+{
+    t[i / 8] |= 1 << (i % 8);
+}
+
+/*
+ * Leftmost S-type: an S-type suffix preceded by an L-type one.
+ */
+static inline gboolean
+is_lms (const guchar *t, SaryInt i)
+{
+    return i > 0 && is_stype(t, i) && !is_stype(t, i - 1);
+}
@@ -0,0 +1,19 @@
+#ifndef __SARY_SAIS_H__
+#define __SARY_SAIS_H__
+
+#include <glib.h>
+#include <sary/saryconfig.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+void	sary_sais	(SaryInt *array,
+			 const gchar *bof,
+			 const gchar *eof);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __SARY_SAIS_H__ */
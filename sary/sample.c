@@ -0,0 +1,306 @@
+/*
+ * sary - a suffix array library
+ *
+ * $Id$
+ *
+ * Copyright (C) 2000  Satoru Takabayashi <satoru@namazu.org>
+ * All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <glib.h>
+#include <sary.h>
+#include <sary/bytes.h>
+
+/*
+ * Sample file, a sidecar of an array file (all numbers in
+ * big endian):
+ *
+ *   0  8  magic "\211SSMP\r\n\032"
+ *   8  4  version
+ *  12  4  length of the header
+ *  16  8  number of index points
+ *  24  4  depth of sorting of the array, 0 if full
+ *  28  4  length of a key, from 1 to 255
+ *  32  8  interval of the samples
+ *  40     samples
+ *
+ * The i-th sample is the (i * interval)-th suffix of the
+ * array cut to the length of a key: a byte of its length,
+ * shorter only at the end of the text, and the key padded
+ * with 0. Unlike the other sidecars, the file is read into
+ * memory as a whole, so that a search is narrowed down
+ * between two samples without touching the array or the
+ * text.
+ */
+
+enum {
+    SAMPLE_VERSION     = 1,
+    SAMPLE_HEADER_SIZE = 40,
+    SAMPLE_KEY_LEN     = 15,  /* a sample takes 16 bytes */
+    SAMPLE_MAX_KEY_LEN = 255
+};
+
+static const gchar magic[8] = "\211SSMP\r\n\032";
+
+struct _SarySample {
+    guchar	*samples;
+    SaryInt	count;
+    SaryInt	interval;
+    SaryInt	len;
+    SaryInt	depth;
+    gint	key_len;
+};
+
+static gboolean		write_sample	(SaryText *text,
+					 SaryHeader *header,
+					 gconstpointer payload,
+					 SaryInt nipoints,
+					 SaryInt interval,
+					 const gchar *sample_name);
+static guint64		count_samples	(guint64 nipoints,
+					 guint64 interval);
+
+
+/*
+ * Write every `interval'-th suffix of the sorted array file
+ * `array_name' with its first bytes to `sample_name'. The
+ * file takes 16 bytes per sample, 1/8 byte per index point
+ * with an interval of 128. The keys are cut down to the
+ * depth of a bounded array as in sary_prefix_make().
+ */
+gboolean
+sary_sample_make (SaryText *text,
+		  const gchar *array_name,
+		  const gchar *sample_name,
+		  SaryInt interval)
+{
+    SaryMmap *map;
+    SaryHeader header;
+    SaryInt nipoints;
+    gboolean result;
+
+    g_assert(interval > 0);
+
+    map = sary_mmap(array_name, "r");
+    if (map == NULL) {
+	return FALSE;
+    }
+    if (sary_header_read(&header, map->map, map->len) == FALSE) {
+	g_warning("%s: unsupported array format", array_name);
+	sary_munmap(map);
+	errno = EINVAL;
+	return FALSE;
+    }
+
+    nipoints = sary_header_count_offsets(&header, map->len);
+    result   = write_sample(text, &header,
+			    (const gchar *)map->map + header.len,
+			    nipoints, interval, sample_name);
+    sary_munmap(map);
+
+    return result;
+}
+
+/* The sample file name. See sary_sidecar_file_name(). */
+gchar *
+sary_sample_file_name (const gchar *array_name)
+{
+    return sary_sidecar_file_name(array_name, ".smp");
+}
+
+SarySample *
+sary_sample_new (const gchar *sample_name)
+{
+    SarySample *sample;
+    FILE *fp;
+    guchar buf[SAMPLE_HEADER_SIZE];
+    guchar *samples = NULL;
+    guint64 len, interval, count;
+    gint key_len;
+
+    fp = fopen(sample_name, "rb");
+    if (fp == NULL) {
+	return NULL;
+    }
+
+    if (fread(buf, 1, SAMPLE_HEADER_SIZE, fp) != SAMPLE_HEADER_SIZE ||
+	memcmp(buf, magic, sizeof(magic)) != 0 ||
+	sary_get_uint32(buf + 8)  != SAMPLE_VERSION ||
+	sary_get_uint32(buf + 12) != SAMPLE_HEADER_SIZE)
+    {
+	goto broken;
+    }
+    len	     = sary_get_uint64(buf + 16);
+    key_len  = sary_get_uint32(buf + 28);
+    interval = sary_get_uint64(buf + 32);
+    if (key_len < 1 || key_len > SAMPLE_MAX_KEY_LEN ||
+	interval < 1 || len > SARY_INT_MAX || interval > SARY_INT_MAX)
+    {
+	goto broken;
+    }
+
+    count = count_samples(len, interval);
+    if (count > SARY_INT_MAX || count > (gsize)-1 / (key_len + 1)) {
+	goto broken;
+    }
+    samples = g_malloc(MAX(count, 1) * (key_len + 1));
+    if (fread(samples, key_len + 1, count, fp) != count ||
+	getc(fp) != EOF)
+    {
+	goto broken;
+    }
+    fclose(fp);
+
+    sample = g_new(SarySample, 1);
+    sample->samples  = samples;
+    sample->count    = count;
+    sample->interval = interval;
+    sample->len	     = len;
+    sample->depth    = sary_get_uint32(buf + 24);
+    sample->key_len  = key_len;
+
+    return sample;
+
+ broken:
+    g_warning("%s: unsupported sample format", sample_name);
+    g_free(samples);
+    fclose(fp);
+    errno = EINVAL;
+    return NULL;
+}
+
+void
+sary_sample_destroy (SarySample *sample)
+{
+    g_free(sample->samples);
+    g_free(sample);
+}
+
+/*
+ * Return the key of the idx-th sample, the first bytes of
+ * the (idx * interval)-th suffix, and store its length in
+ * `len'.
+ */
+const gchar *
+sary_sample_get_key (SarySample *sample, SaryInt idx, SaryInt *len)
+{
+    guchar *p;
+
+    g_assert(idx >= 0 && idx < sample->count);
+
+    p = sample->samples + idx * (sample->key_len + 1);
+    *len = p[0];
+    return (const gchar *)p + 1;
+}
+
+SaryInt
+sary_sample_get_count (SarySample *sample)
+{
+    return sample->count;
+}
+
+SaryInt
+sary_sample_get_interval (SarySample *sample)
+{
+    return sample->interval;
+}
+
+SaryInt
+sary_sample_get_len (SarySample *sample)
+{
+    return sample->len;
+}
+
+SaryInt
+sary_sample_get_depth (SarySample *sample)
+{
+    return sample->depth;
+}
+
+gint
+sary_sample_get_key_len (SarySample *sample)
+{
+    return sample->key_len;
+}
+
+static gboolean
+write_sample (SaryText *text,
+	      SaryHeader *header,
+	      gconstpointer payload,
+	      SaryInt nipoints,
+	      SaryInt interval,
+	      const gchar *sample_name)
+{
+    FILE *fp;
+    guchar buf[SAMPLE_HEADER_SIZE];
+    const gchar *bof = sary_text_get_bof(text);
+    const gchar *eof = sary_text_get_eof(text);
+    SaryInt key_len = SAMPLE_KEY_LEN;
+    guint64 i;
+    gint saved_errno;
+
+    fp = fopen(sample_name, "wb");
+    if (fp == NULL) {
+	return FALSE;
+    }
+
+    if (header->depth > 0 && header->depth < key_len) {
+	key_len = header->depth;
+    }
+    memcpy(buf, magic, sizeof(magic));
+    sary_put_uint32(buf + 8,	 SAMPLE_VERSION);
+    sary_put_uint32(buf + 12, SAMPLE_HEADER_SIZE);
+    sary_put_uint64(buf + 16, nipoints);
+    sary_put_uint32(buf + 24, header->depth);
+    sary_put_uint32(buf + 28, key_len);
+    sary_put_uint64(buf + 32, interval);
+    fwrite(buf, 1, SAMPLE_HEADER_SIZE, fp);
+
+    for (i = 0; i < (guint64)nipoints; i += interval) {
+	const gchar *suffix = bof +
+	    sary_header_get_offset(header, payload, (SaryInt)i);
+	SaryInt len = MIN(key_len, eof - suffix);
+
+	memset(buf, 0, key_len + 1);
+	buf[0] = len;
+	memcpy(buf + 1, suffix, len);
+	fwrite(buf, 1, key_len + 1, fp);
+    }
+
+    if (ferror(fp)) {
+	saved_errno = errno;
+	fclose(fp);
+	errno = saved_errno;
+	return FALSE;
+    }
+    return fclose(fp) == 0;
+}
+
+/*
+ * Count in 64 bits so that a header with an interval near
+ * SARY_INT_MAX does not overflow.
+ */
+static guint64
+count_samples (guint64 nipoints, guint64 interval)
+{
+    return (nipoints + interval - 1) / interval;
+}
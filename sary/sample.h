@@ -0,0 +1,34 @@
+#ifndef __SARY_SAMPLE_H__
+#define __SARY_SAMPLE_H__
+
+#include <glib.h>
+#include <sary/saryconfig.h>
+#include <sary/text.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct _SarySample SarySample;
+
+gboolean	sary_sample_make	(SaryText *text,
+					 const gchar *array_name,
+					 const gchar *sample_name,
+					 SaryInt interval);
+gchar*		sary_sample_file_name	(const gchar *array_name);
+SarySample*	sary_sample_new		(const gchar *sample_name);
+void		sary_sample_destroy	(SarySample *sample);
+const gchar*	sary_sample_get_key	(SarySample *sample,
+					 SaryInt idx,
+					 SaryInt *len);
+SaryInt		sary_sample_get_count	(SarySample *sample);
+SaryInt		sary_sample_get_interval(SarySample *sample);
+SaryInt		sary_sample_get_len	(SarySample *sample);
+SaryInt		sary_sample_get_depth	(SarySample *sample);
+gint		sary_sample_get_key_len	(SarySample *sample);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __SARY_SAMPLE_H__ */
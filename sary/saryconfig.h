@@ -7,11 +7,17 @@ extern "C" {
 
 /*
  * Use SaryInt instead of gint for ease to support 64 bit
- * array in future. Note: GINT_FROM_BE, GINT_TO_BE must also
- * be replaced for 64 bit support.
+ * array.  SaryInt becomes 64 bit with `configure
+ * --enable-large-array' for texts larger than 2 GB. Use
+ * SARY_INT_TO_BE and SARY_INT_FROM_BE instead of GINT_TO_BE
+ * and GINT_FROM_BE for SaryInt.
  */
 typedef int SaryInt;
 
+#define SARY_INT_TO_BE(val)	GINT_TO_BE(val)
+#define SARY_INT_FROM_BE(val)	GINT_FROM_BE(val)
+#define SARY_INT_MAX		G_MAXINT
+
 extern const int sary_major_version;
 extern const int sary_minor_version;
 extern const int sary_micro_version;
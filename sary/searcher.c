@@ -40,19 +40,39 @@ typedef	gboolean	(*SearchFunc) (SarySearcher *searcher,
 				       SaryInt len, 
 				       SaryInt offset,
 				       SaryInt range);
+enum { BATCH_LEN = 64 };
+
+/*
+ * `first', `last' and `cursor' are indices of the array or
+ * of `allocated_data' if `is_allocated' is TRUE.  Offsets in
+ * the array are decoded with the header while the ones in
+ * `allocated_data' are in native byte order. `batch' keeps
+ * packed offsets decoded from the `batch_first'-th one for
+ * sary_searcher_get_next_position().
+ */
 struct _SarySearcher {
     SaryInt     len;    /* number of index points */
     SaryText    *text;
     SaryMmap    *array;
-    SaryInt  	*first;
-    SaryInt     *last;
-    SaryInt     *cursor;
+    SaryHeader	header;
+    gchar	*payload;
+    SaryInt  	first;
+    SaryInt     last;
+    SaryInt     cursor;
     SaryInt	*allocated_data;
     gboolean    is_sorted;
     gboolean    is_allocated;
     SaryPattern	pattern;
     SaryCache	*cache;
+    SaryLcp	*lcp;
+    SaryPrefix	*prefix;
+    SaryChild	*child;
+    SarySample	*sample;
+    SaryFmindex	*fmindex;
     SearchFunc  search;
+    SaryInt	batch[BATCH_LEN];
+    SaryInt	batch_first;
+    SaryInt	batch_len;
 };
 
 typedef gchar* (*SeekFunc)(const gchar *cursor, 
@@ -75,16 +95,96 @@ typedef struct {
     gint  npatterns;
 } Patterns;
 
+/*
+ * Bounds of a binary search and the lengths of the prefix
+ * of the pattern shared with the suffixes at them.
+ */
+typedef struct {
+    SaryInt low;
+    SaryInt high;
+    SaryInt low_match;
+    SaryInt high_match;
+} Bounds;
+
+static inline SaryInt	decode_offset		(SarySearcher *searcher,
+						 SaryInt idx);
+static inline SaryInt	get_offset		(SarySearcher *searcher,
+						 SaryInt idx);
+static void		get_offsets		(SarySearcher *searcher,
+						 SaryInt idx,
+						 SaryInt n,
+						 SaryInt *offsets);
+static SaryInt		get_batched_offset	(SarySearcher *searcher,
+						 SaryInt idx);
+static inline gchar*	get_occurrence		(SarySearcher *searcher,
+						 SaryInt idx);
+static void		append_occurrences	(SarySearcher *searcher,
+						 GArray *occurences);
 static gchar *		peek_next_occurrence	(SarySearcher *searcher);
 static void		init_searcher_states	(SarySearcher *searcher, 
 						 gboolean first_time);
+static SaryLcp*		open_lcp		(SarySearcher *searcher,
+						 const gchar *array_name);
+static SaryPrefix*	open_prefix		(SarySearcher *searcher,
+						 const gchar *array_name);
+static SaryChild*	open_child		(SarySearcher *searcher,
+						 const gchar *array_name);
+static SarySample*	open_sample		(SarySearcher *searcher,
+						 const gchar *array_name);
+static SaryFmindex*	open_fmindex		(SarySearcher *searcher,
+						 const gchar *array_name);
 static gboolean		search 			(SarySearcher *searcher, 
 						 const gchar *pattern, 
 						 SaryInt len, 
 						 SaryInt offset,
 						 SaryInt range);
-static inline gint	bsearchcmp		(gconstpointer searcher_ptr, 
-					 	 gconstpointer obj_ptr);
+static gboolean		bounded_search		(SarySearcher *searcher, 
+						 const gchar *pattern, 
+						 SaryInt len, 
+						 SaryInt offset,
+						 SaryInt range);
+static void		icase_verify		(SarySearcher *searcher,
+						 GArray *occurences,
+						 const gchar *pattern,
+						 SaryInt len);
+static gboolean		narrow			(SarySearcher *searcher,
+						 Bounds *bounds,
+						 SaryLcp *lcp,
+						 gboolean is_last,
+						 Bounds *found);
+static void		sample_narrow		(SarySearcher *searcher,
+						 Bounds *bounds);
+static gboolean		fmindex_search		(SarySearcher *searcher,
+						 const gchar *pattern,
+						 SaryInt len,
+						 SaryInt offset,
+						 SaryInt range);
+static gint		samplecmp		(SarySearcher *searcher,
+						 SaryInt idx,
+						 SaryInt *match);
+static inline gint	patterncmp		(SarySearcher *searcher,
+						 SaryInt idx,
+						 SaryInt *match);
+static gboolean		child_search		(SarySearcher *searcher,
+						 const gchar *pattern,
+						 SaryInt len);
+static SaryInt		get_first_lindex	(SarySearcher *searcher,
+						 SaryInt i,
+						 SaryInt j);
+static SaryInt		get_next_lindex		(SarySearcher *searcher,
+						 SaryInt k,
+						 SaryInt lcp,
+						 SaryInt j);
+static gboolean		find_child		(SarySearcher *searcher,
+						 SaryInt *i,
+						 SaryInt *j,
+						 SaryInt k,
+						 SaryInt lcp,
+						 gint c);
+static gboolean		has_pattern		(SarySearcher *searcher,
+						 SaryInt idx,
+						 SaryInt from,
+						 SaryInt to);
 static inline gint	qsortcmp		(gconstpointer ptr1, 
 						 gconstpointer ptr2);
 static inline gint	qsortscmp		(gconstpointer ptr1,
@@ -105,7 +205,6 @@ static GArray*		icase_search		(SarySearcher *searcher,
 						 GArray *result);
 static gint		expand_letter		(gint *cand, gint c);
 static void		assign_range		(SarySearcher *searcher, 
-						 SaryInt *occurences, 
 						 SaryInt len);
 static gchar*		get_next_region		(SarySearcher *searcher, 
 						 Seeker *seeker,
@@ -150,7 +249,7 @@ saryer_get_next_offset (SarySearcher *searcher)
 	return -1;
     }
 
-    offset = GINT_FROM_BE(*(searcher->cursor));
+    offset = get_offset(searcher, searcher->cursor);
     searcher->cursor++;
 
     return offset;
@@ -171,24 +270,99 @@ SarySearcher *
 sary_searcher_new2 (const gchar *file_name, const gchar *array_name)
 {
     SarySearcher *searcher = g_new(SarySearcher, 1);
+    gint saved_errno;
+    gboolean is_valid;
 
-    searcher->text = sary_text_new(file_name);
+    searcher->array   = NULL;
+    searcher->fmindex = NULL;
+    searcher->text    = sary_text_new(file_name);
     if (searcher->text == NULL) {
-	return NULL;
+	saved_errno = errno;
+	goto failed;
     }
 
-    searcher->array = sary_mmap(array_name, "r");
+    searcher->array   = sary_mmap(array_name, "r");
+    saved_errno	      = errno;
+    searcher->fmindex = open_fmindex(searcher, array_name);
+
     if (searcher->array == NULL) {
-	return NULL;
+	/*
+	 * The FM-index stands for an array removed to save
+	 * space. Offsets are located with it.
+	 */
+	if (searcher->fmindex == NULL) {
+	    goto failed;
+	}
+	sary_header_init(&searcher->header, sizeof(SaryInt) * 8);
+	searcher->payload = NULL;
+	searcher->len	  = sary_fmindex_get_len(searcher->fmindex);
+    } else {
+	is_valid = sary_header_read(&searcher->header, 
+				    searcher->array->map, 
+				    searcher->array->len);
+	/*
+	 * An array with a header of version 2 knows its text.
+	 * Refuse it for another one rather than return wrong
+	 * results.
+	 */
+	if (is_valid && 
+	    sary_header_check_text(&searcher->header, 
+				   searcher->text) == FALSE)
+	{
+	    g_warning("%s: made for another text than %s", 
+		      array_name, file_name);
+	    is_valid = FALSE;
+	}
+	if (is_valid == FALSE) {
+	    saved_errno = EINVAL;
+	    goto failed;
+	}
+	searcher->payload = (gchar *)searcher->array->map + 
+	    searcher->header.len;
+	searcher->len	  = sary_header_count_offsets(&searcher->header, 
+						      searcher->array->len);
+
+	if (searcher->fmindex != NULL && 
+	    (sary_fmindex_get_len(searcher->fmindex) != searcher->len ||
+	     searcher->header.depth != 0))
+	{
+	    sary_fmindex_destroy(searcher->fmindex);
+	    searcher->fmindex = NULL;
+	}
     }
 
-    searcher->len    = searcher->array->len / sizeof(SaryInt);
     searcher->search = search;
+    searcher->batch_first = 0;
+    searcher->batch_len	  = 0;
     searcher->cache  = NULL;
+    searcher->lcp    = NULL;
+    searcher->prefix = NULL;
+    searcher->child  = NULL;
+    searcher->sample = NULL;
+    if (searcher->fmindex == NULL) {  /* the other sidecars */
+	searcher->lcp	 = open_lcp(searcher, array_name);
+	searcher->prefix = open_prefix(searcher, array_name);
+	searcher->child	 = open_child(searcher, array_name);
+	searcher->sample = open_sample(searcher, array_name);
+    }
 
     init_searcher_states(searcher, TRUE);
 
     return searcher;
+
+ failed:
+    if (searcher->fmindex != NULL) {
+	sary_fmindex_destroy(searcher->fmindex);
+    }
+    if (searcher->array != NULL) {
+	sary_munmap(searcher->array);
+    }
+    if (searcher->text != NULL) {
+	sary_text_destroy(searcher->text);
+    }
+    g_free(searcher);
+    errno = saved_errno;
+    return NULL;
 }
 
 void
@@ -196,7 +370,24 @@ sary_searcher_destroy (SarySearcher *searcher)
 {
     sary_text_destroy(searcher->text);
     sary_cache_destroy(searcher->cache);
-    sary_munmap(searcher->array);
+    if (searcher->array != NULL) {
+	sary_munmap(searcher->array);
+    }
+    if (searcher->lcp != NULL) {
+	sary_lcp_destroy(searcher->lcp);
+    }
+    if (searcher->prefix != NULL) {
+	sary_prefix_destroy(searcher->prefix);
+    }
+    if (searcher->child != NULL) {
+	sary_child_destroy(searcher->child);
+    }
+    if (searcher->sample != NULL) {
+	sary_sample_destroy(searcher->sample);
+    }
+    if (searcher->fmindex != NULL) {
+	sary_fmindex_destroy(searcher->fmindex);
+    }
 
     g_free(searcher->allocated_data);
     g_free(searcher);
@@ -247,8 +438,7 @@ sary_searcher_multi_search (SarySearcher *searcher,
                                               pat->patterns[i])) 
         {
             if (sary_searcher_search(searcher, pat->patterns[i])) {
-                SaryInt len = sary_searcher_count_occurrences(searcher);
-		g_array_append_vals(occurences, searcher->first, len);
+		append_occurrences(searcher, occurences);
             }
             first_time = FALSE;
         }
@@ -260,7 +450,7 @@ sary_searcher_multi_search (SarySearcher *searcher,
     } else {
         searcher->is_allocated = TRUE;
         searcher->allocated_data = (SaryInt *)occurences->data;
-        assign_range(searcher, searcher->allocated_data, occurences->len);
+        assign_range(searcher, occurences->len);
         result = TRUE;
     }
     g_array_free(occurences, FALSE); /* don't free the data */
@@ -283,7 +473,7 @@ sary_searcher_isearch (SarySearcher *searcher,
 	offset = 0;
 	range  = searcher->len;
     } else {
-	offset = (gconstpointer)searcher->first - searcher->array->map;
+	offset = searcher->first;
 	range  = sary_searcher_count_occurrences(searcher);
     }
 
@@ -310,6 +500,7 @@ sary_searcher_icase_search2 (SarySearcher *searcher,
     gboolean result;
     GArray *occurences;
     gchar *tmppat;
+    SaryInt depth = searcher->header.depth;
 
     g_assert(len >= 0);
     init_searcher_states(searcher, FALSE);
@@ -321,15 +512,24 @@ sary_searcher_icase_search2 (SarySearcher *searcher,
     tmppat = g_new(gchar, len);  /* for modifications in icase_search. */
     g_memmove(tmppat, pattern, len);
 
+    /*
+     * Beyond the depth of sorting, the occurrences found are
+     * verified with the text instead.
+     */
     occurences = g_array_new(FALSE, FALSE, sizeof(SaryInt));
-    occurences = icase_search(searcher, tmppat, len, 0, occurences);
+    if (depth > 0 && len > depth) {
+	occurences = icase_search(searcher, tmppat, depth, 0, occurences);
+	icase_verify(searcher, occurences, pattern, len);
+    } else {
+	occurences = icase_search(searcher, tmppat, len, 0, occurences);
+    }
 
     if (occurences->len == 0) { /* not found */
 	result = FALSE;
     } else {
 	searcher->is_allocated   = TRUE;
 	searcher->allocated_data = (SaryInt *)occurences->data;
-	assign_range(searcher, searcher->allocated_data, occurences->len);
+	assign_range(searcher, occurences->len);
 	result = TRUE;
     }
 
@@ -481,7 +681,7 @@ sary_searcher_get_next_occurrence (SarySearcher *searcher)
 	return NULL;
     }
 
-    occurrence = sary_i_text(searcher->text, searcher->cursor);
+    occurrence = get_occurrence(searcher, searcher->cursor);
     sary_text_set_cursor(searcher->text, occurrence);
     searcher->cursor++;
 
@@ -497,7 +697,13 @@ sary_searcher_get_next_position (SarySearcher *searcher)
         return -1;
     }
 
-    position =  GINT_FROM_BE(*(searcher->cursor));
+    if (searcher->is_allocated == FALSE && searcher->array != NULL &&
+	searcher->header.width % 8 != 0)
+    {
+	position = get_batched_offset(searcher, searcher->cursor);
+    } else {
+	position = get_offset(searcher, searcher->cursor);
+    }
     searcher->cursor++;
     return position;
 }
@@ -517,13 +723,17 @@ sary_searcher_sort_occurrences (SarySearcher *searcher)
 
     if (searcher->is_allocated == FALSE) {
 	searcher->allocated_data = g_new(SaryInt, len);
-	g_memmove(searcher->allocated_data, 
-		  searcher->first, len * sizeof(SaryInt));
+	get_offsets(searcher, searcher->first, len, 
+		    searcher->allocated_data);
 	searcher->is_allocated = TRUE;
+    } else {
+	g_memmove(searcher->allocated_data,
+		  searcher->allocated_data + searcher->first,
+		  len * sizeof(SaryInt));
     }
 
     qsort(searcher->allocated_data, len, sizeof(SaryInt), qsortcmp);
-    assign_range(searcher, searcher->allocated_data, len);
+    assign_range(searcher, len);
     searcher->is_sorted = TRUE;
 }
 
@@ -534,6 +744,100 @@ sary_searcher_enable_cache (SarySearcher *searcher)
     searcher->search = cache_search;
 }
 
+/*
+ * Decode the idx-th offset in the array. Offsets in the
+ * native byte order are read as they are.
+ */
+static inline SaryInt
+decode_offset (SarySearcher *searcher, SaryInt idx)
+{
+    if (searcher->header.width == sizeof(SaryInt) * 8 &&
+	searcher->header.byte_order == G_BYTE_ORDER)
+    {
+	return ((const SaryInt *)searcher->payload)[idx];
+    } else if (searcher->header.width == sizeof(SaryInt) * 8 &&
+	       searcher->header.byte_order == G_BIG_ENDIAN)
+    {
+	return SARY_INT_FROM_BE(((const SaryInt *)searcher->payload)[idx]);
+    } else {
+	return sary_header_get_offset(&searcher->header, 
+				      searcher->payload, idx);
+    }
+}
+
+static inline SaryInt
+get_offset (SarySearcher *searcher, SaryInt idx)
+{
+    if (searcher->is_allocated) {
+	return searcher->allocated_data[idx];
+    } else if (searcher->array == NULL) {
+	return sary_fmindex_locate(searcher->fmindex, idx);
+    } else {
+	return decode_offset(searcher, idx);
+    }
+}
+
+static inline gchar *
+get_occurrence (SarySearcher *searcher, SaryInt idx)
+{
+    return sary_text_get_bof(searcher->text) + get_offset(searcher, idx);
+}
+
+/*
+ * Copy `n' offsets from the idx-th one to `offsets'. Packed
+ * offsets in the array are decoded in a row much faster
+ * than one by one.
+ */
+static void
+get_offsets (SarySearcher *searcher, 
+	     SaryInt idx, 
+	     SaryInt n, 
+	     SaryInt *offsets)
+{
+    SaryInt i;
+
+    if (searcher->is_allocated == FALSE && searcher->array != NULL &&
+	searcher->header.width % 8 != 0)
+    {
+	sary_header_get_offsets(&searcher->header, searcher->payload,
+				idx, n, offsets);
+    } else {
+	for (i = 0; i < n; i++) {
+	    offsets[i] = get_offset(searcher, idx + i);
+	}
+    }
+}
+
+/*
+ * Return the idx-th offset of a packed array, decoding the
+ * ones following it up to the last occurrence in a batch
+ * for the next calls.
+ */
+static SaryInt
+get_batched_offset (SarySearcher *searcher, SaryInt idx)
+{
+    if (idx < searcher->batch_first || 
+	idx >= searcher->batch_first + searcher->batch_len)
+    {
+	searcher->batch_first = idx;
+	searcher->batch_len   = MIN(BATCH_LEN, searcher->last - idx + 1);
+	sary_header_get_offsets(&searcher->header, searcher->payload,
+				idx, searcher->batch_len, searcher->batch);
+    }
+    return searcher->batch[idx - searcher->batch_first];
+}
+
+static void
+append_occurrences (SarySearcher *searcher, GArray *occurences)
+{
+    SaryInt n = searcher->last - searcher->first + 1;
+    guint len = occurences->len;
+
+    g_array_set_size(occurences, len + n);
+    get_offsets(searcher, searcher->first, n, 
+		(SaryInt *)occurences->data + len);
+}
+
 static gchar *
 peek_next_occurrence (SarySearcher *searcher)
 {
@@ -543,7 +847,7 @@ peek_next_occurrence (SarySearcher *searcher)
 	return NULL;
     }
 
-    occurrence = sary_i_text(searcher->text, searcher->cursor);
+    occurrence = get_occurrence(searcher, searcher->cursor);
     return occurrence;
 }
 
@@ -556,12 +860,150 @@ init_searcher_states (SarySearcher *searcher, gboolean first_time)
     searcher->allocated_data = NULL;
     searcher->is_allocated   = FALSE;
     searcher->is_sorted      = FALSE;
-    searcher->first     = NULL;
-    searcher->last      = NULL;
-    searcher->cursor    = NULL;
+    searcher->first     = 0;
+    searcher->last      = -1;
+    searcher->cursor    = 0;
     searcher->pattern.skip = 0;
 }
 
+/*
+ * The LCP file of the array, if any, speeds up searches.
+ * One left behind by an older array is ignored.
+ */
+static SaryLcp *
+open_lcp (SarySearcher *searcher, const gchar *array_name)
+{
+    gchar *lcp_name = sary_lcp_file_name(array_name);
+    SaryLcp *lcp = sary_lcp_new(lcp_name);
+
+    if (lcp != NULL && (sary_lcp_get_len(lcp) != searcher->len ||
+			sary_lcp_get_depth(lcp) != searcher->header.depth))
+    {
+	sary_lcp_destroy(lcp);
+	lcp = NULL;
+    }
+    g_free(lcp_name);
+    return lcp;
+}
+
+/*
+ * Likewise with the prefix file.
+ */
+static SaryPrefix *
+open_prefix (SarySearcher *searcher, const gchar *array_name)
+{
+    gchar *prefix_name = sary_prefix_file_name(array_name);
+    SaryPrefix *prefix = sary_prefix_new(prefix_name);
+
+    if (prefix != NULL && 
+	(sary_prefix_get_len(prefix) != searcher->len ||
+	 sary_prefix_get_depth(prefix) != searcher->header.depth))
+    {
+	sary_prefix_destroy(prefix);
+	prefix = NULL;
+    }
+    g_free(prefix_name);
+    return prefix;
+}
+
+/*
+ * Likewise with the child file, which needs the LCP file.
+ */
+static SaryChild *
+open_child (SarySearcher *searcher, const gchar *array_name)
+{
+    gchar *child_name = sary_child_file_name(array_name);
+    SaryChild *child = sary_child_new(child_name);
+
+    if (child != NULL && 
+	(searcher->lcp == NULL ||
+	 sary_child_get_len(child) != searcher->len ||
+	 sary_child_get_depth(child) != searcher->header.depth))
+    {
+	sary_child_destroy(child);
+	child = NULL;
+    }
+    g_free(child_name);
+    return child;
+}
+
+/*
+ * Likewise with the sample file, which is read into memory.
+ */
+static SarySample *
+open_sample (SarySearcher *searcher, const gchar *array_name)
+{
+    gchar *sample_name = sary_sample_file_name(array_name);
+    SarySample *sample = sary_sample_new(sample_name);
+
+    if (sample != NULL && 
+	(sary_sample_get_len(sample) != searcher->len ||
+	 sary_sample_get_depth(sample) != searcher->header.depth))
+    {
+	sary_sample_destroy(sample);
+	sample = NULL;
+    }
+    g_free(sample_name);
+    return sample;
+}
+
+/*
+ * Likewise with the FM-index file, which holds the whole
+ * text and may be left without the array.
+ */
+static SaryFmindex *
+open_fmindex (SarySearcher *searcher, const gchar *array_name)
+{
+    gchar *fmindex_name = sary_fmindex_file_name(array_name);
+    SaryFmindex *fmindex = sary_fmindex_new(fmindex_name);
+    SaryInt len = sary_text_get_eof(searcher->text) - 
+	sary_text_get_bof(searcher->text);
+
+    if (fmindex != NULL && sary_fmindex_get_len(fmindex) != len) {
+	sary_fmindex_destroy(fmindex);
+	fmindex = NULL;
+    }
+    g_free(fmindex_name);
+    return fmindex;
+}
+
+/*
+ * Search the first and the last suffixes prefixed with the
+ * pattern in [offset, offset + range). The suffixes there
+ * share the first `pattern.skip' bytes with it.
+ *
+ * As Manber and Myers do, the search keeps the lengths of
+ * the prefix of the pattern matched at its bounds and a
+ * comparison starts after the shorter one, since every
+ * suffix between the bounds shares it. With the LLCP and
+ * RLCP of the LCP file, which hold the lcp of each index
+ * point with the bounds probing it, the search over the
+ * whole array further tells most probes without comparing
+ * and never compares a byte of the pattern twice but for
+ * one per probe, which takes O(m + log n) time.
+ *
+ * The child file, if any, takes the search over the whole
+ * array instead. See child_search().
+ *
+ * The prefix file answers a pattern no longer than its
+ * prefixes and narrows the search of a longer one to the
+ * range of its prefix instead, saving the first probes,
+ * which fault the most pages.
+ *
+ * The sample file, kept in memory, narrows any search down
+ * to the suffixes between two samples before it probes the
+ * array. See sample_narrow().
+ *
+ * The FM-index file, if any, takes every search instead and
+ * finds the suffixes prefixed with the pattern as a whole,
+ * which are those in the range prefixed with it. The other
+ * sidecars are not opened then.
+ *
+ * Reference:
+ * Udi Manber, Gene Myers: "Suffix Arrays: A New Method
+ * for On-Line String Searches," SIAM Journal on
+ * Computing 22(5), 1993.
+ */
 static gboolean
 search (SarySearcher *searcher, 
 	const gchar *pattern, 
@@ -569,64 +1011,520 @@ search (SarySearcher *searcher,
 	SaryInt offset,
 	SaryInt range)
 {
-    SaryInt *first, *last;
-    SaryInt next_low, next_high;
+    Bounds bounds, found;
+    SaryLcp *lcp = NULL;
+    SaryInt skip = searcher->pattern.skip;
 
     g_assert(len >= 0);
 
+    if (searcher->fmindex != NULL) {
+	return fmindex_search(searcher, pattern, len, offset, range);
+    }
     if (searcher->array->map == NULL) {  /* 0-length (empty) file */
 	return FALSE;
     }
+    if (searcher->header.depth > 0 && len > searcher->header.depth) {
+	return bounded_search(searcher, pattern, len, offset, range);
+    }
+
+    searcher->pattern.str = (gchar *)pattern;
+    searcher->pattern.len = len;
+
+    /*
+     * LLCP and RLCP follow the bounds of the search over
+     * the whole array only.
+     */
+    if (offset == 0 && range == searcher->len && skip == 0) {
+	if (searcher->child != NULL) {
+	    return child_search(searcher, pattern, len);
+	} else if (searcher->prefix != NULL) {
+	    range = sary_prefix_lookup(searcher->prefix, pattern, len, 
+				       &offset);
+	    skip  = MIN(len, sary_prefix_get_nbytes(searcher->prefix));
+	    if (range == 0) {
+		return FALSE;
+	    } else if (skip == len) {
+		searcher->first  = offset;
+		searcher->last   = offset + range - 1;
+		searcher->cursor = searcher->first;
+		return TRUE;
+	    }
+	} else if (searcher->sample == NULL) {
+	    lcp = searcher->lcp;
+	}
+    }
+
+    bounds.low	      = offset - 1;
+    bounds.high	      = offset + range;
+    bounds.low_match  = skip;
+    bounds.high_match = skip;
+    if (searcher->sample != NULL) {
+	sample_narrow(searcher, &bounds);
+    }
+    if (narrow(searcher, &bounds, lcp, FALSE, &found) == FALSE) {
+	return FALSE;
+    }
+    searcher->first = bounds.high;
+
+    narrow(searcher, &found, lcp, TRUE, NULL);
+    searcher->last   = found.low;
+    searcher->cursor = searcher->first;
+
+    return TRUE;
+}
+
+/*
+ * Narrow the bounds down to adjacent ones, where the high
+ * bound is the first suffix not less than the pattern, or
+ * the low bound is the last one prefixed with it if
+ * `is_last'. Return TRUE if any suffix is prefixed with
+ * the pattern and then store the bounds before the first
+ * such probe in `found'.
+ */
+static gboolean
+narrow (SarySearcher *searcher,
+	Bounds *bounds,
+	SaryLcp *lcp,
+	gboolean is_last,
+	Bounds *found)
+{
+    SaryInt len = searcher->pattern.len;
+    gboolean is_found = FALSE;
+
+    while (bounds->low + 1 != bounds->high) {
+	SaryInt mid = (bounds->low + bounds->high) / 2;
+	SaryInt l = bounds->low_match, r = bounds->high_match;
+	SaryInt match, cmp;
+
+	/*
+	 * The lcp of the middle with the bound sharing more
+	 * of the pattern tells the order unless it is equal.
+	 */
+	if (lcp != NULL && l > r && sary_lcp_get_left(lcp, mid) != l) {
+	    SaryInt llcp = sary_lcp_get_left(lcp, mid);
+
+	    match = MIN(llcp, l);
+	    cmp	  = llcp > l ? (l == len ? 0 : 1) : -1;
+	} else if (lcp != NULL && r > l && 
+		   sary_lcp_get_right(lcp, mid) != r) 
+	{
+	    SaryInt rlcp = sary_lcp_get_right(lcp, mid);
+
+	    match = MIN(rlcp, r);
+	    cmp	  = rlcp > r ? (r == len ? 0 : -1) : 1;
+	} else {
+	    /*
+	     * With the tables, the middle shares the longer
+	     * match here since its lcp with that bound equals it.
+	     */
+	    match = lcp != NULL ? MAX(l, r) : MIN(l, r);
+	    cmp	  = patterncmp(searcher, mid, &match);
+	}
+
+	if (cmp == 0 && found != NULL && is_found == FALSE) {
+	    *found = *bounds;
+	    is_found = TRUE;
+	}
+	if (cmp > 0 || (is_last && cmp == 0)) {
+	    bounds->low	      = mid;
+	    bounds->low_match = match;
+	} else {
+	    bounds->high       = mid;
+	    bounds->high_match = match;
+	}
+    }
+    return is_found;
+}
+
+/*
+ * Narrow the bounds down to the samples in them closest to
+ * the pattern: the last one less than it and the first one
+ * greater. A sample prefixed with the pattern, or whose key
+ * is a prefix of it, tells nothing and is skipped. The
+ * search in memory leaves `interval' suffixes at most
+ * between the bounds unless many of them share the key,
+ * whose offsets are in a page or two of the array.
+ */
+static void
+sample_narrow (SarySearcher *searcher, Bounds *bounds)
+{
+    SaryInt interval = sary_sample_get_interval(searcher->sample);
+    SaryInt first = (bounds->low + interval) / interval;
+    SaryInt end	  = (bounds->high + interval - 1) / interval;
+    SaryInt low, high, match;
+
+    /*
+     * The first sample not less than the pattern.
+     */
+    low = first, high = end;
+    while (low < high) {
+	SaryInt mid = low + (high - low) / 2;
+
+	match = 0;
+	if (samplecmp(searcher, mid, &match) > 0) {
+	    low = mid + 1;
+	} else {
+	    high = mid;
+	}
+    }
+    if (low > first) {
+	match = 0;
+	samplecmp(searcher, low - 1, &match);
+	bounds->low	  = (low - 1) * interval;
+	bounds->low_match = MAX(bounds->low_match, match);
+    }
+
+    /*
+     * The first sample greater than the pattern.
+     */
+    high = end;
+    while (low < high) {
+	SaryInt mid = low + (high - low) / 2;
+
+	match = 0;
+	if (samplecmp(searcher, mid, &match) >= 0) {
+	    low = mid + 1;
+	} else {
+	    high = mid;
+	}
+    }
+    if (low < end) {
+	match = 0;
+	samplecmp(searcher, low, &match);
+	bounds->high	   = low * interval;
+	bounds->high_match = MAX(bounds->high_match, match);
+    }
+}
+
+/*
+ * Search the whole array with the FM-index and keep the
+ * occurrences in the range. As a range searched is that of
+ * a prefix of the pattern, they are usually all of them.
+ */
+static gboolean
+fmindex_search (SarySearcher *searcher,
+		const gchar *pattern,
+		SaryInt len,
+		SaryInt offset,
+		SaryInt range)
+{
+    SaryInt first, count, last;
 
     searcher->pattern.str = (gchar *)pattern;
     searcher->pattern.len = len;
 
-    first = (SaryInt *)sary_bsearch_first(searcher, 
-					  searcher->array->map + offset,
-					  range, sizeof(SaryInt), 
-					  &next_low, &next_high,
-					  bsearchcmp);
-    if (first == NULL) {
+    count = sary_fmindex_search(searcher->fmindex, pattern, len, &first);
+    last  = MIN(first + count, offset + range) - 1;
+    first = MAX(first, offset);
+    if (first > last) {
+	return FALSE;
+    }
+
+    searcher->first  = first;
+    searcher->last   = last;
+    searcher->cursor = first;
+    return TRUE;
+}
+
+/*
+ * Compare the pattern with the key of the idx-th sample as
+ * patterncmp() does, but return 0 as well if the key is a
+ * prefix of the pattern and the suffix goes on beyond it.
+ */
+static gint
+samplecmp (SarySearcher *searcher, SaryInt idx, SaryInt *match)
+{
+    const gchar *pattern = searcher->pattern.str;
+    const gchar *key;
+    SaryInt key_len, len, i = 0;
+
+    key = sary_sample_get_key(searcher->sample, idx, &key_len);
+    len = MIN(searcher->pattern.len, key_len);
+    while (i < len && pattern[i] == key[i]) {
+	i++;
+    }
+    *match = i;
+
+    if (i == searcher->pattern.len) {
+	return 0;
+    } else if (i == key_len) {
+	/* A short key is a suffix ending at the end of the text. */
+	return key_len == sary_sample_get_key_len(searcher->sample) ? 0 : 1;
+    }
+    return (guchar)pattern[i] - (guchar)key[i];
+}
+
+/*
+ * The array is sorted by the first `depth' bytes of
+ * suffixes and then by their positions. Find the suffixes
+ * sharing the first `depth' bytes with the pattern and keep
+ * the ones followed by the rest of it in the text. They are
+ * in the order of their positions.
+ */
+static gboolean
+bounded_search (SarySearcher *searcher, 
+		const gchar *pattern, 
+		SaryInt len, 
+		SaryInt offset,
+		SaryInt range)
+{
+    SaryInt depth = searcher->header.depth;
+    gchar *bof = sary_text_get_bof(searcher->text);
+    gchar *eof = sary_text_get_eof(searcher->text);
+    GArray *occurences;
+    SaryInt i;
+
+    /*
+     * An incremental search beyond the depth has narrowed
+     * the range already.
+     */
+    if (searcher->pattern.skip < depth &&
+	search(searcher, pattern, depth, offset, range) == FALSE) 
+    {
 	return FALSE;
     }
 
-    last  = (SaryInt *)sary_bsearch_last(searcher, 
-					 searcher->array->map + offset, 
-					 range, sizeof(SaryInt),
-					 next_low, next_high,
-					 bsearchcmp);
-    g_assert(last != NULL);
+    occurences = g_array_new(FALSE, FALSE, sizeof(SaryInt));
+    for (i = searcher->first; i <= searcher->last; i++) {
+	SaryInt pos = get_offset(searcher, i);
+
+	if (eof - bof - pos >= len && 
+	    memcmp(bof + pos + depth, pattern + depth, len - depth) == 0) 
+	{
+	    g_array_append_val(occurences, pos);
+	}
+    }
+    searcher->pattern.str = (gchar *)pattern;
+    searcher->pattern.len = len;
 
-    searcher->first   = first;
-    searcher->last    = last;
-    searcher->cursor  = first;
+    g_free(searcher->allocated_data);
+    if (occurences->len == 0) {
+	g_array_free(occurences, TRUE);
+	searcher->allocated_data = NULL;
+	searcher->is_allocated   = FALSE;
+	searcher->first  = 0;
+	searcher->last   = -1;
+	searcher->cursor = 0;
+	return FALSE;
+    }
+    searcher->is_allocated   = TRUE;
+    searcher->allocated_data = (SaryInt *)occurences->data;
+    assign_range(searcher, occurences->len);
+    g_array_free(occurences, FALSE); /* don't free the data */
 
     return TRUE;
 }
 
+/*
+ * Keep the occurrences followed by the rest of the pattern
+ * beyond the depth, ignoring case as icase_search() does.
+ */
+static void
+icase_verify (SarySearcher *searcher, 
+	      GArray *occurences, 
+	      const gchar *pattern, 
+	      SaryInt len)
+{
+    SaryInt depth = searcher->header.depth;
+    gchar *bof = sary_text_get_bof(searcher->text);
+    gchar *eof = sary_text_get_eof(searcher->text);
+    SaryInt i, j, n = 0;
+
+    for (i = 0; i < occurences->len; i++) {
+	SaryInt pos = g_array_index(occurences, SaryInt, i);
+
+	if (eof - bof - pos < len) {
+	    continue;
+	}
+	for (j = depth; j < len; j++) {
+	    gint c = (guchar)bof[pos + j];
+	    gint p = (guchar)pattern[j];
+
+	    if (c != p && !(isalpha(p) && 
+			    (c == toupper(p) || c == tolower(p)))) 
+	    {
+		break;
+	    }
+	}
+	if (j == len) {
+	    g_array_index(occurences, SaryInt, n++) = pos;
+	}
+    }
+    g_array_set_size(occurences, n);
+}
+
+/*
+ * Compare the pattern with the idx-th suffix of the array,
+ * which share the first `match' bytes, and set `match' to
+ * the length of their common prefix. A suffix prefixed
+ * with the pattern is equal to it and one ending before
+ * it is less.
+ */
 static inline gint 
-bsearchcmp (gconstpointer sary_searcher_ptr, gconstpointer obj_ptr)
+patterncmp (SarySearcher *searcher, SaryInt idx, SaryInt *match)
 {
-    gint len1, len2, skip;
-    SarySearcher *searcher  = (SarySearcher *)sary_searcher_ptr;
-    gchar *eof  = sary_text_get_eof(searcher->text);
-    gchar *pos = sary_i_text(searcher->text, obj_ptr);
+    const gchar *pattern = searcher->pattern.str;
+    const gchar *bof = sary_text_get_bof(searcher->text);
+    const gchar *eof = sary_text_get_eof(searcher->text);
+    const gchar *pos = bof + decode_offset(searcher, idx);
+    SaryInt len = MIN(searcher->pattern.len, eof - pos);
+    SaryInt i = *match;
+
+    while (i < len && pattern[i] == pos[i]) {
+	i++;
+    }
+    *match = i;
+
+    if (i == searcher->pattern.len) {
+	return 0;
+    } else if (i == len) {
+	return 1;
+    }
+    return (guchar)pattern[i] - (guchar)pos[i];
+}
 
-    skip = searcher->pattern.skip;
-    len1 = searcher->pattern.len - skip;
-    len2 = eof - pos - skip;
-    if (len2 < 0) {
-	len2 = 0;
+/*
+ * Walk down the lcp-intervals from the whole array as down
+ * a suffix tree. An interval is checked against the pattern
+ * up to its lcp with one of its suffixes, and the child
+ * interval following on is chosen by the next byte of the
+ * pattern, so that a search takes O(m) steps of choosing
+ * among at most 257 children, whatever the size of the
+ * array.
+ *
+ * An array sorted to a bounded depth is sorted by position
+ * in an interval of the depth, where the walk never goes
+ * down since a pattern is no longer than the depth here.
+ */
+static gboolean
+child_search (SarySearcher *searcher, const gchar *pattern, SaryInt len)
+{
+    SaryInt i = 0, j = searcher->len - 1, match = 0;
+
+    searcher->pattern.str = (gchar *)pattern;
+    searcher->pattern.len = len;
+
+    if (searcher->len == 0) {
+	return FALSE;
+    }
+    while (i < j) {
+	SaryInt k   = get_first_lindex(searcher, i, j);
+	SaryInt lcp = sary_lcp_get(searcher->lcp, k);
+	SaryInt end = MIN(lcp, len);
+
+	if (has_pattern(searcher, i, match, end) == FALSE) {
+	    return FALSE;
+	}
+	match = end;
+	if (match == len) {
+	    break;
+	}
+	if (find_child(searcher, &i, &j, k, lcp, 
+		       (guchar)pattern[lcp]) == FALSE) 
+	{
+	    return FALSE;
+	}
+    }
+    if (i == j && has_pattern(searcher, i, match, len) == FALSE) {
+	return FALSE;
     }
 
-    return memcmp(searcher->pattern.str + skip, pos + skip, MIN(len1, len2));
+    searcher->first  = i;
+    searcher->last   = j;
+    searcher->cursor = i;
+    return TRUE;
+}
+
+/*
+ * Return the first l-index of the interval [i..j], which
+ * is up[j + 1] if in the interval and down[i] otherwise.
+ */
+static SaryInt
+get_first_lindex (SarySearcher *searcher, SaryInt i, SaryInt j)
+{
+    SaryInt up = sary_child_get(searcher->child, j);
+
+    if (i < up && up <= j) {
+	return up;
+    }
+    return sary_child_get(searcher->child, i);
+}
+
+/*
+ * Return the l-index following k in the interval ending at
+ * j, or -1 if k is the last one. The entry holds down[k]
+ * instead, which has a larger lcp, or 0 if neither.
+ */
+static SaryInt
+get_next_lindex (SarySearcher *searcher, SaryInt k, SaryInt lcp, SaryInt j)
+{
+    SaryInt next = sary_child_get(searcher->child, k);
+
+    if (next > k && next <= j && sary_lcp_get(searcher->lcp, next) == lcp) {
+	return next;
+    }
+    return -1;
+}
+
+/*
+ * Narrow [i..j], an interval of `lcp' with the first
+ * l-index k, to its child whose suffixes have `c' next.
+ * Children are in the order of the byte, after one ending
+ * there if any.
+ */
+static gboolean
+find_child (SarySearcher *searcher,
+	    SaryInt *i,
+	    SaryInt *j,
+	    SaryInt k,
+	    SaryInt lcp,
+	    gint c)
+{
+    const gchar *bof = sary_text_get_bof(searcher->text);
+    const gchar *eof = sary_text_get_eof(searcher->text);
+    SaryInt first = *i;
+
+    for (;;) {
+	SaryInt last = k == -1 ? *j : k - 1;
+	const gchar *pos = bof + decode_offset(searcher, first);
+
+	if (pos + lcp < eof && (guchar)pos[lcp] >= c) {
+	    if ((guchar)pos[lcp] > c) {
+		return FALSE;
+	    }
+	    *i = first;
+	    *j = last;
+	    return TRUE;
+	}
+	if (k == -1) {
+	    return FALSE;
+	}
+	first = k;
+	k = get_next_lindex(searcher, k, lcp, *j);
+    }
+}
+
+/*
+ * Return TRUE if the idx-th suffix of the array has the
+ * bytes of the pattern from `from' to `to' at the same
+ * place.
+ */
+static gboolean
+has_pattern (SarySearcher *searcher, SaryInt idx, SaryInt from, SaryInt to)
+{
+    const gchar *bof = sary_text_get_bof(searcher->text);
+    const gchar *eof = sary_text_get_eof(searcher->text);
+    const gchar *pos = bof + decode_offset(searcher, idx);
+
+    return eof - pos >= to && 
+	memcmp(pos + from, searcher->pattern.str + from, to - from) == 0;
 }
 
 static inline gint 
 qsortcmp (gconstpointer ptr1, gconstpointer ptr2)
 {
-    SaryInt occurrence1 = GINT_FROM_BE(*(SaryInt *)ptr1);
-    SaryInt occurrence2 = GINT_FROM_BE(*(SaryInt *)ptr2);
+    SaryInt occurrence1 = *(SaryInt *)ptr1;
+    SaryInt occurrence2 = *(SaryInt *)ptr2;
 
     if (occurrence1 < occurrence2) {
 	return -1;
@@ -662,9 +1560,14 @@ cache_search (SarySearcher *searcher,
 	return TRUE;
     } else {
 	gboolean result = search(searcher, pattern, len, offset, range);
-	if (result == TRUE) {
+
+	/*
+	 * Occurrences verified by bounded_search() are not
+	 * a range of the array to be cached.
+	 */
+	if (result == TRUE && searcher->is_allocated == FALSE) {
 	    sary_cache_add(searcher->cache, 
-			   sary_i_text(searcher->text, searcher->first), len, 
+			   get_occurrence(searcher, searcher->first), len, 
 			   searcher->first, searcher->last);
 	}
 	return result;
@@ -684,8 +1587,8 @@ icase_search (SarySearcher *searcher,
 
     ncand = expand_letter(cand, (guchar)pattern[step]);
     for (i = 0; i < ncand; i++) {
-	SaryInt *orig_first = searcher->first;
-	SaryInt *orig_last  = searcher->last;
+	SaryInt orig_first = searcher->first;
+	SaryInt orig_last  = searcher->last;
 
 	pattern[step] = cand[i];
 	if (sary_searcher_isearch(searcher, pattern, step + 1)) {
@@ -693,8 +1596,7 @@ icase_search (SarySearcher *searcher,
 		result = icase_search(searcher, pattern,
                                       len, step + 1, result);
 	    } else if (step + 1 == len) {
-		g_array_append_vals(result, searcher->first, 
-				    sary_searcher_count_occurrences(searcher));
+		append_occurrences(searcher, result);
 	    } else {
 		g_assert_not_reached();
 	    }
@@ -725,11 +1627,11 @@ expand_letter (gint *cand, gint c)
 }
 
 static void
-assign_range (SarySearcher *searcher, SaryInt *occurences, SaryInt len)
+assign_range (SarySearcher *searcher, SaryInt len)
 {
-    searcher->first  = occurences;
-    searcher->cursor = occurences;
-    searcher->last   = occurences + len - 1;
+    searcher->first  = 0;
+    searcher->cursor = 0;
+    searcher->last   = len - 1;
 }
 
 static gchar *
@@ -744,7 +1646,7 @@ get_next_region (SarySearcher *searcher, Seeker *seeker, SaryInt *len)
 
     bof    = sary_text_get_bof(searcher->text);
     eof    = sary_text_get_eof(searcher->text);
-    cursor = sary_i_text(searcher->text, searcher->cursor);
+    cursor = get_occurrence(searcher, searcher->cursor);
 
     head   = seeker->seek_backward(cursor, bof, seeker->backward_data);
     tail   = seeker->seek_forward(cursor, eof, seeker->forward_data);
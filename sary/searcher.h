@@ -5,6 +5,7 @@
 #include <sary/mmap.h>
 #include <sary/text.h>
 #include <sary/i.h>
+#include <sary/header.h>
 #include <sary/saryconfig.h>
 
 #ifdef __cplusplus
@@ -20,8 +21,8 @@ typedef struct {
 } SaryPattern;
 
 typedef struct {
-    SaryInt  *first;
-    SaryInt  *last;
+    SaryInt  first;   /* index of the first occurrence */
+    SaryInt  last;    /* index of the last occurrence */
 } SaryResult;
 
 
@@ -48,6 +49,7 @@ gboolean      sary_searcher_multi_search            (SarySearcher *searcher,
                                                      gchar **patterns,
                                                      gint npatterns);
 SaryText*     sary_searcher_get_text                (SarySearcher *searcher);
+/* NULL if the searcher has only an FM-index and no array file */
 SaryMmap*     sary_searcher_get_array               (SarySearcher *searcher);
 SaryInt         saryer_get_next_offset          (SarySearcher *searcher);//patch for polygraph, by @yangke 2015-6-20
 gchar*        sary_searcher_get_next_line           (SarySearcher *searcher);
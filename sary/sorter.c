@@ -42,10 +42,15 @@ typedef struct {
 
 struct _SarySorter {
     SaryMmap*		array;
+    SaryInt*		payload;
     SaryText*		text;
     gchar*		array_name;
     SaryInt		nthreads;
     SaryInt		nipoints;
+    SaryInt		fanin;
+    SaryInt		depth;
+    SarySortEngine	engine;
+    gint		width;
     Blocks*		blocks;
     SaryProgress*	progress;
     SaryProgressFunc	progress_func;
@@ -59,6 +64,8 @@ static Blocks*	new_blocks	(SaryInt *array,
 				 SaryInt nblocks);
 static void	destroy_blocks	(Blocks *blocks);
 static void	sort_block	(SarySorter *sorter);
+static void	sort_buckets	(SarySorter *sorter,
+				 Block *block);
 static Block*	get_next_block	(SarySorter *sorter);
 
 /*
@@ -73,6 +80,7 @@ SarySorter *
 sary_sorter_new (SaryText *text, const gchar *array_name)
 {
     SarySorter *sorter;
+    SaryHeader header;
 
     sorter = g_new(SarySorter, 1);
     sorter->array = sary_mmap(array_name, "r+");
@@ -80,9 +88,30 @@ sary_sorter_new (SaryText *text, const gchar *array_name)
 	return FALSE;
     }
 
+    /*
+     * Index points are sorted in place so that they must be
+     * as wide as SaryInt and in big endian.
+     */
+    if (sary_header_read(&header, sorter->array->map, 
+			 sorter->array->len) == FALSE ||
+	header.width != sizeof(SaryInt) * 8 ||
+	header.byte_order != G_BIG_ENDIAN)
+    {
+	g_warning("%s: unsupported array format", array_name);
+	sary_munmap(sorter->array);
+	g_free(sorter);
+	errno = EINVAL;
+	return NULL;
+    }
+
     sorter->text   = text;
-    sorter->nipoints = sorter->array->len / sizeof(SaryInt);
+    sorter->payload  = (SaryInt *)((gchar *)sorter->array->map + header.len);
+    sorter->nipoints = (sorter->array->len - header.len) / sizeof(SaryInt);
     sorter->nthreads = 1;
+    sorter->fanin    = 0;
+    sorter->depth    = 0;
+    sorter->engine   = SARY_SORT_MKQSORT;
+    sorter->width    = header.width;
     sorter->array_name = g_strdup(array_name);
     sorter->blocks   = NULL;
     sorter->progress = NULL;
@@ -105,17 +134,45 @@ gboolean
 sary_sorter_sort (SarySorter *sorter)
 
 {
+    if (sorter->engine == SARY_SORT_SAIS &&
+	sorter->nipoints != sary_text_get_size(sorter->text)) 
+    {
+	/*
+	 * Induced sorting constructs the suffix array from the
+	 * text alone. It cannot be used unless every byte is
+	 * an index point.
+	 */
+	g_warning("SA-IS requires bytestream index points");
+	errno = EINVAL;
+	return FALSE;
+    }
+
     sorter->progress = sary_progress_new("sort", sorter->nipoints);
     sary_progress_connect(sorter->progress, 
 			  sorter->progress_func, 
 			  sorter->progress_func_data);
 
-    sary_multikey_qsort(sorter->progress,
-			(SaryInt *)sorter->array->map, 
-			sorter->nipoints, 
-			0,
-			sary_text_get_bof(sorter->text),
-			sary_text_get_eof(sorter->text));
+    if (sorter->engine == SARY_SORT_SAIS) {
+	sary_sais(sorter->payload,
+		  sary_text_get_bof(sorter->text),
+		  sary_text_get_eof(sorter->text));
+    } else if (sorter->engine == SARY_SORT_QSUFSORT) {
+	sary_qsufsort(sorter->progress,
+		      sorter->payload, 
+		      sorter->nipoints, 
+		      sary_text_get_bof(sorter->text),
+		      sary_text_get_eof(sorter->text));
+    } else {
+	sary_multikey_qsort_bounded(sorter->progress,
+				    sorter->payload, 
+				    sorter->nipoints, 
+				    0,
+				    sorter->depth,
+				    sary_text_get_bof(sorter->text),
+				    sary_text_get_eof(sorter->text),
+				    sorter->engine == SARY_SORT_MKQSORT_CACHED,
+				    sorter->nthreads);
+    }
 
     sary_progress_destroy(sorter->progress);
 
@@ -130,7 +187,7 @@ sary_sorter_sort_blocks (SarySorter *sorter,
     SaryInt nblocks = calc_nblocks(sorter->nipoints, block_size);
     pthread_t *threads = g_new(pthread_t, sorter->nthreads);
 
-    sorter->blocks  = new_blocks((SaryInt *)sorter->array->map,
+    sorter->blocks  = new_blocks(sorter->payload,
 				 sorter->nipoints, block_size, nblocks);
     sorter->mutex = g_new(pthread_mutex_t, 1);
     pthread_mutex_init(sorter->mutex, NULL);
@@ -140,16 +197,25 @@ sary_sorter_sort_blocks (SarySorter *sorter,
 			  sorter->progress_func, 
 			  sorter->progress_func_data);
 
-    for (i = 0; i < sorter->nthreads; i++) {
-	if (pthread_create(&threads[i], NULL, 
-			   (void *)sort_block, sorter) != 0) 
-	{
-	    g_error("pthread_create: %s", g_strerror(errno));
+    if (nblocks == 1 && sorter->nthreads > 1) {
+	/*
+	 * The whole array fits in a block. Sort it by
+	 * buckets with all threads and the block needs no
+	 * merging.
+	 */
+	sort_buckets(sorter, sorter->blocks->first);
+    } else {
+	for (i = 0; i < sorter->nthreads; i++) {
+	    if (pthread_create(&threads[i], NULL, 
+			       (void *)sort_block, sorter) != 0) 
+	    {
+		g_error("pthread_create: %s", g_strerror(errno));
+	    }
 	}
-    }
 
-    for (i = 0; i < sorter->nthreads; i++) {
-	pthread_join(threads[i], NULL);
+	for (i = 0; i < sorter->nthreads; i++) {
+	    pthread_join(threads[i], NULL);
+	}
     }
     pthread_mutex_destroy(sorter->mutex);
     sary_progress_destroy(sorter->progress);
@@ -170,6 +236,13 @@ sary_sorter_merge_blocks (SarySorter *sorter,
 					array_name,
 					nblocks);
 
+    sary_merger_set_offset_width(merger, sorter->width);
+    sary_merger_set_nthreads(merger, sorter->nthreads);
+    if (sorter->fanin > 0) {
+	sary_merger_set_fanin(merger, sorter->fanin);
+    }
+    sary_merger_set_depth(merger, sorter->depth);
+
     for (i = 0; i < nblocks; i++) {
 	sary_merger_add_block(merger, 
 			      blocks->blocks[i].first, 
@@ -189,6 +262,46 @@ sary_sorter_set_nthreads (SarySorter *sorter, SaryInt nthreads)
     sorter->nthreads = nthreads;
 }
 
+/*
+ * Merge blocks by sary_sorter_merge_blocks() at most
+ * `fanin' at once. See sary_merger_set_fanin().
+ */
+void
+sary_sorter_set_fanin (SarySorter *sorter, SaryInt fanin)
+{
+    g_assert(fanin == 0 || fanin >= 2);
+    sorter->fanin = fanin;
+}
+
+/*
+ * Sort suffixes by their first `depth' bytes and then by
+ * their positions with Multikey Quicksort, which saves
+ * going deep into long repeats. 0, the default, sorts them
+ * fully. SA-IS and prefix doubling always sort them fully.
+ */
+void
+sary_sorter_set_depth (SarySorter *sorter, SaryInt depth)
+{
+    g_assert(depth >= 0);
+    sorter->depth = depth;
+}
+
+void
+sary_sorter_set_engine (SarySorter *sorter, SarySortEngine engine)
+{
+    sorter->engine = engine;
+}
+
+/*
+ * Set the width in bits of offsets written by
+ * sary_sorter_merge_blocks(). See sary_writer_new2().
+ */
+void
+sary_sorter_set_offset_width (SarySorter *sorter, gint width)
+{
+    sorter->width = width;
+}
+
 void
 sary_sorter_connect_progress (SarySorter *sorter,
 			      SaryProgressFunc progress_func,
@@ -249,12 +362,15 @@ sort_block (SarySorter *sorter)
 	 * sorting, mutex lock is necessary for
 	 * sary_progress_set_count() but it't too expensive.
 	 */
-	sary_multikey_qsort(NULL,
-			    block->first,
-			    block->len,
-			    0,
-			    sary_text_get_bof(sorter->text),
-			    sary_text_get_eof(sorter->text));
+	sary_multikey_qsort_bounded(NULL,
+				    block->first,
+				    block->len,
+				    0,
+				    sorter->depth,
+				    sary_text_get_bof(sorter->text),
+				    sary_text_get_eof(sorter->text),
+				    sorter->engine == SARY_SORT_MKQSORT_CACHED,
+				    1);
     
 	pthread_mutex_lock(sorter->mutex);
 	sary_progress_set_count(sorter->progress, 
@@ -263,6 +379,27 @@ sort_block (SarySorter *sorter)
     }
 }
 
+static void
+sort_buckets (SarySorter *sorter, Block *block)
+{
+    if (sorter->engine == SARY_SORT_MKQSORT_CACHED) {
+	sary_bucket_sort_cached(sorter->progress,
+				block->first,
+				block->len,
+				sorter->depth,
+				sary_text_get_bof(sorter->text),
+				sary_text_get_eof(sorter->text),
+				sorter->nthreads);
+    } else {
+	sary_bucket_sort(sorter->progress,
+			 block->first,
+			 block->len,
+			 sorter->depth,
+			 sary_text_get_bof(sorter->text),
+			 sary_text_get_eof(sorter->text),
+			 sorter->nthreads);
+    }
+}
 
 static Block *
 get_next_block (SarySorter *sorter)
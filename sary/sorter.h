@@ -12,6 +12,14 @@ extern "C" {
 
 typedef struct _SarySorter SarySorter;
 
+typedef enum {
+    SARY_SORT_MKQSORT,	/* Multikey Quicksort */
+    SARY_SORT_SAIS,	/* Induced sorting, for bytestream index points */
+    SARY_SORT_MKQSORT_CACHED, /* Multikey Quicksort with cached keys */
+    SARY_SORT_QSUFSORT,	/* Prefix doubling, for repetitive texts */
+    SARY_SORT_AUTO	/* Chosen by SaryBuilder from samples */
+} SarySortEngine;
+
 SarySorter*	sary_sorter_new			(SaryText *text,
 						 const gchar *array_name);
 void		sary_sorter_destroy		(SarySorter *sorter);
@@ -22,6 +30,14 @@ void		sary_sorter_merge_blocks	(SarySorter *sorter,
 						 const gchar *array_name);
 void		sary_sorter_set_nthreads	(SarySorter *sorter,
 						 SaryInt nthreads);
+void		sary_sorter_set_fanin		(SarySorter *sorter,
+						 SaryInt fanin);
+void		sary_sorter_set_depth		(SarySorter *sorter,
+						 SaryInt depth);
+void		sary_sorter_set_engine		(SarySorter *sorter,
+						 SarySortEngine engine);
+void		sary_sorter_set_offset_width	(SarySorter *sorter,
+						 gint width);
 
 void		sary_sorter_connect_progress	(SarySorter *sorter,
 						 SaryProgressFunc 
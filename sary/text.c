@@ -28,6 +28,7 @@
 
 #include "config.h"
 #include <string.h>
+#include <errno.h>
 #include <glib.h>
 #include <sary.h>
 
@@ -44,6 +45,16 @@ sary_text_new (const gchar *file_name)
 	return NULL;
     }
 
+    /*
+     * Offsets to the text must fit in SaryInt. Configure
+     * with --enable-large-array for a larger one.
+     */
+    if (mobj->len > (gsize)SARY_INT_MAX) {
+	sary_munmap(mobj);
+	errno = EFBIG;
+	return NULL;
+    }
+
     /*
      * zero-length (empty) text file can be handled. In that
      * case, text->{bol,eof,cursor} are NULL. Be careful!
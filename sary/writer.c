@@ -25,32 +25,161 @@
 #include "config.h"
 #include <glib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
 #include <sary.h>
 
-enum { BUFSIZE = 1024 * 1024 / sizeof(SaryInt) };  /* 1MB */
+enum { BUFSIZE = 1024 * 1024 };  /* 1MB */
 
+/*
+ * Offsets are stored into one of the two buffers while the
+ * other one is written to the file by a background thread
+ * with pwrite(2). The caller does not wait for the disk
+ * until it fills a buffer before the previous one is done.
+ */
 struct _SaryWriter {
-    FILE*	fp;
-    SaryInt*	buf;
-    SaryInt	buf_idx;
+    gint		fd;
+    off_t		pos;	  /* where buf will be written */
+    SaryHeader		header;
+    gchar*		bufs[2];
+    gchar*		buf;
+    SaryInt		buf_idx;  /* number of offsets in buf */
+    SaryInt		buf_len;
+
+    pthread_t		thread;
+    pthread_mutex_t	mutex;
+    pthread_cond_t	cond;
+    gchar*		pending;  /* buffer handed to the thread */
+    gsize		pending_len;
+    off_t		pending_pos;
+    gint		error;	  /* errno of the failed write */
+    gboolean		is_finished;
 };
 
+static SaryWriter*	writer_new	(const gchar *file_name,
+					 gint flags,
+					 const SaryHeader *header);
+static gboolean		hand_over	(SaryWriter *writer);
+static gboolean		wait_pending	(SaryWriter *writer);
+static void		write_pending	(SaryWriter *writer);
+static gboolean		write_all	(gint fd, 
+					 const gchar *buf, 
+					 gsize len,
+					 off_t pos);
+
+/*
+ * Write offsets as wide as SaryInt. The array can be sorted
+ * by SarySorter as it is.
+ */
 SaryWriter*
 sary_writer_new (const gchar *file_name)
+{
+    return sary_writer_new2(file_name, sizeof(SaryInt) * 8);
+}
+
+/*
+ * Write offsets in `width' bits: 32, 40 or 64, or any width
+ * from 8 to 56 bits to pack them.
+ */
+SaryWriter*
+sary_writer_new2 (const gchar *file_name, gint width)
+{
+    SaryHeader header;
+
+    sary_header_init(&header, width);
+    return sary_writer_new_with_header(file_name, &header);
+}
+
+/*
+ * Write `header' and then offsets in the width of it.
+ */
+SaryWriter*
+sary_writer_new_with_header (const gchar *file_name, 
+			     const SaryHeader *header)
+{
+    SaryWriter *writer;
+
+    writer = writer_new(file_name, O_CREAT | O_TRUNC, header);
+    if (writer == NULL) {
+	return NULL;
+    }
+
+    if (writer->header.len > 0) {
+	sary_header_write(&writer->header, writer->buf);
+	if (write_all(writer->fd, writer->buf, 
+		      writer->header.len, 0) == FALSE) 
+	{
+	    sary_writer_destroy(writer);
+	    return NULL;
+	}
+    }
+    writer->pos = writer->header.len;
+
+    return writer;
+}
+
+/*
+ * Write offsets from the `idx'-th one of an array file
+ * created by sary_writer_new_with_header() with the same
+ * header. Several writers can write distinct ranges of the
+ * file at once, which must start on a byte if packed.
+ */
+SaryWriter*
+sary_writer_new_at (const gchar *file_name, 
+		    const SaryHeader *header, 
+		    SaryInt idx)
+{
+    SaryWriter *writer;
+
+    g_assert((guint64)idx * header->width % 8 == 0);
+    writer = writer_new(file_name, 0, header);
+    if (writer == NULL) {
+	return NULL;
+    }
+
+    writer->pos = writer->header.len + 
+	(off_t)((guint64)idx * header->width / 8);
+
+    return writer;
+}
+
+static SaryWriter *
+writer_new (const gchar *file_name, gint flags, const SaryHeader *header)
 {
     SaryWriter *writer;
 
     g_assert(file_name != NULL);
 
     writer = g_new(SaryWriter, 1);
-    writer->fp = fopen(file_name, "w");
-    if (writer->fp == NULL) {
+    writer->fd = open(file_name, O_WRONLY | flags, 0666);
+    if (writer->fd == -1) {
+	g_free(writer);
 	return NULL;
     }
 
-    writer->buf = g_new(SaryInt, BUFSIZE);
+    writer->header  = *header;
+    writer->pos     = 0;
+    writer->buf_len = BUFSIZE / writer->header.width * 8;  /* whole bytes */
+    writer->bufs[0] = g_new(gchar, BUFSIZE);
+    writer->bufs[1] = g_new(gchar, BUFSIZE);
+    writer->buf     = writer->bufs[0];
     writer->buf_idx = 0;
 
+    writer->pending     = NULL;
+    writer->error       = 0;
+    writer->is_finished = FALSE;
+    pthread_mutex_init(&writer->mutex, NULL);
+    pthread_cond_init(&writer->cond, NULL);
+    if (pthread_create(&writer->thread, NULL, 
+		       (void *)write_pending, writer) != 0) 
+    {
+	g_error("pthread_create: %s", g_strerror(errno));
+    }
+
     return writer;
 }
 
@@ -59,39 +188,161 @@ sary_writer_destroy (SaryWriter *writer)
 {
     g_assert(writer->buf_idx == 0);
 
-    fclose(writer->fp);
-    g_free(writer->buf);
+    pthread_mutex_lock(&writer->mutex);
+    writer->is_finished = TRUE;
+    pthread_cond_broadcast(&writer->cond);
+    pthread_mutex_unlock(&writer->mutex);
+    pthread_join(writer->thread, NULL);
+
+    pthread_mutex_destroy(&writer->mutex);
+    pthread_cond_destroy(&writer->cond);
+    close(writer->fd);
+    g_free(writer->bufs[0]);
+    g_free(writer->bufs[1]);
     g_free(writer);
 }
 
+/*
+ * `data' is an offset in big endian.
+ */
 gboolean
 sary_writer_write (SaryWriter *writer, 
 		   SaryInt data)
 {
-    writer->buf[writer->buf_idx] = data;
+    if (writer->header.width == sizeof(SaryInt) * 8 &&
+	writer->header.byte_order == G_BIG_ENDIAN) 
+    {
+	((SaryInt *)writer->buf)[writer->buf_idx] = data;
+    } else if (writer->header.width == sizeof(SaryInt) * 8 &&
+	       writer->header.byte_order == G_BYTE_ORDER) 
+    {
+	((SaryInt *)writer->buf)[writer->buf_idx] = SARY_INT_FROM_BE(data);
+    } else {
+	if (writer->buf_idx % 8 == 0) {  /* the padding must be 0 */
+	    memset(writer->buf + writer->buf_idx / 8 * writer->header.width,
+		   0, writer->header.width);
+	}
+	sary_header_set_offset(&writer->header, writer->buf, 
+			       writer->buf_idx, SARY_INT_FROM_BE(data));
+    }
     writer->buf_idx++;
 
-    if (writer->buf_idx == BUFSIZE) {
-	if (sary_writer_flush(writer) == FALSE) {
+    if (writer->buf_idx == writer->buf_len) {
+	if (hand_over(writer) == FALSE) {
 	    return FALSE;
 	}
     }
     return TRUE;
 }
 
+/*
+ * Return after all offsets written so far reach the file.
+ * Packed offsets can be written after it only if a multiple
+ * of 8 of them have been written, ending on a byte.
+ */
 gboolean
 sary_writer_flush (SaryWriter *writer)
 {
-    if (writer->buf_idx == 0) {
-	return TRUE;
+    if (writer->buf_idx > 0) {
+	if (hand_over(writer) == FALSE) {
+	    return FALSE;
+	}
     }
+    return wait_pending(writer);
+}
 
-    fwrite(writer->buf, sizeof(SaryInt), writer->buf_idx, writer->fp);
-    if (ferror(writer->fp)) {
-	fclose(writer->fp);
+/*
+ * Pass the current buffer to the thread and switch to the
+ * other one.
+ */
+static gboolean
+hand_over (SaryWriter *writer)
+{
+    if (wait_pending(writer) == FALSE) {
 	return FALSE;
     }
+
+    pthread_mutex_lock(&writer->mutex);
+    writer->pending     = writer->buf;
+    writer->pending_len = 
+	((guint64)writer->buf_idx * writer->header.width + 7) / 8;
+    writer->pending_pos = writer->pos;
+    pthread_cond_broadcast(&writer->cond);
+    pthread_mutex_unlock(&writer->mutex);
+
+    writer->pos    += writer->pending_len;
+    writer->buf     = writer->buf == writer->bufs[0] ? 
+	writer->bufs[1] : writer->bufs[0];
     writer->buf_idx = 0;
+
+    return TRUE;
+}
+
+/*
+ * Wait for the thread to finish the buffer handed over.
+ * errno is set if it has failed.
+ */
+static gboolean
+wait_pending (SaryWriter *writer)
+{
+    gint error;
+
+    pthread_mutex_lock(&writer->mutex);
+    while (writer->pending != NULL) {
+	pthread_cond_wait(&writer->cond, &writer->mutex);
+    }
+    error = writer->error;
+    pthread_mutex_unlock(&writer->mutex);
+
+    if (error != 0) {
+	errno = error;
+	return FALSE;
+    }
     return TRUE;
+}
+
+static void
+write_pending (SaryWriter *writer)
+{
+    pthread_mutex_lock(&writer->mutex);
+    while (1) {
+	while (writer->pending == NULL && !writer->is_finished) {
+	    pthread_cond_wait(&writer->cond, &writer->mutex);
+	}
+	if (writer->pending == NULL) {  /* finished */
+	    break;
+	}
+	pthread_mutex_unlock(&writer->mutex);
+
+	if (writer->error == 0 &&
+	    write_all(writer->fd, writer->pending, 
+		      writer->pending_len, writer->pending_pos) == FALSE) 
+	{
+	    writer->error = errno;
+	}
+
+	pthread_mutex_lock(&writer->mutex);
+	writer->pending = NULL;
+	pthread_cond_broadcast(&writer->cond);
+    }
+    pthread_mutex_unlock(&writer->mutex);
+}
+
+static gboolean
+write_all (gint fd, const gchar *buf, gsize len, off_t pos)
+{
+    while (len > 0) {
+	ssize_t n = pwrite(fd, buf, len, pos);
 
+	if (n == -1) {
+	    if (errno == EINTR) {
+		continue;
+	    }
+	    return FALSE;
+	}
+	buf += n;
+	len -= n;
+	pos += n;
+    }
+    return TRUE;
 }
@@ -3,6 +3,7 @@
 
 #include <glib.h>
 #include <sary/saryconfig.h>
+#include <sary/header.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -11,6 +12,14 @@ extern "C" {
 typedef struct _SaryWriter SaryWriter;
 
 SaryWriter*	sary_writer_new		(const gchar *file_name);
+SaryWriter*	sary_writer_new2	(const gchar *file_name,
+					 gint width);
+SaryWriter*	sary_writer_new_with_header
+					(const gchar *file_name,
+					 const SaryHeader *header);
+SaryWriter*	sary_writer_new_at	(const gchar *file_name,
+					 const SaryHeader *header,
+					 SaryInt idx);
 void		sary_writer_destroy	(SaryWriter *writer);
 gboolean	sary_writer_write	(SaryWriter *writer, SaryInt data);
 gboolean	sary_writer_flush	(SaryWriter *writer);
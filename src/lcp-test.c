@@ -0,0 +1,150 @@
+/*
+ * sary - a suffix array library
+ *
+ * $Id$
+ *
+ * Copyright (C) 2000  Satoru Takabayashi <satoru@namazu.org>
+ * All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Test for the LCP file. Every lcp is compared with the one
+ * counted from the text, and every LLCP and RLCP with the
+ * minimum of the lcp between the bounds.
+ *
+ *  % mksary -p words
+ *  % ./lcp-test words words.ary
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <glib.h>
+#include <errno.h>
+#include <sary.h>
+
+static SaryInt	count_lcp	(const gchar *s1,
+				 const gchar *s2,
+				 const gchar *eof,
+				 SaryInt depth);
+static SaryInt	check_tree	(SaryLcp *lcp,
+				 SaryInt low,
+				 SaryInt high);
+static void	show_usage	(void);
+
+int
+main (int argc, char **argv)
+{
+    SaryText *text;
+    SaryMmap *array;
+    SaryLcp *lcp;
+    SaryHeader header;
+    gchar *lcp_name, *payload, *bof, *eof;
+    SaryInt i, nipoints, prev = 0;
+
+    if (argc != 3) {
+	show_usage();
+	exit(EXIT_FAILURE);
+    }
+
+    text  = sary_text_new(argv[1]);
+    array = sary_mmap(argv[2], "r");
+    lcp_name = sary_lcp_file_name(argv[2]);
+    lcp   = sary_lcp_new(lcp_name);
+    if (text == NULL || array == NULL || lcp == NULL) {
+	g_printerr("lcp-test: %s: %s\n", argv[1], g_strerror(errno));
+	exit(EXIT_FAILURE);
+    }
+    g_assert(sary_header_read(&header, array->map, array->len));
+
+    bof = sary_text_get_bof(text);
+    eof = sary_text_get_eof(text);
+    payload  = (gchar *)array->map + header.len;
+    nipoints = sary_header_count_offsets(&header, array->len);
+    g_assert(sary_lcp_get_len(lcp) == nipoints);
+    g_assert(sary_lcp_get_depth(lcp) == header.depth);
+
+    for (i = 0; i < nipoints; i++) {
+	SaryInt offset = sary_header_get_offset(&header, payload, i);
+	SaryInt expected = i == 0 ? 0 :
+	    count_lcp(bof + prev, bof + offset, eof, header.depth);
+
+	if (sary_lcp_get(lcp, i) != expected) {
+	    g_printerr("lcp-test: %s: lcp[%ld] is %ld, not %ld\n", lcp_name,
+		       (glong)i, (glong)sary_lcp_get(lcp, i), (glong)expected);
+	    exit(EXIT_FAILURE);
+	}
+	prev = offset;
+    }
+    check_tree(lcp, -1, nipoints);
+
+    sary_lcp_destroy(lcp);
+    sary_munmap(array);
+    sary_text_destroy(text);
+    g_free(lcp_name);
+
+    return 0;
+}
+
+static SaryInt
+count_lcp (const gchar *s1, const gchar *s2, const gchar *eof, SaryInt depth)
+{
+    SaryInt len = 0;
+
+    while (s1 + len < eof && s2 + len < eof && s1[len] == s2[len] &&
+	   (depth == 0 || len < depth))
+    {
+	len++;
+    }
+    return len;
+}
+
+/*
+ * Return the minimum of the lcp in (low, high], or 0 if
+ * either bound is virtual.
+ */
+static SaryInt
+check_tree (SaryLcp *lcp, SaryInt low, SaryInt high)
+{
+    SaryInt mid, left, right, len = sary_lcp_get_len(lcp);
+    gboolean is_virtual = low == -1 || high == len;
+
+    if (low + 1 == high) {
+	return is_virtual ? 0 : sary_lcp_get(lcp, high);
+    }
+
+    mid	  = (low + high) / 2;
+    left  = check_tree(lcp, low, mid);
+    right = check_tree(lcp, mid, high);
+    if (sary_lcp_get_left(lcp, mid) != left ||
+	sary_lcp_get_right(lcp, mid) != right)
+    {
+	g_printerr("lcp-test: llcp/rlcp[%ld] is %ld/%ld, not %ld/%ld\n",
+		   (glong)mid, (glong)sary_lcp_get_left(lcp, mid),
+		   (glong)sary_lcp_get_right(lcp, mid),
+		   (glong)left, (glong)right);
+	exit(EXIT_FAILURE);
+    }
+    return is_virtual ? 0 : MIN(left, right);
+}
+
+static void
+show_usage (void)
+{
+    g_print("Usage: lcp-test <file> <array>\n");
+}
@@ -38,6 +38,11 @@ typedef struct {
     SaryIpointFunc	ipoint_func;
 } CodesetFunc;
 
+typedef struct {
+    gchar		*name;
+    SarySortEngine	engine;
+} SortEngine;
+
 typedef void		(*ProcessFunc)	(SaryBuilder *builder,
 					 const gchar *file_name, 
 					 const gchar *array_name);
@@ -56,7 +61,17 @@ CodesetFunc codeset_func_tab[] = {
     { NULL, 		NULL },
 };
 
+SortEngine sort_engine_tab[] = {
+    { "mkqsort",	SARY_SORT_MKQSORT },
+    { "sais",		SARY_SORT_SAIS    },
+    { "cached",		SARY_SORT_MKQSORT_CACHED },
+    { "qsufsort",	SARY_SORT_QSUFSORT },
+    { "auto",		SARY_SORT_AUTO },
+    { NULL,		0 },
+};
+
 static SaryIpointFunc	dispatch_codeset_func	(const gchar *codeset);
+static SarySortEngine	dispatch_sort_engine	(const gchar *name);
 static SaryBuilder*	new_builder		(const gchar *file_name, 
 						 const gchar *array_name);
 static void		index			(SaryBuilder *builder,
@@ -68,6 +83,24 @@ static void		sort			(SaryBuilder *builder,
 static void		index_and_sort		(SaryBuilder *builder,
 						 const gchar *file_name,
 						 const gchar *array_name);
+static void		pack			(SaryBuilder *builder,
+						 const gchar *file_name,
+						 const gchar *array_name);
+static void		make_lcp		(SaryBuilder *builder,
+						 const gchar *file_name,
+						 const gchar *array_name);
+static void		make_prefix		(SaryBuilder *builder,
+						 const gchar *file_name,
+						 const gchar *array_name);
+static void		make_child		(SaryBuilder *builder,
+						 const gchar *file_name,
+						 const gchar *array_name);
+static void		make_sample		(SaryBuilder *builder,
+						 const gchar *file_name,
+						 const gchar *array_name);
+static void		make_fmindex		(SaryBuilder *builder,
+						 const gchar *file_name,
+						 const gchar *array_name);
 static void		print_time		(SaryProgress *progress, 
 						 time_t t);
 static void		print_eta		(SaryProgress *progress);
@@ -79,7 +112,7 @@ static void		show_help		(void);
 static void		show_mini_help		(void);
 static void		show_version		(void);
 static SaryInt		ck_atoi			(gchar const *str, 
-						 gint *out);
+						 SaryInt *out);
 
 static SaryIpointFunc	ipoint_func   = sary_ipoint_char_ascii;
 static SaryProgressFunc progress_func = progress_bar;
@@ -87,7 +120,20 @@ static ProcessFunc 	process       = index_and_sort;
 static SortFunc		sort_func     = sary_builder_sort;
 static gchar*		array_name    = NULL;
 static SaryInt		block_size    = 4 * 1024 * 1024; /* 4 MB */
-static SaryInt		nthreads      = 1;
+static gboolean		block_size_set = FALSE;
+static SaryInt		nthreads      = 0;  /* 0 for the default */
+static SarySortEngine	sort_engine   = SARY_SORT_MKQSORT;
+static SaryInt		offset_width  = 0;  /* 0 for the default */
+static gboolean		packed        = FALSE;
+static gboolean		native        = FALSE;
+static SaryInt		memory_limit  = -1; /* in MB, -1 for no limit */
+static SaryInt		fanin         = 0;  /* 0 for the default */
+static SaryInt		depth         = 0;  /* 0 for full sorting */
+static gboolean		lcp           = FALSE;
+static SaryInt		prefix        = 0;  /* bytes, 0 for no table */
+static gboolean		child         = FALSE;
+static SaryInt		sample        = 0;  /* interval, 0 for none */
+static SaryInt		fmindex       = 0;  /* interval, 0 for none */
 
 int
 main (int argc, char **argv)
@@ -108,6 +154,24 @@ main (int argc, char **argv)
 
     builder = new_builder(file_name, array_name);
     process(builder, file_name, array_name);
+    if (packed == TRUE && process != index) {
+	pack(builder, file_name, array_name);
+    }
+    if (lcp == TRUE && process != index) {
+	make_lcp(builder, file_name, array_name);
+    }
+    if (prefix > 0 && process != index) {
+	make_prefix(builder, file_name, array_name);
+    }
+    if (child == TRUE && process != index) {
+	make_child(builder, file_name, array_name);
+    }
+    if (sample > 0 && process != index) {
+	make_sample(builder, file_name, array_name);
+    }
+    if (fmindex > 0 && process != index) {
+	make_fmindex(builder, file_name, array_name);
+    }
 
     sary_builder_destroy(builder);
     g_free(array_name);
@@ -129,6 +193,20 @@ dispatch_codeset_func (const gchar *codeset)
     return sary_ipoint_char_ascii;
 }
 
+static SarySortEngine
+dispatch_sort_engine (const gchar *name)
+{
+    SortEngine *cursor;
+
+    for (cursor = sort_engine_tab; cursor->name != NULL; cursor++) {
+	if (g_strcasecmp(cursor->name, name) == 0) {
+	    return cursor->engine;
+	}
+    }
+    g_warning("invalid sort engine: %s", name);
+    return SARY_SORT_MKQSORT;
+}
+
 static SaryBuilder *
 new_builder (const gchar *file_name, const gchar *array_name)
 {
@@ -141,8 +219,29 @@ new_builder (const gchar *file_name, const gchar *array_name)
 	exit(EXIT_FAILURE);
     }
 
-    sary_builder_set_block_size(builder, block_size);
-    sary_builder_set_nthreads(builder, nthreads);
+    /*
+     * Leave the block size to the memory limit unless -b
+     * is given one.
+     */
+    if (block_size_set || memory_limit == -1) {
+	sary_builder_set_block_size(builder, block_size);
+    }
+    if (nthreads != 0) {
+	sary_builder_set_nthreads(builder, nthreads);
+    }
+    if (fanin != 0) {
+	sary_builder_set_fanin(builder, fanin);
+    }
+    sary_builder_set_depth(builder, depth);
+    if (memory_limit != -1) {
+	sary_builder_set_memory_limit(builder, 
+				      (gsize)memory_limit * 1024 * 1024);
+    }
+    sary_builder_set_sort_engine(builder, sort_engine);
+    if (offset_width != 0) {
+	sary_builder_set_offset_width(builder, offset_width);
+    }
+    sary_builder_set_native(builder, native);
     sary_builder_set_ipoint_func(builder, ipoint_func);
     sary_builder_connect_progress(builder, progress_func, NULL);
     return builder;
@@ -181,15 +280,99 @@ sort (SaryBuilder *builder,
 }
 
 
+/*
+ * Block sorting indexes and sorts at once so that the
+ * unsorted array is never written.
+ */
 static void
 index_and_sort (SaryBuilder *builder,
 		const gchar *file_name, 
 		const gchar *array_name)
 {
+    if (sort_func == sary_builder_block_sort) {
+	if (sary_builder_index_and_block_sort(builder) == FALSE) {
+	    g_printerr("mksary: %s, %s: %s\n", file_name, array_name,
+		       g_strerror(errno));
+	    exit(EXIT_FAILURE);
+	}
+	return;
+    }
     index(builder, file_name, array_name);
     sort(builder, file_name, array_name);
 }
 
+static void
+make_lcp (SaryBuilder *builder,
+	  const gchar *file_name,
+	  const gchar *array_name)
+{
+    if (sary_builder_make_lcp(builder) == FALSE) {
+	g_printerr("mksary: %s, %s: %s\n", file_name, array_name,
+		   g_strerror(errno));
+	exit(EXIT_FAILURE);
+    }
+}
+
+static void
+make_prefix (SaryBuilder *builder,
+	     const gchar *file_name,
+	     const gchar *array_name)
+{
+    if (sary_builder_make_prefix(builder, prefix) == FALSE) {
+	g_printerr("mksary: %s, %s: %s\n", file_name, array_name,
+		   g_strerror(errno));
+	exit(EXIT_FAILURE);
+    }
+}
+
+static void
+make_child (SaryBuilder *builder,
+	    const gchar *file_name,
+	    const gchar *array_name)
+{
+    if (sary_builder_make_child(builder) == FALSE) {
+	g_printerr("mksary: %s, %s: %s\n", file_name, array_name,
+		   g_strerror(errno));
+	exit(EXIT_FAILURE);
+    }
+}
+
+static void
+pack (SaryBuilder *builder,
+      const gchar *file_name,
+      const gchar *array_name)
+{
+    if (sary_builder_pack(builder) == FALSE) {
+	g_printerr("mksary: %s, %s: %s\n", file_name, array_name,
+		   g_strerror(errno));
+	exit(EXIT_FAILURE);
+    }
+}
+
+static void
+make_sample (SaryBuilder *builder,
+	     const gchar *file_name,
+	     const gchar *array_name)
+{
+    if (sary_builder_make_sample(builder, sample) == FALSE) {
+	g_printerr("mksary: %s, %s: %s\n", file_name, array_name,
+		   g_strerror(errno));
+	exit(EXIT_FAILURE);
+    }
+}
+
+static void
+make_fmindex (SaryBuilder *builder,
+	      const gchar *file_name,
+	      const gchar *array_name)
+{
+    if (sary_builder_make_fmindex(builder, fmindex) == FALSE) {
+	g_printerr("mksary: %s, %s: %s\n", file_name, array_name,
+		   g_strerror(errno));
+	exit(EXIT_FAILURE);
+    }
+}
+
 static void
 print_time (SaryProgress *progress, time_t t)
 {
@@ -210,8 +393,8 @@ static void
 print_eta (SaryProgress *progress)
 {
     time_t eta;
-    gint current   = progress->current;
-    gint total     = progress->total;
+    SaryInt current = progress->current;
+    SaryInt total   = progress->total;
     time_t elapsed = time(NULL) - progress->start_time;
 
     if (progress->is_finished) {
@@ -255,14 +438,19 @@ progress_bar (SaryProgress *progress)
     /*
      * Adding one for avoiding "division by zero" error.
      */
-    gint current  = progress->current  + 1;
-    gint previous = progress->previous + 1;
-    gint total    = progress->total    + 1;
+    SaryInt current  = progress->current  + 1;
+    SaryInt previous = progress->previous + 1;
+    SaryInt total    = progress->total    + 1;
 
     cur_percentage  = (gint)((gdouble)current  * 100 / total);
     prev_percentage = (gint)((gdouble)previous * 100 / total);
     bar_len         = (gint)((gdouble)current  * scale / total);
 
+    if (progress->is_finished && progress->message != NULL) {
+	g_print("%s:\t%s\n", progress->task, progress->message);
+	return;
+    }
+
     if (cur_percentage > prev_percentage || progress->is_finished) {
 	  g_print("%s:	%3d%% |%.*s%*s| ", progress->task, 
 		  cur_percentage, bar_len, bar, scale - bar_len, "");
@@ -284,19 +472,30 @@ progress_quiet (SaryProgress *progress)
     /* do nothing */
 }
 
-static const char *short_options = "a:b::c:hilLqst:w";
+static const char *short_options = "a:b::c:d:e:f:F::hilLm::NpP::qsS::t:wW:x";
 static struct option long_options[] = {
     { "array",		required_argument,		NULL, 'a' },
     { "block",		optional_argument,		NULL, 'b' },
     { "encoding",	required_argument,		NULL, 'c' },
+    { "depth",		required_argument,		NULL, 'd' },
+    { "engine",		required_argument,		NULL, 'e' },
+    { "fan-in",		required_argument,		NULL, 'f' },
+    { "fm-index",	optional_argument,		NULL, 'F' },
     { "help",		no_argument,			NULL, 'h' },
     { "index",		no_argument,			NULL, 'i' },
     { "line",		no_argument,			NULL, 'l' },
     { "locale",		no_argument,			NULL, 'L' },
+    { "memory-limit",	optional_argument,		NULL, 'm' },
+    { "native",		no_argument,			NULL, 'N' },
+    { "lcp",		no_argument,			NULL, 'p' },
+    { "prefix",		optional_argument,		NULL, 'P' },
     { "quiet",		no_argument,			NULL, 'q' },
     { "sort",		no_argument,			NULL, 's' },
-    { "threads",	no_argument,			NULL, 't' },
+    { "sample",		optional_argument,		NULL, 'S' },
+    { "threads",	required_argument,		NULL, 't' },
     { "word",		no_argument,			NULL, 'w' },
+    { "width",		required_argument,		NULL, 'W' },
+    { "child",		no_argument,			NULL, 'x' },
     { "version",	no_argument,			NULL, 'v' },
     { NULL, 0, NULL, 0 }
 };
@@ -308,6 +507,12 @@ show_help (void)
 Usage: mksary [OPTION]... FILE\n\
   -a, --array=NAME       set the array file name to NAME\n\
   -b, --block=[SIZE]     sort block by block with SIZE [%d] KB block\n\
+  -m, --memory-limit=[SIZE]\n\
+                         sort block by block within SIZE MB of memory\n\
+                         choosing the block size and the number of\n\
+                         threads unless given [free physical memory]\n\
+  -f, --fan-in=NUM       merge NUM blocks at most at once in block sorting\n\
+                         with several passes for more blocks\n\
   -i, --index            assign index points and write them to an array file\n\
   -s, --sort             sort an array file\n\
   -l, --line             index every line\n\
@@ -315,8 +520,45 @@ Usage: mksary [OPTION]... FILE\n\
   -c, --encoding=NAME    handle NAME encoding for indexing\n\
                          [bytestream], ASCII, ISO-8859,\n\
                          EUC-JP, Shift_JIS, UTF-8\n\
+  -d, --depth=BYTES      sort suffixes by their first BYTES bytes only,\n\
+                         which is faster for repetitive texts; longer\n\
+                         patterns are verified with the text in search\n\
+  -e, --engine=NAME      sort with NAME engine: [mkqsort], sais, cached,\n\
+                         qsufsort, auto\n\
+                         (sais requires bytestream index points)\n\
+                         (cached needs more memory but reads\n\
+                          the text less while sorting)\n\
+                         (qsufsort needs 2 offsets per byte of the text\n\
+                          but is fast for repetitive texts)\n\
+                         (auto chooses the engine, the block size and\n\
+                          the number of threads from samples of the text)\n\
+  -p, --lcp              also write the LCP array to a sidecar file,\n\
+                         FILE.lcp for FILE.ary, which speeds up\n\
+                         searches for long patterns\n\
+  -P, --prefix=[BYTES]   also write the ranges of all BYTES [2] byte\n\
+                         prefixes, 1 to 3, to FILE.pfx for FILE.ary,\n\
+                         which shortcuts the first steps of searches\n\
+  -x, --child            also write the child table of the enhanced\n\
+                         suffix array to FILE.cld for FILE.ary, with\n\
+                         the LCP file, which finds a pattern in time\n\
+                         independent of the size of the text\n\
+  -S, --sample=[INTERVAL]\n\
+                         also write every INTERVAL [128]-th suffix with\n\
+                         its first bytes to FILE.smp for FILE.ary, which\n\
+                         searches keep in memory to read fewer pages\n\
+  -F, --fm-index=[INTERVAL]\n\
+                         also write the FM-index of the text to FILE.fmi\n\
+                         for FILE.ary, sampling every INTERVAL [32]-th\n\
+                         offset, which searches use instead of FILE.ary\n\
+                         (requires bytestream index points)\n\
+  -W, --width=BITS       write BITS wide offsets: 32, 40 or 64\n\
+                         [32 if the text is smaller than 2 GB], or\n\
+                         `packed' for as few bits as the text needs\n\
+  -N, --native           write a header identifying the text, which\n\
+                         searches check, and 32 or 64 bit offsets in\n\
+                         the native byte order\n\
   -L, --locale           enable locale support (use mblen for indexing)\n\
-  -t, --threads=NUM      set number of threads for block sorting to NUM\n\
+  -t, --threads=NUM      set number of threads for indexing and sorting to NUM\n\
   -q, --quiet            suppress all normal output\n\
   -v, --version          print version information and exit\n\
   -h, --help             display this help and exit\n\
@@ -346,6 +588,7 @@ parse_options (int argc, char **argv)
 		    exit(EXIT_FAILURE);
 		}
 		block_size = block_size * 1024;
+		block_size_set = TRUE;
 		if (block_size == 0) {
 		    block_size = sizeof(SaryInt);  /* for test suites */
 		}
@@ -354,6 +597,33 @@ parse_options (int argc, char **argv)
 	case 'c':
 	    ipoint_func = dispatch_codeset_func(optarg);
 	    break;
+	case 'd':
+	    if (ck_atoi(optarg, &depth) || depth == 0) {
+		g_printerr("mksary: invalid depth argument\n");
+		exit(EXIT_FAILURE);
+	    }
+	    break;
+	case 'e':
+	    sort_engine = dispatch_sort_engine(optarg);
+	    if (sort_engine == SARY_SORT_AUTO) {
+		sort_func = sary_builder_block_sort;
+	    }
+	    break;
+	case 'f':
+	    if (ck_atoi(optarg, &fanin) || fanin < 2) {
+		g_printerr("mksary: invalid fan-in argument\n");
+		exit(EXIT_FAILURE);
+	    }
+	    break;
+	case 'F':
+	    fmindex = 32;
+	    if (optarg) {
+		if (ck_atoi(optarg, &fmindex) || fmindex < 1) {
+		    g_printerr("mksary: invalid fm-index argument\n");
+		    exit(EXIT_FAILURE);
+		}
+	    }
+	    break;
 	case 'h':
 	    show_help();
 	    break;
@@ -369,12 +639,46 @@ parse_options (int argc, char **argv)
 	    }
 	    ipoint_func = sary_ipoint_locale;
 	    break;
+	case 'm':
+	    sort_func    = sary_builder_block_sort;
+	    memory_limit = 0;
+	    if (optarg) {
+		if (ck_atoi(optarg, &memory_limit) || memory_limit == 0) {
+		    g_printerr("mksary: invalid memory limit argument\n");
+		    exit(EXIT_FAILURE);
+		}
+	    }
+	    break;
+	case 'N':
+	    native = TRUE;
+	    break;
+	case 'p':
+	    lcp = TRUE;
+	    break;
+	case 'P':
+	    prefix = 2;
+	    if (optarg) {
+		if (ck_atoi(optarg, &prefix) || prefix < 1 || prefix > 3) {
+		    g_printerr("mksary: invalid prefix argument\n");
+		    exit(EXIT_FAILURE);
+		}
+	    }
+	    break;
 	case 'q':
 	    progress_func = progress_quiet;
 	    break;
 	case 's':
 	    process = sort;
 	    break;
+	case 'S':
+	    sample = 128;
+	    if (optarg) {
+		if (ck_atoi(optarg, &sample) || sample < 1) {
+		    g_printerr("mksary: invalid sample argument\n");
+		    exit(EXIT_FAILURE);
+		}
+	    }
+	    break;
 	case 't':
 	    if (optarg) {
 		if (ck_atoi(optarg, &nthreads)) {
@@ -386,15 +690,26 @@ parse_options (int argc, char **argv)
 	case 'w':
 	    ipoint_func = sary_ipoint_word;
 	    break;
+	case 'x':
+	    child = TRUE;
+	    lcp   = TRUE;
+	    break;
+	case 'W':
+	    if (g_strcasecmp(optarg, "packed") == 0) {
+		packed = TRUE;
+	    } else if (ck_atoi(optarg, &offset_width) ||
+		(offset_width != 32 && offset_width != 40 && 
+		 offset_width != 64))
+	    {
+		g_printerr("mksary: invalid width argument\n");
+		exit(EXIT_FAILURE);
+	    }
+	    break;
 	case 'v':
 	    show_version();
 	    break;
 	}
     }
-    if (nthreads > 1 && sort_func != sary_builder_block_sort) {
-	g_print("mksary: -t option must be used with -b option.\n");
-	exit(EXIT_FAILURE);
-    }
 }
 
 
@@ -432,7 +747,7 @@ GNU Lesser General Public License for more details.\n\
  * (otherwise 0).
  */
 static SaryInt
-ck_atoi (gchar const *str, gint *out)
+ck_atoi (gchar const *str, SaryInt *out)
 {
     gchar const *p;
     for (p = str; *p; p++) {
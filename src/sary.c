@@ -78,7 +78,7 @@ static void	show_help		(void);
 static void	show_mini_help		(void);
 static void	show_version		(void);
 static void	parse_options		(int argc, char **argv);
-static SaryInt	ck_atoi			(gchar const *str, gint *out);
+static SaryInt	ck_atoi			(gchar const *str, SaryInt *out);
 static void	sort_lexicographical	(SarySearcher *searcher);
 
 static struct grep {
@@ -189,7 +189,7 @@ static void
 grep_count (SarySearcher *searcher, const gchar *pattern)
 {
     if (search(searcher, pattern)) {
-	g_print("%d\n", sary_searcher_count_occurrences(searcher));
+	g_print("%ld\n", (glong)sary_searcher_count_occurrences(searcher));
     } else {
 	g_print("0\n");
     }
@@ -448,7 +448,7 @@ parse_options (int argc, char **argv)
  * (otherwise 0).
  */
 static SaryInt
-ck_atoi (gchar const *str, gint *out)
+ck_atoi (gchar const *str, SaryInt *out)
 {
     gchar const *p;
     for (p = str; *p; p++) {
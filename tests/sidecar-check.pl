@@ -0,0 +1,90 @@
+#
+# Check searches with a sidecar file of an array, such as
+# the LCP file, against the same searches without it.
+#
+#   % perl sidecar-check.pl EXT OPTIONS...
+#
+# For each OPTIONS, make an array with mksary OPTIONS which
+# must write the sidecar file FILE.EXT, count every pattern
+# with and without the file and compare the counts. They are
+# also compared with the number of occurrences in the text
+# unless OPTIONS index lines or words. At last, a new array
+# made without OPTIONS must drop the stale file.
+#
+
+require 5.004;
+
+$sary   = "../src/sary";
+$mksary = "../src/mksary";
+
+($ext, @options) = @ARGV;
+die "usage: sidecar-check.pl EXT OPTIONS...\n" unless @options;
+
+$file    = "tmp.sidecar-$ext.txt";
+$sidecar = "$file.$ext";
+
+# Few symbols for full buckets and deep intervals, long
+# repeats with a few variations for lcp beyond a byte, and
+# a high byte.
+srand(1);
+@sym  = ("a", "b", "c", "\xff");
+$text = join "", map { $sym[int(rand(4))] } 1..4000;
+for (1..200) {
+    $text .= "0123456789abcdefghijklmnopqrstuvwxyz";
+    $text .= int(rand(10)) if rand() < 0.1;
+}
+$text .= "ab";
+open(TEXT, ">$file") || die "$file: $!\n";
+print TEXT $text;
+close(TEXT);
+
+# Substrings of up to 5, 40 and 600 bytes, the ones with the
+# last byte changed, and ones running beyond the end.
+srand(2);
+for $max (5, 40, 600) {
+    for (1..25) {
+	$pat = substr($text, int(rand(length $text)), 1 + int(rand($max)));
+	push @patterns, $pat;
+	chop $pat;
+	push @patterns, "${pat}x";
+    }
+}
+push @patterns, "b", "abc", "ab\xff", substr($text, -5) . "0",
+    substr($text, -20), substr($text, -40);
+
+for $opt (@options) {
+    unlink $sidecar;
+    system("$mksary -q $opt $file") == 0 || fail("mksary $opt");
+    -f $sidecar || fail("mksary $opt: no $sidecar");
+    for $pat (@patterns) {
+	$with = `$sary -c '$pat' $file`;
+	rename($sidecar, "$sidecar.save");
+	$without = `$sary -c '$pat' $file`;
+	rename("$sidecar.save", $sidecar);
+	$with eq $without || fail("$opt: $pat: $with != $without");
+	next if $opt =~ /(^|\s)-[lw]\b/;
+	$count{$pat} = count($pat) unless defined $count{$pat};
+	$with == $count{$pat} || fail("$opt: $pat: $with != $count{$pat}");
+    }
+}
+
+# A new array drops the stale sidecar file.
+system("$mksary -q $file") == 0 || fail("mksary");
+-f $sidecar && fail("stale $sidecar");
+
+exit 0;
+
+sub count {
+    my ($pat) = @_;
+    my $n = 0;
+
+    $n++ while $text =~ /(?=\Q$pat\E)/g;
+    return $n;
+}
+
+sub fail {
+    my ($msg) = @_;
+
+    print STDERR "sidecar-check.pl: $msg\n";
+    exit 1;
+}